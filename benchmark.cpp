@@ -0,0 +1,886 @@
+#include "benchmark.h"
+#include "log_duration.h"
+#include "concurrent_map.h"
+#include "process_queries.h"
+#include "concurrent_search_server.h"
+#include "sharded_search_server.h"
+#include "remove_duplicates.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <thread>
+
+using namespace std::literals;
+
+std::string GenerateWord(std::mt19937 &generator, int max_length) {
+  const int length = std::uniform_int_distribution(1, max_length)(generator);
+  std::string word;
+  word.reserve(length);
+  for (int i = 0; i < length; ++i) {
+    word.push_back(std::uniform_int_distribution('a', 'z')(generator));
+  }
+  return word;
+}
+
+std::vector<std::string> GenerateDictionary(std::mt19937 &generator, int word_count, int max_length) {
+  std::vector<std::string> words;
+  words.reserve(word_count);
+  for (int i = 0; i < word_count; ++i) {
+    words.push_back(GenerateWord(generator, max_length));
+  }
+  std::sort(words.begin(), words.end());
+  words.erase(unique(words.begin(), words.end()), words.end());
+  std::shuffle(words.begin(), words.end(), generator);
+  return words;
+}
+
+std::string GenerateText(std::mt19937 &generator, const std::vector<std::string> &dictionary, int word_count,
+                         double minus_prob) {
+  std::string text;
+  for (int i = 0; i < word_count; ++i) {
+    if (i > 0) {
+      text.push_back(' ');
+    }
+    if (std::uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+      text.push_back('-');
+    }
+    const double position = std::pow(std::uniform_real_distribution<>(0, 1)(generator), 3.0);
+    text += dictionary[static_cast<size_t>(position * dictionary.size())];
+  }
+  return text;
+}
+
+std::vector<std::string> GenerateTexts(std::mt19937 &generator, const std::vector<std::string> &dictionary,
+                                       int text_count, int max_word_count, double minus_prob) {
+  std::vector<std::string> texts;
+  texts.reserve(text_count);
+  for (int i = 0; i < text_count; ++i) {
+    const int word_count = std::uniform_int_distribution(1, max_word_count)(generator);
+    texts.push_back(GenerateText(generator, dictionary, word_count, minus_prob));
+  }
+  return texts;
+}
+
+SearchServer GenerateSearchServer(std::mt19937 &generator, const std::vector<std::string> &dictionary,
+                                  int document_count, int max_word_count) {
+  SearchServer search_server(dictionary[0]);
+  std::vector<std::string> documents;
+  documents.reserve(document_count);
+  for (int id = 0; id < document_count; ++id) {
+    const int word_count = std::uniform_int_distribution(max_word_count / 2, max_word_count)(generator);
+    documents.push_back(GenerateText(generator, dictionary, word_count));
+  }
+  for (int id = 0; id < document_count; ++id) {
+    search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL,
+                              {std::uniform_int_distribution(-10, 10)(generator)});
+  }
+  return search_server;
+}
+
+namespace {
+
+// ConcurrentMap as it was before sharded open addressing, kept as the baseline
+template<typename Key, typename Value>
+class LegacyConcurrentMap {
+ private:
+  struct Bucket {
+    std::mutex mx_;
+    std::map<Key, Value> map_;
+  };
+
+  std::vector<Bucket> buckets_;
+
+ public:
+  explicit LegacyConcurrentMap(size_t bucket_count)
+      : buckets_(bucket_count) {
+  }
+
+  void Accumulate(const Key &key, const Value &delta) {
+    auto &bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+    std::lock_guard lock(bucket.mx_);
+    bucket.map_[key] += delta;
+  }
+};
+
+template<typename Map>
+void RunConcurrentAccumulation(const std::string &name, Map &map, int thread_count, int operation_count, int key_count) {
+  LOG_DURATION_STREAM(name + " threads = "s + std::to_string(thread_count), std::cout);
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < thread_count; ++thread) {
+    threads.emplace_back([&map, thread, thread_count, operation_count, key_count] {
+      std::mt19937 generator(thread);
+      for (int i = 0; i < operation_count / thread_count; ++i) {
+        map.Accumulate(std::uniform_int_distribution(0, key_count - 1)(generator), 1.0);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+bool IsSameResult(const std::vector<Document> &lhs, const std::vector<Document> &rhs) {
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document &l, const Document &r) {
+    return l.id == r.id && l.relevance == r.relevance && l.rating == r.rating;
+  });
+}
+
+}
+
+void BenchmarkPruning() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto search_server = GenerateSearchServer(generator, dictionary, 50'000, 100);
+
+  for (const int query_length : {2, 8, 32}) {
+    const auto queries = GenerateTexts(generator, dictionary, 200, query_length, 0.1);
+    std::vector<std::vector<Document>> exhaustive(queries.size());
+    std::vector<std::vector<Document>> pruned(queries.size());
+    std::cout << "Queries up to "s << query_length << " words"s << std::endl;
+    {
+      LOG_DURATION_STREAM("  exhaustive"s, std::cout);
+      for (size_t i = 0; i < queries.size(); ++i) {
+        exhaustive[i] = search_server.FindTopDocuments(queries[i]);
+      }
+    }
+    {
+      LOG_DURATION_STREAM("  pruned"s, std::cout);
+      for (size_t i = 0; i < queries.size(); ++i) {
+        pruned[i] = search_server.FindTopDocumentsPruned(queries[i]);
+      }
+    }
+    for (size_t i = 0; i < queries.size(); ++i) {
+      assert(IsSameResult(exhaustive[i], pruned[i]));
+    }
+  }
+}
+
+void BenchmarkParallelSearch() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto search_server = GenerateSearchServer(generator, dictionary, 100'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 100, 16, 0.1);
+
+  std::vector<std::vector<Document>> seq_results(queries.size());
+  std::vector<std::vector<Document>> par_results(queries.size());
+  {
+    LOG_DURATION_STREAM("FindTopDocuments seq"s, std::cout);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      seq_results[i] = search_server.FindTopDocuments(std::execution::seq, queries[i]);
+    }
+  }
+  {
+    LOG_DURATION_STREAM("FindTopDocuments par"s, std::cout);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      par_results[i] = search_server.FindTopDocuments(std::execution::par, queries[i]);
+    }
+  }
+  for (size_t i = 0; i < queries.size(); ++i) {
+    assert(IsSameResult(seq_results[i], par_results[i]));
+  }
+}
+
+void BenchmarkConcurrentMap() {
+  const int operation_count = 2'000'000;
+  const int key_count = 100'000;
+  const size_t shard_count = 64;
+  for (const int thread_count : {1, 2, 4, 8, 16, 32, 64}) {
+    {
+      LegacyConcurrentMap<int, double> map(shard_count);
+      RunConcurrentAccumulation("legacy ConcurrentMap"s, map, thread_count, operation_count, key_count);
+    }
+    {
+      ConcurrentMap<int, double> map(shard_count);
+      RunConcurrentAccumulation("ConcurrentMap"s, map, thread_count, operation_count, key_count);
+    }
+    {
+      ConcurrentAccumulator<int, double> map(key_count, -1);
+      RunConcurrentAccumulation("ConcurrentAccumulator"s, map, thread_count, operation_count, key_count);
+    }
+  }
+}
+
+void BenchmarkQueryBatch() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto search_server = GenerateSearchServer(generator, dictionary, 20'000, 100);
+  // Few distinct head words, so queries share most of their terms
+  const std::vector<std::string> head_words(dictionary.begin(), dictionary.begin() + 200);
+  const auto queries = GenerateTexts(generator, head_words, 2'000, 8, 0.1);
+
+  std::vector<std::vector<Document>> independent_results(queries.size());
+  {
+    LOG_DURATION_STREAM("independent queries"s, std::cout);
+    std::transform(std::execution::par, queries.begin(), queries.end(), independent_results.begin(),
+                   [&search_server](const std::string &query) {
+                     return search_server.FindTopDocuments(query);
+                   });
+  }
+  QueryResultArena batch_results;
+  {
+    LOG_DURATION_STREAM("query batch"s, std::cout);
+    search_server.FindTopDocumentsBatch(queries, batch_results);
+  }
+  for (size_t i = 0; i < queries.size(); ++i) {
+    assert(IsSameResult(independent_results[i], {batch_results[i].begin(), batch_results[i].end()}));
+  }
+}
+
+void BenchmarkConcurrentIngestion() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto documents = GenerateTexts(generator, dictionary, 40'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 1'000, 8, 0.1);
+  ConcurrentSearchServer search_server(dictionary[0]);
+  for (int id = 0; id < 20'000; ++id) {
+    search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {1});
+  }
+
+  const auto measure_queries = [&](bool with_ingestion) {
+    std::atomic<bool> is_running = true;
+    std::atomic<int> query_count = 0;
+    std::vector<std::thread> readers;
+    const int reader_count = std::max<int>(std::thread::hardware_concurrency() - 1, 1);
+    for (int reader = 0; reader < reader_count; ++reader) {
+      readers.emplace_back([&, reader] {
+        for (size_t i = reader; is_running; i = (i + 1) % queries.size()) {
+          search_server.FindTopDocuments(queries[i]);
+          ++query_count;
+        }
+      });
+    }
+    int added_count = 0;
+    const auto finish = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (std::chrono::steady_clock::now() < finish) {
+      if (with_ingestion && added_count < 20'000) {
+        search_server.AddDocument(20'000 + added_count, documents[20'000 + added_count], DocumentStatus::ACTUAL, {1});
+        search_server.RemoveDocument(added_count);
+        ++added_count;
+      } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    is_running = false;
+    for (auto &reader : readers) {
+      reader.join();
+    }
+    std::cout << (with_ingestion ? "with"s : "without"s) << " ingestion: "s << query_count << " queries/s, "s
+              << added_count << " documents replaced/s"s << std::endl;
+  };
+  measure_queries(false);
+  measure_queries(true);
+}
+
+void BenchmarkSegmentIngestion() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto documents = GenerateTexts(generator, dictionary, 100'000, 100);
+  SearchServer search_server(dictionary[0]);
+  // Every batch should take about the same time however large the index already is
+  for (int batch = 0; batch < 5; ++batch) {
+    LOG_DURATION_STREAM("  add documents "s + std::to_string(batch * 20'000) + "-"s + std::to_string((batch + 1) * 20'000),
+                        std::cout);
+    for (int id = batch * 20'000; id < (batch + 1) * 20'000; ++id) {
+      search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {1});
+    }
+  }
+  {
+    LOG_DURATION_STREAM("  remove 20000 documents"s, std::cout);
+    for (int id = 0; id < 100'000; id += 5) {
+      search_server.RemoveDocument(id);
+    }
+  }
+  {
+    LOG_DURATION_STREAM("  wait for merges"s, std::cout);
+    search_server.WaitForMerges();
+  }
+  std::cout << "  "s << search_server.GetSegmentCount() << " segments"s << std::endl;
+}
+
+void BenchmarkIndexLoading() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto documents = GenerateTexts(generator, dictionary, 100'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 200, 8, 0.1);
+  const std::string path = "benchmark_index.idx"s;
+  {
+    SearchServer search_server(dictionary[0]);
+    {
+      LOG_DURATION_STREAM("  build from text"s, std::cout);
+      for (int id = 0; id < 100'000; ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+      }
+    }
+    {
+      LOG_DURATION_STREAM("  save index"s, std::cout);
+      search_server.SaveIndex(path);
+    }
+  }
+  {
+    LOG_DURATION_STREAM("  load index, verifying checksums"s, std::cout);
+    SearchServer::LoadIndex(path);
+  }
+  SearchServer rebuilt(dictionary[0]);
+  for (int id = 0; id < 100'000; ++id) {
+    rebuilt.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+  }
+  std::optional<SearchServer> loaded;
+  {
+    LOG_DURATION_STREAM("  load index"s, std::cout);
+    loaded.emplace(SearchServer::LoadIndex(path, false));
+  }
+  for (const std::string &query : queries) {
+    assert(IsSameResult(loaded->FindTopDocuments(query), rebuilt.FindTopDocuments(query)));
+  }
+  std::remove(path.c_str());
+}
+
+void BenchmarkPostingCompression() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto documents = GenerateTexts(generator, dictionary, 100'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 1'000, 8, 0.1);
+  SearchServer search_server(dictionary[0]);
+  for (int id = 0; id < 100'000; ++id) {
+    search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+  }
+  search_server.WaitForMerges();
+  std::cout << "  "s << search_server.GetPostingByteCount() * 1.0 / search_server.GetPostingCount()
+            << " bytes/posting, "s << sizeof(Posting) << " uncompressed"s << std::endl;
+  {
+    LOG_DURATION_STREAM("  1000 queries"s, std::cout);
+    for (const std::string &query : queries) {
+      search_server.FindTopDocuments(query);
+    }
+  }
+
+  // A long list with the gaps of a common term
+  std::vector<Posting> postings;
+  std::geometric_distribution<uint32_t> gap(0.25);
+  std::geometric_distribution<uint32_t> count(0.7);
+  uint32_t document_index = 0;
+  for (int i = 0; i < 10'000'000; ++i) {
+    document_index += gap(generator) + 1;
+    const uint32_t term_count = count(generator) + 1;
+    postings.push_back({document_index, term_count, ComputeTermFreq(term_count, 1.0 / 100)});
+  }
+  const std::vector<double> inv_word_counts(document_index + 1, 1.0 / 100);
+  std::vector<PostingBlock> blocks;
+  std::vector<uint32_t> words;
+  EncodePostings(postings.data(), postings.data() + postings.size(), blocks, words);
+  const PostingList plain(postings.data(), postings.data() + postings.size(), 1.0);
+  const PostingList compressed(blocks.data(), blocks.data() + blocks.size(), words.data(), inv_word_counts.data(), 0, 1.0);
+  std::cout << "  "s << compressed.GetByteCount() * 1.0 / postings.size() << " bytes/posting in a long list"s
+            << std::endl;
+  for (const PostingList *list : {&plain, &compressed}) {
+    const auto start = std::chrono::steady_clock::now();
+    double term_freq_sum = 0.0;
+    for (PostingCursor cursor(*list); !cursor.IsEnd(); cursor.Next()) {
+      term_freq_sum += cursor->term_freq;
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    std::cout << "  "s << (list == &plain ? "plain"s : "compressed, "s + GetUnpackKernelName()) << ": "s
+              << postings.size() / duration.count() / 1e6 << " M postings/s"s << std::endl;
+    assert(term_freq_sum > 0.0);
+  }
+}
+
+void BenchmarkTokenizer() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto texts = GenerateTexts(generator, dictionary, 200'000, 100);
+  size_t word_count = 0;
+  {
+    LOG_DURATION_STREAM("  SplitIntoWords"s, std::cout);
+    for (const std::string &text : texts) {
+      word_count += SplitIntoWords(std::string_view(text)).size();
+    }
+  }
+  {
+    LOG_DURATION_STREAM("  WordSplitter"s, std::cout);
+    WordSplitter &splitter = WordSplitter::ForCurrentThread();
+    for (const std::string &text : texts) {
+      word_count -= splitter.Split(text).size();
+    }
+  }
+  assert(word_count == 0);
+  SearchServer search_server(dictionary[0]);
+  {
+    LOG_DURATION_STREAM("  AddDocument"s, std::cout);
+    for (int id = 0; id < 200'000; ++id) {
+      search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {1});
+    }
+  }
+}
+
+void BenchmarkBulkIngestion() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto texts = GenerateTexts(generator, dictionary, 200'000, 100);
+  std::vector<DocumentInput> documents;
+  documents.reserve(texts.size());
+  for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+    documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {id % 10}});
+  }
+  std::cout << "  "s << std::thread::hardware_concurrency() << " threads"s << std::endl;
+  SearchServer one_by_one(dictionary[0]);
+  {
+    LOG_DURATION_STREAM("  AddDocument one by one"s, std::cout);
+    for (const DocumentInput &document : documents) {
+      one_by_one.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+  }
+  SearchServer batched(dictionary[0]);
+  {
+    LOG_DURATION_STREAM("  AddDocuments par"s, std::cout);
+    batched.AddDocuments(std::execution::par, documents);
+  }
+  assert(batched.GetPostingCount() == one_by_one.GetPostingCount());
+}
+
+// TF-IDF is the default model, the one earlier benchmarks measure
+template<typename Scoring>
+void BenchmarkScoringModel(const std::string &name, const SearchServer &search_server,
+                           const std::vector<std::string> &queries) {
+  const auto is_actual = [](int document_id, DocumentStatus status, int rating) {
+    return status == DocumentStatus::ACTUAL;
+  };
+  {
+    LOG_DURATION_STREAM("  "s + name + " exhaustive"s, std::cout);
+    for (const std::string &query : queries) {
+      search_server.FindTopDocuments<Scoring>(query, is_actual);
+    }
+  }
+  {
+    LOG_DURATION_STREAM("  "s + name + " pruned"s, std::cout);
+    for (const std::string &query : queries) {
+      search_server.FindTopDocumentsPruned<Scoring>(query, is_actual);
+    }
+  }
+}
+
+void BenchmarkScoring() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto search_server = GenerateSearchServer(generator, dictionary, 100'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 1'000, 8, 0.1);
+  BenchmarkScoringModel<TfIdfScoring>("TF-IDF"s, search_server, queries);
+  BenchmarkScoringModel<Bm25Scoring>("BM25"s, search_server, queries);
+}
+
+void BenchmarkResultCache() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  auto search_server = GenerateSearchServer(generator, dictionary, 100'000, 100);
+  // Requests are drawn from 5'000 distinct queries so that the top 1% of them
+  // take about half of the traffic
+  const auto queries = GenerateTexts(generator, dictionary, 5'000, 8, 0.1);
+  std::vector<size_t> requests(20'000);
+  for (size_t &request : requests) {
+    request = static_cast<size_t>(std::pow(std::uniform_real_distribution<>(0, 1)(generator), 6.5) * queries.size());
+  }
+  {
+    LOG_DURATION_STREAM("  uncached"s, std::cout);
+    for (const size_t request : requests) {
+      search_server.FindTopDocuments(queries[request]);
+    }
+  }
+  search_server.EnableResultCache(1'000);
+  {
+    LOG_DURATION_STREAM("  cached"s, std::cout);
+    for (const size_t request : requests) {
+      search_server.FindTopDocumentsCached(queries[request]);
+    }
+  }
+  const QueryCacheStats stats = search_server.GetResultCacheStats();
+  std::cout << "  hit rate "s << stats.GetHitRate() << ", "s << stats.eviction_count << " evictions"s << std::endl;
+}
+
+void BenchmarkPhraseQueries() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto texts = GenerateTexts(generator, dictionary, 50'000, 100);
+  SearchServer search_server(dictionary[0], IndexOptions{true});
+  for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+    search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 10});
+  }
+  std::cout << "  positions "s << search_server.GetPositionByteCount() << " bytes, postings "s
+            << search_server.GetPostingByteCount() << " bytes"s << std::endl;
+
+  // Two adjacent words of some document, so that every phrase matches
+  std::vector<std::string> phrases;
+  while (phrases.size() < 200) {
+    const auto words = SplitIntoWords(texts[std::uniform_int_distribution<size_t>(0, texts.size() - 1)(generator)]);
+    if (words.size() >= 2 && words[0] != dictionary[0] && words[1] != dictionary[0]) {
+      phrases.push_back(words[0] + " "s + words[1]);
+    }
+  }
+  const auto any_document = [](int document_id, DocumentStatus status, int rating) {
+    return true;
+  };
+  size_t post_filtered_count = 0;
+  {
+    LOG_DURATION_STREAM("  search, then filter texts"s, std::cout);
+    for (const std::string &phrase : phrases) {
+      std::vector<Document> documents;
+      for (const Document &document : search_server.FindTopDocuments(phrase, any_document, texts.size())) {
+        if ((" "s + texts[document.id] + " "s).find(" "s + phrase + " "s) != std::string::npos) {
+          documents.push_back(document);
+        }
+      }
+      post_filtered_count += std::min<size_t>(documents.size(), MAX_RESULT_DOCUMENT_COUNT);
+    }
+  }
+  size_t phrase_count = 0;
+  {
+    LOG_DURATION_STREAM("  phrase query"s, std::cout);
+    for (const std::string &phrase : phrases) {
+      phrase_count += search_server.FindTopDocuments("\""s + phrase + "\""s, any_document).size();
+    }
+  }
+  assert(phrase_count == post_filtered_count);
+}
+
+void BenchmarkPrefixExpansion() {
+  std::mt19937 generator;
+  {
+    const auto words = GenerateDictionary(generator, 1'000'000, 10);
+    TermDictionary dictionary;
+    size_t term_bytes = 0;
+    for (const std::string &word : words) {
+      term_bytes += word.size();
+      dictionary.Add(word);
+    }
+    dictionary.Freeze();
+    std::cout << "  "s << dictionary.size() << " terms of "s << term_bytes << " bytes, front coded into "s
+              << dictionary.GetSortedTermByteCount() << " bytes"s << std::endl;
+
+    std::vector<std::string> prefixes;
+    for (int i = 0; i < 10'000; ++i) {
+      const std::string &word = words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+      prefixes.push_back(word.substr(0, std::uniform_int_distribution<size_t>(2, 4)(generator)));
+    }
+    size_t term_count = 0;
+    {
+      LOG_DURATION_STREAM("  prefix enumeration"s, std::cout);
+      for (const std::string &prefix : prefixes) {
+        dictionary.ForEachTermWithPrefix(prefix, [&term_count](const std::string_view &, TermId) {
+          ++term_count;
+        });
+      }
+    }
+    std::cout << "  "s << term_count << " terms enumerated"s << std::endl;
+  }
+
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const SearchServer search_server = GenerateSearchServer(generator, dictionary, 50'000, 100);
+  // Prefixes of few enough words to be expanded completely
+  std::vector<std::string> wildcard_queries;
+  std::vector<std::string> explicit_queries;
+  while (wildcard_queries.size() < 500) {
+    const std::string &word = dictionary[std::uniform_int_distribution<size_t>(1, dictionary.size() - 1)(generator)];
+    const std::string prefix = word.substr(0, 3);
+    std::string query;
+    size_t word_count = 0;
+    for (const std::string &other : dictionary) {
+      if (other.compare(0, prefix.size(), prefix) == 0 && other != dictionary[0]) {
+        query += " "s + other;
+        ++word_count;
+      }
+    }
+    if (word_count > 1 && word_count <= MAX_WILDCARD_TERM_COUNT) {
+      wildcard_queries.push_back(prefix + "*"s);
+      explicit_queries.push_back(query);
+    }
+  }
+  const auto any_document = [](int document_id, DocumentStatus status, int rating) {
+    return true;
+  };
+  size_t explicit_count = 0;
+  {
+    LOG_DURATION_STREAM("  expanded words"s, std::cout);
+    for (const std::string &query : explicit_queries) {
+      explicit_count += search_server.FindTopDocuments(query, any_document).size();
+    }
+  }
+  size_t wildcard_count = 0;
+  {
+    LOG_DURATION_STREAM("  wildcard"s, std::cout);
+    for (const std::string &query : wildcard_queries) {
+      wildcard_count += search_server.FindTopDocuments(query, any_document).size();
+    }
+  }
+  assert(wildcard_count == explicit_count);
+}
+
+void BenchmarkDocumentStore() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto texts = GenerateTexts(generator, dictionary, 50'000, 100);
+  std::vector<int> ids(10'000);
+  for (int &id : ids) {
+    id = std::uniform_int_distribution<int>(0, texts.size() - 1)(generator);
+  }
+  for (const auto &[name, text_storage] : {std::pair{"no texts"s, TextStorage::NONE},
+                                           std::pair{"plain texts"s, TextStorage::PLAIN},
+                                           std::pair{"compressed texts"s, TextStorage::COMPRESSED}}) {
+    SearchServer search_server(dictionary[0], IndexOptions{false, text_storage});
+    {
+      LOG_DURATION_STREAM("  "s + name + ", add documents"s, std::cout);
+      for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {1});
+      }
+    }
+    std::cout << "  "s << search_server.GetMemoryUsage() << std::endl;
+    if (text_storage == TextStorage::NONE) {
+      continue;
+    }
+    size_t text_size = 0;
+    {
+      LOG_DURATION_STREAM("  "s + name + ", read 10000 texts"s, std::cout);
+      for (const int id : ids) {
+        text_size += search_server.GetDocumentText(id).size();
+      }
+    }
+    assert(text_size > 0);
+  }
+}
+
+void BenchmarkBatchRemoval() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto texts = GenerateTexts(generator, dictionary, 100'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 200, 5, 0.1);
+  std::vector<DocumentInput> documents;
+  for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+    documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {1}});
+  }
+  std::vector<int> removed_ids(texts.size());
+  std::iota(removed_ids.begin(), removed_ids.end(), 0);
+  std::shuffle(removed_ids.begin(), removed_ids.end(), generator);
+  removed_ids.resize(40'000);
+
+  const auto run_queries = [&queries](const std::string &name, const SearchServer &search_server) {
+    LOG_DURATION_STREAM("  "s + name, std::cout);
+    size_t result_count = 0;
+    for (const std::string &query : queries) {
+      result_count += search_server.FindTopDocuments(query).size();
+    }
+    return result_count;
+  };
+  for (const std::string &name : {"RemoveDocument"s, "RemoveDocuments"s, "RemoveDocuments, par"s}) {
+    SearchServer search_server(dictionary[0]);
+    search_server.AddDocuments(std::execution::par, documents);
+    search_server.WaitForMerges();
+    {
+      LOG_DURATION_STREAM("  "s + name + ", 40000 documents"s, std::cout);
+      if (name == "RemoveDocument"s) {
+        for (const int id : removed_ids) {
+          search_server.RemoveDocument(id);
+        }
+      } else if (name == "RemoveDocuments"s) {
+        search_server.RemoveDocuments(removed_ids);
+      } else {
+        search_server.RemoveDocuments(std::execution::par, removed_ids);
+      }
+    }
+    if (name != "RemoveDocuments, par"s) {
+      continue;
+    }
+    search_server.WaitForMerges();
+    const size_t result_count = run_queries("queries before Compact"s, search_server);
+    const size_t posting_count = search_server.GetPostingCount();
+    {
+      LOG_DURATION_STREAM("  Compact"s, std::cout);
+      search_server.Compact();
+    }
+    assert(run_queries("queries after Compact"s, search_server) == result_count);
+    std::cout << "  "s << posting_count << " postings before Compact, "s
+              << search_server.GetPostingCount() << " after"s << std::endl;
+  }
+}
+
+void BenchmarkDuplicateDetection() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  auto texts = GenerateTexts(generator, dictionary, 100'000, 100);
+  // Every tenth text repeats an earlier one with its words shuffled
+  for (size_t i = 10; i < texts.size(); i += 10) {
+    auto words = SplitIntoWords(texts[std::uniform_int_distribution<size_t>(0, i - 1)(generator)]);
+    std::shuffle(words.begin(), words.end(), generator);
+    texts[i].clear();
+    for (const std::string &word : words) {
+      texts[i] += word + " "s;
+    }
+  }
+  std::vector<DocumentInput> documents;
+  for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+    documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {1}});
+  }
+
+  std::cout << "Duplicate detection, 100000 documents"s << std::endl;
+  size_t skipped_count = 0;
+  for (const uint32_t max_simhash_distance : {0u, MAX_SIMHASH_DISTANCE}) {
+    for (const DuplicatePolicy policy : {DuplicatePolicy::KEEP, DuplicatePolicy::SKIP}) {
+      if (policy == DuplicatePolicy::KEEP && max_simhash_distance > 0) {
+        continue;
+      }
+      IndexOptions options;
+      options.duplicates = policy;
+      options.max_simhash_distance = max_simhash_distance;
+      SearchServer search_server(dictionary[0], options);
+      {
+        LOG_DURATION_STREAM("  AddDocuments, par, "s + (policy == DuplicatePolicy::KEEP ? "keeping"s : "skipping"s)
+                                + " duplicates, SimHash distance "s + std::to_string(max_simhash_distance), std::cout);
+        search_server.AddDocuments(std::execution::par, documents);
+      }
+      if (policy == DuplicatePolicy::SKIP && max_simhash_distance == 0) {
+        skipped_count = documents.size() - search_server.GetDocumentCount();
+      }
+    }
+  }
+
+  SearchServer search_server(dictionary[0]);
+  search_server.AddDocuments(std::execution::par, documents);
+  // Word sets compared as sets of strings, as without fingerprints
+  size_t word_set_duplicate_count = 0;
+  {
+    LOG_DURATION_STREAM("  word sets of every document"s, std::cout);
+    std::set<std::set<std::string_view>> word_sets;
+    for (const int id : search_server) {
+      std::set<std::string_view> word_set;
+      for (const auto &[word, freq] : search_server.GetWordFrequencies(id)) {
+        word_set.insert(word);
+      }
+      word_set_duplicate_count += !word_sets.insert(std::move(word_set)).second;
+    }
+  }
+  size_t removed_count;
+  {
+    LOG_DURATION_STREAM("  RemoveDuplicates"s, std::cout);
+    removed_count = RemoveDuplicates(search_server).size();
+  }
+  assert(removed_count == word_set_duplicate_count && removed_count == skipped_count);
+  std::cout << "  "s << removed_count << " duplicates"s << std::endl;
+}
+
+void BenchmarkDocumentFilters() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto texts = GenerateTexts(generator, dictionary, 100'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 500, 5, 0.1);
+  std::vector<DocumentInput> documents;
+  for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+    documents.push_back({id, texts[id], static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT), {id % 11 - 5}});
+  }
+  SearchServer search_server(dictionary[0]);
+  search_server.AddDocuments(std::execution::par, documents);
+  std::vector<int> removed_ids;
+  for (int id = 0; id < static_cast<int>(texts.size()); id += 10) {
+    removed_ids.push_back(id);
+  }
+  search_server.RemoveDocuments(removed_ids);
+  search_server.WaitForMerges();
+
+  const auto run_queries = [&](const std::string &name, const auto &document_predicate) {
+    std::vector<std::vector<Document>> results(queries.size());
+    LOG_DURATION_STREAM("  "s + name, std::cout);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      results[i] = search_server.FindTopDocuments(queries[i], document_predicate);
+    }
+    return results;
+  };
+  std::cout << "Document filters, 100000 documents, 500 queries"s << std::endl;
+  const auto predicate_results = run_queries("ACTUAL, predicate"s, [](int, DocumentStatus status, int) {
+    return status == DocumentStatus::ACTUAL;
+  });
+  const auto filter_results = run_queries("ACTUAL, filter"s, DocumentFilter::ForStatus(DocumentStatus::ACTUAL));
+  const auto rating_predicate_results = run_queries("ACTUAL, rating 2..5, predicate"s,
+                                                    [](int, DocumentStatus status, int rating) {
+    return status == DocumentStatus::ACTUAL && rating >= 2 && rating <= 5;
+  });
+  const auto rating_filter_results = run_queries("ACTUAL, rating 2..5, filter"s,
+                                                 DocumentFilter::ForStatus(DocumentStatus::ACTUAL).WithRating(2, 5));
+  for (size_t i = 0; i < queries.size(); ++i) {
+    assert(IsSameResult(predicate_results[i], filter_results[i]));
+    assert(IsSameResult(rating_predicate_results[i], rating_filter_results[i]));
+  }
+}
+
+void BenchmarkShardedSearch() {
+  std::mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+  const auto texts = GenerateTexts(generator, dictionary, 100'000, 100);
+  const auto queries = GenerateTexts(generator, dictionary, 500, 5, 0.1);
+  std::vector<DocumentInput> documents;
+  for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+    documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {id % 11 - 5}});
+  }
+  SearchServer search_server(dictionary[0]);
+  search_server.AddDocuments(std::execution::par, documents);
+  search_server.WaitForMerges();
+  std::vector<std::vector<Document>> expected(queries.size());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    expected[i] = search_server.FindTopDocuments(queries[i]);
+  }
+
+  std::cout << "Sharded search, 100000 documents, 500 queries"s << std::endl;
+  for (const size_t shard_count : {1, 4, 16}) {
+    ShardedSearchServer sharded_server(dictionary[0], shard_count);
+    sharded_server.AddDocuments(documents);
+    sharded_server.WaitForMerges();
+    std::vector<std::vector<Document>> results(queries.size());
+    {
+      // One query at a time, its shards searched in parallel
+      LOG_DURATION_STREAM("  "s + std::to_string(shard_count) + " shards, shards in parallel"s, std::cout);
+      for (size_t i = 0; i < queries.size(); ++i) {
+        results[i] = sharded_server.FindTopDocuments(std::execution::par, queries[i]);
+      }
+    }
+    for (size_t i = 0; i < queries.size(); ++i) {
+      assert(IsSameResult(results[i], expected[i]));
+    }
+    {
+      // Queries in parallel, the shards of each one after another
+      LOG_DURATION_STREAM("  "s + std::to_string(shard_count) + " shards, queries in parallel"s, std::cout);
+      std::transform(std::execution::par, queries.begin(), queries.end(), results.begin(), [&](const std::string &query) {
+        return sharded_server.FindTopDocuments(query);
+      });
+    }
+    for (size_t i = 0; i < queries.size(); ++i) {
+      assert(IsSameResult(results[i], expected[i]));
+    }
+  }
+}
+
+void RunBenchmarks() {
+  BenchmarkPruning();
+  BenchmarkParallelSearch();
+  BenchmarkConcurrentMap();
+  BenchmarkQueryBatch();
+  BenchmarkConcurrentIngestion();
+  BenchmarkSegmentIngestion();
+  BenchmarkIndexLoading();
+  BenchmarkPostingCompression();
+  BenchmarkTokenizer();
+  BenchmarkBulkIngestion();
+  BenchmarkScoring();
+  BenchmarkResultCache();
+  BenchmarkPhraseQueries();
+  BenchmarkPrefixExpansion();
+  BenchmarkDocumentStore();
+  BenchmarkBatchRemoval();
+  BenchmarkDuplicateDetection();
+  BenchmarkDocumentFilters();
+  BenchmarkShardedSearch();
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "search_server.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+std::string GenerateWord(std::mt19937 &generator, int max_length);
+std::vector<std::string> GenerateDictionary(std::mt19937 &generator, int word_count, int max_length);
+// Words are drawn with a skewed distribution, so a few of them are very common
+std::string GenerateText(std::mt19937 &generator, const std::vector<std::string> &dictionary, int word_count,
+                         double minus_prob = 0.0);
+std::vector<std::string> GenerateTexts(std::mt19937 &generator, const std::vector<std::string> &dictionary,
+                                       int text_count, int max_word_count, double minus_prob = 0.0);
+// Documents get between max_word_count / 2 and max_word_count words
+SearchServer GenerateSearchServer(std::mt19937 &generator, const std::vector<std::string> &dictionary,
+                                  int document_count, int max_word_count);
+
+void BenchmarkPruning();
+void BenchmarkParallelSearch();
+void BenchmarkConcurrentMap();
+void BenchmarkQueryBatch();
+void BenchmarkConcurrentIngestion();
+void BenchmarkSegmentIngestion();
+void BenchmarkIndexLoading();
+void BenchmarkPostingCompression();
+void BenchmarkTokenizer();
+void BenchmarkBulkIngestion();
+void BenchmarkScoring();
+void BenchmarkResultCache();
+void BenchmarkPhraseQueries();
+void BenchmarkPrefixExpansion();
+void BenchmarkDocumentStore();
+void BenchmarkBatchRemoval();
+void BenchmarkDuplicateDetection();
+void BenchmarkDocumentFilters();
+void BenchmarkShardedSearch();
+
+void RunBenchmarks();
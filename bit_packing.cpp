@@ -0,0 +1,164 @@
+#include "bit_packing.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BIT_PACKING_X86
+#endif
+
+namespace {
+
+const uint32_t LANE_COUNT = 8;
+const uint32_t ROW_COUNT = BIT_PACKING_BLOCK_SIZE / LANE_COUNT;
+
+uint32_t GetMask(uint32_t bit_width) {
+  return bit_width == 32 ? ~uint32_t{0} : (uint32_t{1} << bit_width) - 1;
+}
+
+// Row r holds values 8r .. 8r + 7; in every lane it starts at bit r * bit_width
+void UnpackBlockScalar(const uint32_t *words, uint32_t bit_width, uint32_t *values) {
+  const uint32_t mask = GetMask(bit_width);
+  for (uint32_t row = 0; row < ROW_COUNT; ++row) {
+    const uint32_t offset = row * bit_width;
+    const uint32_t *word = words + offset / 32 * LANE_COUNT;
+    const uint32_t shift = offset % 32;
+    for (uint32_t lane = 0; lane < LANE_COUNT; ++lane) {
+      uint32_t value = word[lane] >> shift;
+      if (shift + bit_width > 32) {
+        value |= word[LANE_COUNT + lane] << (32 - shift);
+      }
+      values[row * LANE_COUNT + lane] = value & mask;
+    }
+  }
+}
+
+#ifdef BIT_PACKING_X86
+
+__attribute__((target("sse2")))
+void UnpackBlockSse2(const uint32_t *words, uint32_t bit_width, uint32_t *values) {
+  const __m128i mask = _mm_set1_epi32(static_cast<int>(GetMask(bit_width)));
+  for (uint32_t row = 0; row < ROW_COUNT; ++row) {
+    const uint32_t offset = row * bit_width;
+    const uint32_t *word = words + offset / 32 * LANE_COUNT;
+    const uint32_t shift = offset % 32;
+    const __m128i right = _mm_cvtsi32_si128(static_cast<int>(shift));
+    const __m128i left = _mm_cvtsi32_si128(static_cast<int>(32 - shift));
+    for (uint32_t half = 0; half < LANE_COUNT; half += 4) {
+      __m128i value = _mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(word + half)), right);
+      if (shift + bit_width > 32) {
+        const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(word + LANE_COUNT + half));
+        value = _mm_or_si128(value, _mm_sll_epi32(next, left));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(values + row * LANE_COUNT + half), _mm_and_si128(value, mask));
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+void UnpackBlockAvx2(const uint32_t *words, uint32_t bit_width, uint32_t *values) {
+  const __m256i mask = _mm256_set1_epi32(static_cast<int>(GetMask(bit_width)));
+  for (uint32_t row = 0; row < ROW_COUNT; ++row) {
+    const uint32_t offset = row * bit_width;
+    const uint32_t *word = words + offset / 32 * LANE_COUNT;
+    const uint32_t shift = offset % 32;
+    __m256i value = _mm256_srl_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(word)),
+                                     _mm_cvtsi32_si128(static_cast<int>(shift)));
+    if (shift + bit_width > 32) {
+      const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(word + LANE_COUNT));
+      value = _mm256_or_si256(value, _mm256_sll_epi32(next, _mm_cvtsi32_si128(static_cast<int>(32 - shift))));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(values + row * LANE_COUNT), _mm256_and_si256(value, mask));
+  }
+}
+
+#endif
+
+using UnpackBlockKernel = void (*)(const uint32_t *words, uint32_t bit_width, uint32_t *values);
+
+struct UnpackKernel {
+  UnpackBlockKernel unpack_block;
+  const char *name;
+};
+
+UnpackKernel SelectUnpackKernel() {
+#ifdef BIT_PACKING_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return {UnpackBlockAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {UnpackBlockSse2, "sse2"};
+  }
+#endif
+  return {UnpackBlockScalar, "scalar"};
+}
+
+const UnpackKernel &GetUnpackKernel() {
+  static const UnpackKernel kernel = SelectUnpackKernel();
+  return kernel;
+}
+
+}
+
+uint32_t GetBitWidth(const uint32_t *values, size_t count) {
+  uint32_t all_bits = 0;
+  for (size_t i = 0; i < count; ++i) {
+    all_bits |= values[i];
+  }
+  uint32_t bit_width = 0;
+  while (bit_width < 32 && (all_bits >> bit_width) != 0) {
+    ++bit_width;
+  }
+  return bit_width;
+}
+
+size_t GetPackedWordCount(size_t count, uint32_t bit_width) {
+  if (count == BIT_PACKING_BLOCK_SIZE) {
+    return LANE_COUNT * ((ROW_COUNT * bit_width + 31) / 32);
+  }
+  return (count * bit_width + 31) / 32;
+}
+
+void PackValues(const uint32_t *values, size_t count, uint32_t bit_width, uint32_t *words) {
+  if (bit_width == 0) {
+    return;
+  }
+  const bool is_full_block = count == BIT_PACKING_BLOCK_SIZE;
+  for (size_t i = 0; i < count; ++i) {
+    const uint32_t lane = is_full_block ? i % LANE_COUNT : 0;
+    const uint64_t offset = (is_full_block ? i / LANE_COUNT : i) * uint64_t{bit_width};
+    const uint32_t stride = is_full_block ? LANE_COUNT : 1;
+    uint32_t *word = words + offset / 32 * stride + lane;
+    const uint32_t shift = offset % 32;
+    word[0] |= values[i] << shift;
+    if (shift + bit_width > 32) {
+      word[stride] |= values[i] >> (32 - shift);
+    }
+  }
+}
+
+void UnpackValues(const uint32_t *words, size_t count, uint32_t bit_width, uint32_t *values) {
+  if (bit_width == 0) {
+    std::fill(values, values + count, 0);
+    return;
+  }
+  if (count == BIT_PACKING_BLOCK_SIZE) {
+    GetUnpackKernel().unpack_block(words, bit_width, values);
+    return;
+  }
+  const uint32_t mask = GetMask(bit_width);
+  for (size_t i = 0; i < count; ++i) {
+    const uint64_t offset = i * uint64_t{bit_width};
+    const uint32_t shift = offset % 32;
+    uint32_t value = words[offset / 32] >> shift;
+    if (shift + bit_width > 32) {
+      value |= words[offset / 32 + 1] << (32 - shift);
+    }
+    values[i] = value & mask;
+  }
+}
+
+const char *GetUnpackKernelName() {
+  return GetUnpackKernel().name;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t BIT_PACKING_BLOCK_SIZE = 128;
+
+// Smallest bit width holding every value
+uint32_t GetBitWidth(const uint32_t *values, size_t count);
+// 32-bit words taken by count values of bit_width bits
+size_t GetPackedWordCount(size_t count, uint32_t bit_width);
+
+// A full block of BIT_PACKING_BLOCK_SIZE values is packed vertically: value i
+// goes to lane i % 8 of 8 interleaved 32-bit word streams, so one SIMD shift
+// unpacks 8 (AVX2) or 4 (SSE2) values at once. Shorter blocks are packed as a
+// plain bit stream. The words must be zeroed beforehand.
+void PackValues(const uint32_t *values, size_t count, uint32_t bit_width, uint32_t *words);
+// Picks the AVX2, SSE2 or scalar kernel for full blocks once, by the running CPU
+void UnpackValues(const uint32_t *words, size_t count, uint32_t bit_width, uint32_t *values);
+// "avx2", "sse2" or "scalar"
+const char *GetUnpackKernelName();
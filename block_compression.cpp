@@ -0,0 +1,127 @@
+#include "block_compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const size_t MIN_MATCH_SIZE = 4;
+const size_t MAX_MATCH_OFFSET = 65535;
+const int MATCH_TABLE_BITS = 14;
+const size_t TOKEN_COUNT_LIMIT = 15;
+
+uint32_t ReadSequence(const char *data) {
+  uint32_t sequence;
+  std::memcpy(&sequence, data, sizeof(sequence));
+  return sequence;
+}
+
+uint32_t HashSequence(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - MATCH_TABLE_BITS);
+}
+
+void AppendCount(size_t count, std::vector<uint8_t> &output) {
+  if (count < TOKEN_COUNT_LIMIT) {
+    return;
+  }
+  for (count -= TOKEN_COUNT_LIMIT; count >= 255; count -= 255) {
+    output.push_back(255);
+  }
+  output.push_back(count);
+}
+
+// A match_size of zero ends the block
+void AppendSequence(const std::string_view &literals, size_t match_offset, size_t match_size,
+                    std::vector<uint8_t> &output) {
+  const size_t match_count = match_size == 0 ? 0 : match_size - MIN_MATCH_SIZE;
+  output.push_back((std::min(literals.size(), TOKEN_COUNT_LIMIT) << 4) | std::min(match_count, TOKEN_COUNT_LIMIT));
+  AppendCount(literals.size(), output);
+  output.insert(output.end(), literals.begin(), literals.end());
+  if (match_size != 0) {
+    output.push_back(match_offset & 0xff);
+    output.push_back(match_offset >> 8);
+    AppendCount(match_count, output);
+  }
+}
+
+size_t ReadCount(size_t count, const uint8_t *&data, const uint8_t *last) {
+  using namespace std::literals;
+  if (count < TOKEN_COUNT_LIMIT) {
+    return count;
+  }
+  uint8_t byte;
+  do {
+    if (data == last) {
+      throw std::runtime_error("Compressed block is corrupt"s);
+    }
+    byte = *data++;
+    count += byte;
+  } while (byte == 255);
+  return count;
+}
+
+}
+
+void CompressBlock(const std::string_view &input, std::vector<uint8_t> &output) {
+  // Last place of every hashed 4-byte sequence; a stale or colliding entry
+  // only costs the comparison that rejects it
+  std::vector<uint32_t> places(size_t{1} << MATCH_TABLE_BITS, 0);
+  const char *data = input.data();
+  size_t literal_start = 0;
+  size_t position = 0;
+  while (position + MIN_MATCH_SIZE <= input.size()) {
+    const uint32_t sequence = ReadSequence(data + position);
+    uint32_t &place = places[HashSequence(sequence)];
+    const size_t candidate = place;
+    place = position;
+    if (candidate >= position || position - candidate > MAX_MATCH_OFFSET || ReadSequence(data + candidate) != sequence) {
+      ++position;
+      continue;
+    }
+    size_t match_size = MIN_MATCH_SIZE;
+    while (position + match_size < input.size() && data[candidate + match_size] == data[position + match_size]) {
+      ++match_size;
+    }
+    AppendSequence(input.substr(literal_start, position - literal_start), position - candidate, match_size, output);
+    position += match_size;
+    literal_start = position;
+  }
+  AppendSequence(input.substr(literal_start), 0, 0, output);
+}
+
+std::string DecompressBlock(const uint8_t *first, const uint8_t *last, size_t size) {
+  using namespace std::literals;
+  std::string output;
+  output.reserve(size);
+  const uint8_t *data = first;
+  while (data != last && output.size() < size) {
+    const uint8_t token = *data++;
+    const size_t literal_count = ReadCount(token >> 4, data, last);
+    if (static_cast<size_t>(last - data) < literal_count) {
+      throw std::runtime_error("Compressed block is corrupt"s);
+    }
+    output.append(reinterpret_cast<const char *>(data), literal_count);
+    data += literal_count;
+    if (data == last) {
+      break;
+    }
+    if (last - data < 2) {
+      throw std::runtime_error("Compressed block is corrupt"s);
+    }
+    const size_t match_offset = data[0] | (data[1] << 8);
+    data += 2;
+    const size_t match_size = ReadCount(token & 0x0f, data, last) + MIN_MATCH_SIZE;
+    if (match_offset == 0 || match_offset > output.size()) {
+      throw std::runtime_error("Compressed block is corrupt"s);
+    }
+    // The match may overlap the bytes it produces
+    size_t from = output.size() - match_offset;
+    output.resize(output.size() + match_size);
+    for (size_t to = output.size() - match_size; to != output.size(); ++to, ++from) {
+      output[to] = output[from];
+    }
+  }
+  output.resize(std::min(output.size(), size));
+  return output;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// LZ77 in the format of LZ4 blocks: a sequence is a token with the literal
+// count in its high and the match length minus 4 in its low four bits, longer
+// counts continued by bytes up to 255, the literals, then the 2-byte little
+// endian distance to the match. The last sequence has literals only.
+// Appends the compressed input to output
+void CompressBlock(const std::string_view &input, std::vector<uint8_t> &output);
+// Decodes the block until size bytes are out or the block ends; throws
+// std::runtime_error on a corrupt block
+std::string DecompressBlock(const uint8_t *first, const uint8_t *last, size_t size);
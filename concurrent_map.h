@@ -1,60 +1,282 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <map>
-#include <vector>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <type_traits>
-#include <cstddef>
+#include <utility>
+#include <vector>
+
+const size_t CACHE_LINE_SIZE = 64;
 
-template<typename Key, typename Value>
+// std::hash of integers is the identity, so hashes are mixed before their bits are split
+inline uint64_t MixHashBits(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// Sharded hash map: the high bits of a key's hash pick a shard, the low bits
+// a slot of the shard's open-addressing table. Every shard is guarded by its
+// own mutex and padded to a cache line, so threads working on different
+// shards never share one.
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
 class ConcurrentMap {
  private:
-  struct Bucket {
+  struct Slot {
+    Key key;
+    Value value;
+  };
+
+  enum class SlotState : uint8_t {
+    EMPTY,
+    USED,
+    ERASED,
+  };
+
+  struct alignas(CACHE_LINE_SIZE) Shard {
     std::mutex mx_;
-    std::map<Key, Value> map_;
+    std::vector<Slot> slots_;
+    std::vector<SlotState> states_;
+    size_t size_ = 0;
+    size_t occupied_ = 0;
   };
 
-  std::vector<Bucket> buckets_;
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_count_;
+  Hash hash_;
+  KeyEqual key_equal_;
 
-  Bucket& GetBucket(const Key &key) {
-    return buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+  std::pair<Shard &, uint64_t> Locate(const Key &key) {
+    const uint64_t hash = MixHashBits(hash_(key));
+    return {shards_[(hash >> 32) % shard_count_], hash};
   }
 
- public:
-  static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+  // Linear probing; returns the slot holding the key or the slot to insert it into
+  size_t FindSlot(const Shard &shard, const Key &key, uint64_t hash) const {
+    const size_t mask = shard.slots_.size() - 1;
+    size_t insert_pos = shard.slots_.size();
+    for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+      const SlotState state = shard.states_[pos];
+      if (state == SlotState::EMPTY) {
+        return insert_pos != shard.slots_.size() ? insert_pos : pos;
+      }
+      if (state == SlotState::ERASED) {
+        if (insert_pos == shard.slots_.size()) {
+          insert_pos = pos;
+        }
+      } else if (key_equal_(shard.slots_[pos].key, key)) {
+        return pos;
+      }
+    }
+  }
 
+  void Rehash(Shard &shard, size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    std::vector<SlotState> old_states(capacity, SlotState::EMPTY);
+    std::swap(old_slots, shard.slots_);
+    std::swap(old_states, shard.states_);
+    shard.occupied_ = shard.size_;
+    for (size_t pos = 0; pos < old_slots.size(); ++pos) {
+      if (old_states[pos] == SlotState::USED) {
+        const uint64_t hash = MixHashBits(hash_(old_slots[pos].key));
+        const size_t new_pos = FindSlot(shard, old_slots[pos].key, hash);
+        shard.slots_[new_pos] = std::move(old_slots[pos]);
+        shard.states_[new_pos] = SlotState::USED;
+      }
+    }
+  }
+
+  Value &FindOrInsert(Shard &shard, const Key &key, uint64_t hash) {
+    // Keeps the load, tombstones included, under 3/4
+    if (4 * (shard.occupied_ + 1) > 3 * shard.slots_.size()) {
+      // Grows when live keys fill half of the table, otherwise only sweeps tombstones
+      const bool is_crowded = 2 * (shard.size_ + 1) > shard.slots_.size();
+      Rehash(shard, is_crowded ? std::max<size_t>(16, 2 * shard.slots_.size()) : shard.slots_.size());
+    }
+    const size_t pos = FindSlot(shard, key, hash);
+    if (shard.states_[pos] != SlotState::USED) {
+      if (shard.states_[pos] == SlotState::EMPTY) {
+        ++shard.occupied_;
+      }
+      shard.states_[pos] = SlotState::USED;
+      shard.slots_[pos] = Slot{key, Value()};
+      ++shard.size_;
+    }
+    return shard.slots_[pos].value;
+  }
+
+ public:
   struct Access {
-    Access(const Key &key, Bucket &bucket)
-        : lock_(bucket.mx_)
-        , ref_to_value(bucket.map_[key]) {
+    Access(const Key &key, ConcurrentMap &map)
+        : Access(key, map, map.Locate(key)) {
     }
 
     std::lock_guard<std::mutex> lock_;
     Value &ref_to_value;
+
+   private:
+    Access(const Key &key, ConcurrentMap &map, std::pair<Shard &, uint64_t> location)
+        : lock_(location.first.mx_)
+        , ref_to_value(map.FindOrInsert(location.first, key, location.second)) {
+    }
   };
 
-  explicit ConcurrentMap(size_t bucket_count)
-      : buckets_(bucket_count) {
+  explicit ConcurrentMap(size_t shard_count, Hash hash = Hash(), KeyEqual key_equal = KeyEqual())
+      : shards_(std::make_unique<Shard[]>(shard_count))
+      , shard_count_(shard_count)
+      , hash_(std::move(hash))
+      , key_equal_(std::move(key_equal)) {
+    if (shard_count == 0) {
+      throw std::invalid_argument("ConcurrentMap needs at least one shard");
+    }
   }
 
   Access operator[](const Key &key) {
-    return Access{key, GetBucket(key)};
-  };
+    return Access{key, *this};
+  }
 
-  void Erase(const Key &key){
-    auto &bucket = GetBucket(key);
-    std::lock_guard lock(bucket.mx_);
-    bucket.map_.erase(key);
+  // Adds delta to the value of the key under a single lock acquisition
+  template<typename Delta>
+  void Accumulate(const Key &key, const Delta &delta) {
+    auto [shard, hash] = Locate(key);
+    std::lock_guard lock(shard.mx_);
+    FindOrInsert(shard, key, hash) += delta;
+  }
+
+  void Erase(const Key &key) {
+    auto [shard, hash] = Locate(key);
+    std::lock_guard lock(shard.mx_);
+    if (shard.slots_.empty()) {
+      return;
+    }
+    const size_t pos = FindSlot(shard, key, hash);
+    if (shard.states_[pos] == SlotState::USED) {
+      shard.states_[pos] = SlotState::ERASED;
+      shard.slots_[pos] = Slot{};
+      --shard.size_;
+    }
+  }
+
+  // Visits every (key, value) in place, locking one shard at a time
+  template<typename Visitor>
+  void ForEach(Visitor visitor) {
+    for (size_t i = 0; i < shard_count_; ++i) {
+      Shard &shard = shards_[i];
+      std::lock_guard lock(shard.mx_);
+      for (size_t pos = 0; pos < shard.slots_.size(); ++pos) {
+        if (shard.states_[pos] == SlotState::USED) {
+          visitor(std::as_const(shard.slots_[pos].key), shard.slots_[pos].value);
+        }
+      }
+    }
+  }
+
+  // Moves every (key, value) out to the visitor and leaves the map empty
+  template<typename Visitor>
+  void Drain(Visitor visitor) {
+    for (size_t i = 0; i < shard_count_; ++i) {
+      Shard &shard = shards_[i];
+      std::lock_guard lock(shard.mx_);
+      for (size_t pos = 0; pos < shard.slots_.size(); ++pos) {
+        if (shard.states_[pos] == SlotState::USED) {
+          visitor(std::move(shard.slots_[pos].key), std::move(shard.slots_[pos].value));
+        }
+      }
+      shard.slots_.clear();
+      shard.states_.clear();
+      shard.size_ = 0;
+      shard.occupied_ = 0;
+    }
   }
 
   std::map<Key, Value> BuildOrdinaryMap() {
     std::map<Key, Value> full_map;
-    for (auto &[mx_, map_]: buckets_) {
-      {
-        std::lock_guard lock_(mx_);
-        full_map.insert(map_.begin(), map_.end());
+    ForEach([&full_map](const Key &key, const Value &value) {
+      full_map.emplace(key, value);
+    });
+    return full_map;
+  }
+};
+
+// Fixed-capacity map that inserts and accumulates arithmetic values without
+// locks: keys are claimed with a compare-and-swap on an empty_key sentinel and
+// values are updated atomically. Entries can not be erased.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentAccumulator {
+ public:
+  static_assert(std::is_arithmetic_v<Value>, "ConcurrentAccumulator supports only arithmetic values");
+  static_assert(std::is_trivially_copyable_v<Key>, "ConcurrentAccumulator supports only trivially copyable keys");
+
+  ConcurrentAccumulator(size_t capacity, Key empty_key, Hash hash = Hash())
+      : slot_count_(RoundUpToPowerOfTwo(capacity + capacity / 2 + 1))
+      , keys_(std::make_unique<std::atomic<Key>[]>(slot_count_))
+      , values_(std::make_unique<std::atomic<Value>[]>(slot_count_))
+      , empty_key_(empty_key)
+      , hash_(std::move(hash)) {
+    for (size_t pos = 0; pos < slot_count_; ++pos) {
+      keys_[pos].store(empty_key_, std::memory_order_relaxed);
+      values_[pos].store(Value(), std::memory_order_relaxed);
+    }
+  }
+
+  void Accumulate(const Key &key, Value delta) {
+    std::atomic<Value> &value = values_[ClaimSlot(key)];
+    if constexpr (std::is_integral_v<Value>) {
+      value.fetch_add(delta, std::memory_order_relaxed);
+    } else {
+      Value expected = value.load(std::memory_order_relaxed);
+      while (!value.compare_exchange_weak(expected, expected + delta, std::memory_order_relaxed)) {
       }
     }
-    return full_map;
   }
-};
\ No newline at end of file
+
+  // Must not run concurrently with Accumulate
+  template<typename Visitor>
+  void ForEach(Visitor visitor) const {
+    for (size_t pos = 0; pos < slot_count_; ++pos) {
+      const Key key = keys_[pos].load(std::memory_order_acquire);
+      if (key != empty_key_) {
+        visitor(key, values_[pos].load(std::memory_order_relaxed));
+      }
+    }
+  }
+
+ private:
+  size_t slot_count_;
+  std::unique_ptr<std::atomic<Key>[]> keys_;
+  std::unique_ptr<std::atomic<Value>[]> values_;
+  Key empty_key_;
+  Hash hash_;
+
+  static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+      result *= 2;
+    }
+    return result;
+  }
+
+  size_t ClaimSlot(const Key &key) {
+    const size_t mask = slot_count_ - 1;
+    size_t pos = MixHashBits(hash_(key)) & mask;
+    for (size_t probe = 0; probe < slot_count_; ++probe, pos = (pos + 1) & mask) {
+      Key current = keys_[pos].load(std::memory_order_acquire);
+      if (current == key) {
+        return pos;
+      }
+      if (current == empty_key_) {
+        if (keys_[pos].compare_exchange_strong(current, key, std::memory_order_acq_rel) || current == key) {
+          return pos;
+        }
+      }
+    }
+    throw std::length_error("ConcurrentAccumulator is full");
+  }
+};
@@ -0,0 +1,91 @@
+#include "concurrent_search_server.h"
+
+#include <thread>
+
+ConcurrentSearchServer::ConcurrentSearchServer(const std::string &stop_words_text)
+    : replicas_{std::make_unique<SearchServer>(stop_words_text), std::make_unique<SearchServer>(stop_words_text)} {
+}
+
+ConcurrentSearchServer::ConcurrentSearchServer(const std::string_view &stop_words_text)
+    : replicas_{std::make_unique<SearchServer>(stop_words_text), std::make_unique<SearchServer>(stop_words_text)} {
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id,
+                                         const std::string_view &document,
+                                         DocumentStatus status,
+                                         const std::vector<int> &ratings) {
+  // A rejected document throws on the first replica, before anything is published
+  ApplyWrite([&](SearchServer &replica) {
+    replica.AddDocument(document_id, document, status, ratings);
+  });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+  ApplyWrite([document_id](SearchServer &replica) {
+    replica.RemoveDocument(document_id);
+  });
+}
+
+void ConcurrentSearchServer::RemoveDocuments(const std::vector<int> &document_ids) {
+  ApplyWrite([&document_ids](SearchServer &replica) {
+    replica.RemoveDocuments(std::execution::par, document_ids);
+  });
+}
+
+void ConcurrentSearchServer::Compact() {
+  ApplyWrite([](SearchServer &replica) {
+    replica.Compact();
+  });
+}
+
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(const std::string_view &raw_query,
+                                                               DocumentStatus status,
+                                                               size_t top_k) const {
+  return Read([&](const SearchServer &search_server) {
+    return search_server.FindTopDocuments(raw_query, status, top_k);
+  });
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ConcurrentSearchServer::MatchDocument(
+    const std::string_view &raw_query,
+    int document_id) const {
+  return Read([&](const SearchServer &search_server) {
+    return search_server.MatchDocument(raw_query, document_id);
+  });
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+  return Read([](const SearchServer &search_server) {
+    return search_server.GetDocumentCount();
+  });
+}
+
+// Readers register in the counter selected by counter_index_. Flipping the
+// index and draining both counters in turn guarantees that every reader which
+// could have seen the previously published replica has left it.
+void ConcurrentSearchServer::WaitForReaders() {
+  const int previous = counter_index_.load();
+  const int next = 1 - previous;
+  while (reader_counters_[next].count.load() != 0) {
+    std::this_thread::yield();
+  }
+  counter_index_.store(next);
+  while (reader_counters_[previous].count.load() != 0) {
+    std::this_thread::yield();
+  }
+}
+
+ConcurrentSearchServer::ReadGuard::ReadGuard(const ConcurrentSearchServer &server)
+    : server_(server)
+    , counter_index_(server.counter_index_.load()) {
+  server_.reader_counters_[counter_index_].count.fetch_add(1);
+  replica_ = server_.published_replica_.load();
+}
+
+ConcurrentSearchServer::ReadGuard::~ReadGuard() {
+  server_.reader_counters_[counter_index_].count.fetch_sub(1);
+}
+
+int ConcurrentSearchServer::ReadGuard::GetReplica() const {
+  return replica_;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "search_server.h"
+#include "concurrent_map.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SearchServer that can be read while it is being written to. It keeps two
+// replicas of the index (left-right): readers always run on the published
+// replica and never wait, the single writer updates the hidden one, publishes
+// it atomically, waits for readers still on the old replica and replays the
+// change there. Memory is doubled in exchange for wait-free readers.
+class ConcurrentSearchServer {
+ public:
+  template<typename StringContainer>
+  explicit ConcurrentSearchServer(const StringContainer &stop_words)
+      : replicas_{std::make_unique<SearchServer>(stop_words), std::make_unique<SearchServer>(stop_words)} {
+  }
+
+  explicit ConcurrentSearchServer(const std::string &stop_words_text);
+  explicit ConcurrentSearchServer(const std::string_view &stop_words_text);
+
+  void AddDocument(int document_id,
+                   const std::string_view &document,
+                   DocumentStatus status,
+                   const std::vector<int> &ratings);
+  void RemoveDocument(int document_id);
+  // One write for the whole batch, with parallel statistics updates
+  void RemoveDocuments(const std::vector<int> &document_ids);
+  // Each replica is compacted while the other one serves the readers
+  void Compact();
+
+  // Runs reader(const SearchServer &) on a version that no writer touches until it returns
+  template<typename Reader>
+  auto Read(Reader reader) const {
+    const ReadGuard guard(*this);
+    return reader(static_cast<const SearchServer &>(*replicas_[guard.GetReplica()]));
+  }
+
+  std::vector<Document> FindTopDocuments(const std::string_view &raw_query,
+                                         DocumentStatus status = DocumentStatus::ACTUAL,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+  std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view &raw_query,
+                                                                          int document_id) const;
+  int GetDocumentCount() const;
+
+ private:
+  struct alignas(CACHE_LINE_SIZE) ReaderCounter {
+    std::atomic<int64_t> count{0};
+  };
+
+  class ReadGuard {
+   public:
+    explicit ReadGuard(const ConcurrentSearchServer &server);
+    ~ReadGuard();
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+
+    int GetReplica() const;
+
+   private:
+    const ConcurrentSearchServer &server_;
+    int counter_index_;
+    int replica_;
+  };
+
+  std::array<std::unique_ptr<SearchServer>, 2> replicas_;
+  std::atomic<int> published_replica_{0};
+  std::atomic<int> counter_index_{0};
+  mutable std::array<ReaderCounter, 2> reader_counters_;
+  std::mutex writer_mx_;
+
+  template<typename Write>
+  void ApplyWrite(Write write) {
+    std::lock_guard lock(writer_mx_);
+    const int published = published_replica_.load();
+    write(*replicas_[1 - published]);
+    published_replica_.store(1 - published);
+    WaitForReaders();
+    write(*replicas_[published]);
+  }
+
+  void WaitForReaders();
+};
@@ -0,0 +1,119 @@
+#include "corpus_statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+void CorpusStatistics::Reserve(size_t term_count) {
+  if (document_freqs_.size() < term_count) {
+    document_freqs_.resize(term_count, 0);
+  }
+  if (idf_cache_size_ < term_count) {
+    // Fresh entries are stale, nothing needs to be copied
+    idf_cache_size_ = std::max(term_count, idf_cache_size_ * 2);
+    idf_cache_ = std::make_unique<CachedIdf[]>(idf_cache_size_);
+  }
+}
+
+void CorpusStatistics::AddDocument(const TermCount *first, const TermCount *last) {
+  for (const TermCount *word = first; word != last; ++word) {
+    ++document_freqs_[word->term_id];
+    word_count_ += word->term_count;
+  }
+  ++document_count_;
+  ++generation_;
+}
+
+void CorpusStatistics::RemoveDocument(const TermCount *first, const TermCount *last) {
+  for (const TermCount *word = first; word != last; ++word) {
+    --document_freqs_[word->term_id];
+    word_count_ -= word->term_count;
+  }
+  --document_count_;
+  ++generation_;
+}
+
+void CorpusStatistics::RemoveDocument(const std::execution::parallel_policy par,
+                                      const TermCount *first,
+                                      const TermCount *last) {
+  std::for_each(par, first, last, [this](const TermCount &word) {
+    --document_freqs_[word.term_id];
+  });
+  for (const TermCount *word = first; word != last; ++word) {
+    word_count_ -= word->term_count;
+  }
+  --document_count_;
+  ++generation_;
+}
+
+void CorpusStatistics::RemoveDocuments(const std::execution::parallel_policy par,
+                                       const std::vector<IteratorRange<const TermCount *>> &documents) {
+  if (documents.empty()) {
+    return;
+  }
+  const size_t min_range_size = 4096;
+  const size_t max_range_count = 4 * std::max(std::thread::hardware_concurrency(), 1u);
+  const size_t range_count = std::clamp<size_t>(document_freqs_.size() / min_range_size, 1, max_range_count);
+  std::vector<size_t> ranges(range_count);
+  std::iota(ranges.begin(), ranges.end(), 0);
+  std::vector<uint64_t> word_counts(range_count, 0);
+  std::for_each(par, ranges.begin(), ranges.end(), [&](size_t range) {
+    const TermId first_term = document_freqs_.size() * range / range_count;
+    const TermId last_term = document_freqs_.size() * (range + 1) / range_count;
+    // Terms of a document are sorted by id
+    for (const auto &document : documents) {
+      auto word = std::lower_bound(document.begin(), document.end(), first_term, [](const TermCount &word, TermId term_id) {
+        return word.term_id < term_id;
+      });
+      for (; word != document.end() && word->term_id < last_term; ++word) {
+        --document_freqs_[word->term_id];
+        word_counts[range] += word->term_count;
+      }
+    }
+  });
+  word_count_ -= std::accumulate(word_counts.begin(), word_counts.end(), uint64_t{0});
+  document_count_ -= documents.size();
+  ++generation_;
+}
+
+void CorpusStatistics::Assign(std::vector<uint32_t> document_freqs, uint32_t document_count, uint64_t word_count) {
+  document_freqs_ = std::move(document_freqs);
+  document_count_ = document_count;
+  word_count_ = word_count;
+  ++generation_;
+  Reserve(document_freqs_.size());
+}
+
+uint32_t CorpusStatistics::GetDocumentCount() const {
+  return document_count_;
+}
+
+uint64_t CorpusStatistics::GetWordCount() const {
+  return word_count_;
+}
+
+double CorpusStatistics::GetAverageDocumentLength() const {
+  return document_count_ == 0 ? 0.0 : word_count_ * 1.0 / document_count_;
+}
+
+const std::vector<uint32_t> &CorpusStatistics::GetDocumentFreqs() const {
+  return document_freqs_;
+}
+
+double CorpusStatistics::GetInverseDocumentFreq(TermId term_id) const {
+  CachedIdf &cached = idf_cache_[term_id];
+  if (cached.generation.load(std::memory_order_acquire) != generation_) {
+    cached.value.store(log(document_count_ * 1.0 / document_freqs_[term_id]), std::memory_order_relaxed);
+    cached.generation.store(generation_, std::memory_order_release);
+  }
+  return cached.value.load(std::memory_order_relaxed);
+}
+
+uint64_t CorpusStatistics::GetGeneration() const {
+  return generation_;
+}
+
+size_t CorpusStatistics::GetByteCount() const {
+  return document_freqs_.capacity() * sizeof(uint32_t) + idf_cache_size_ * sizeof(CachedIdf);
+}
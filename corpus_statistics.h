@@ -0,0 +1,63 @@
+#pragma once
+#include "segment.h"
+#include "term_dictionary.h"
+#include "paginator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <memory>
+#include <vector>
+
+// Statistics of the live documents that scoring reads on every query. IDF of a
+// term is computed on its first use after the corpus changed and kept until
+// the next change; every change starts a new generation. Queries running at
+// the same time may fill the cache together, they all store the same value.
+class CorpusStatistics {
+ public:
+  CorpusStatistics() = default;
+  CorpusStatistics(CorpusStatistics &&) = default;
+  CorpusStatistics &operator=(CorpusStatistics &&) = default;
+
+  // Makes room for terms below term_count
+  void Reserve(size_t term_count);
+  void AddDocument(const TermCount *first, const TermCount *last);
+  void RemoveDocument(const TermCount *first, const TermCount *last);
+  // Every term has its own counter, so the counters are updated in parallel
+  void RemoveDocument(const std::execution::parallel_policy par, const TermCount *first, const TermCount *last);
+  // Every thread updates the counters of its own range of terms
+  void RemoveDocuments(const std::execution::parallel_policy par,
+                       const std::vector<IteratorRange<const TermCount *>> &documents);
+  // Statistics of a loaded index; document_freqs holds every term
+  void Assign(std::vector<uint32_t> document_freqs, uint32_t document_count, uint64_t word_count);
+
+  uint32_t GetDocumentCount() const;
+  // Words without stop words
+  uint64_t GetWordCount() const;
+  double GetAverageDocumentLength() const;
+  // Live documents with the term
+  uint32_t GetDocumentFreq(TermId term_id) const {
+    return term_id < document_freqs_.size() ? document_freqs_[term_id] : 0;
+  }
+  const std::vector<uint32_t> &GetDocumentFreqs() const;
+  // log(document count / document freq), for terms with live documents only
+  double GetInverseDocumentFreq(TermId term_id) const;
+  uint64_t GetGeneration() const;
+  // Bytes of the document freqs and the IDF cache
+  size_t GetByteCount() const;
+
+ private:
+  struct CachedIdf {
+    std::atomic<uint64_t> generation{0};
+    std::atomic<double> value{0.0};
+  };
+
+  uint32_t document_count_ = 0;
+  uint64_t word_count_ = 0;
+  // Starts above the zero every cache entry is born with
+  uint64_t generation_ = 1;
+  std::vector<uint32_t> document_freqs_;
+  std::unique_ptr<CachedIdf[]> idf_cache_;
+  size_t idf_cache_size_ = 0;
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 enum class DocumentStatus {
   ACTUAL,
@@ -22,5 +24,13 @@ struct Document {
   int rating = 0;
 };
 
+// Input of SearchServer::AddDocuments; the text is only read during the call
+struct DocumentInput {
+  int id = 0;
+  std::string_view text;
+  DocumentStatus status = DocumentStatus::ACTUAL;
+  std::vector<int> ratings;
+};
+
 std::ostream &operator<<(std::ostream &out, const Document &document);
 
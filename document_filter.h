@@ -0,0 +1,49 @@
+#pragma once
+#include "document.h"
+
+#include <climits>
+#include <cstdint>
+
+const int DOCUMENT_STATUS_COUNT = 4;
+
+inline bool IsValidStatus(DocumentStatus status) {
+  return static_cast<int>(status) >= 0 && static_cast<int>(status) < DOCUMENT_STATUS_COUNT;
+}
+
+inline uint32_t GetStatusBit(DocumentStatus status) {
+  return uint32_t{1} << static_cast<int>(status);
+}
+
+// Filter the search recognizes by its type and applies without a call per
+// posting: statuses are tested on the server's bitmaps of live documents by
+// status and ratings on the dense per-document column. It is a predicate as
+// well, for the code paths that take any. Any other predicate is called with
+// (document_id, status, rating) for every matching live document.
+struct DocumentFilter {
+  // GetStatusBit of every accepted status
+  uint32_t status_mask = (uint32_t{1} << DOCUMENT_STATUS_COUNT) - 1;
+  // Inclusive
+  int min_rating = INT_MIN;
+  int max_rating = INT_MAX;
+
+  static DocumentFilter ForStatus(DocumentStatus status) {
+    DocumentFilter filter;
+    filter.status_mask = GetStatusBit(status);
+    return filter;
+  }
+
+  DocumentFilter WithRating(int min, int max) const {
+    DocumentFilter filter = *this;
+    filter.min_rating = min;
+    filter.max_rating = max;
+    return filter;
+  }
+
+  bool HasRatingRange() const {
+    return min_rating != INT_MIN || max_rating != INT_MAX;
+  }
+
+  bool operator()(int document_id, DocumentStatus status, int rating) const {
+    return (status_mask & GetStatusBit(status)) != 0 && rating >= min_rating && rating <= max_rating;
+  }
+};
@@ -0,0 +1,103 @@
+#include "document_store.h"
+
+#include <algorithm>
+
+DocumentStore::DocumentStore(bool is_compressed)
+    : is_compressed_(is_compressed) {
+}
+
+DocumentStore::DocumentStore(bool is_compressed, const Layout &layout, std::shared_ptr<const void> storage)
+    : is_compressed_(is_compressed)
+    , mapped_(layout)
+    , storage_(std::move(storage)) {
+}
+
+void DocumentStore::AddDocument(const std::string_view &text) {
+  if (!is_compressed_) {
+    bytes_.insert(bytes_.end(), text.begin(), text.end());
+    text_offsets_.push_back(bytes_.size());
+    return;
+  }
+  open_texts_ += text;
+  text_offsets_.push_back(text_offsets_.back() + text.size());
+  if (open_texts_.size() >= DOCUMENT_STORE_BLOCK_SIZE) {
+    Flush();
+  }
+}
+
+void DocumentStore::Flush() {
+  const uint32_t document_count = text_offsets_.size() - 1;
+  if (!is_compressed_ || block_documents_.back() == document_count) {
+    return;
+  }
+  CompressBlock(open_texts_, bytes_);
+  block_documents_.push_back(document_count);
+  block_offsets_.push_back(bytes_.size());
+  open_texts_.clear();
+}
+
+bool DocumentStore::IsCompressed() const {
+  return is_compressed_;
+}
+
+uint32_t DocumentStore::GetDocumentCount() const {
+  return mapped_.document_count + text_offsets_.size() - 1;
+}
+
+std::string DocumentStore::GetText(uint32_t document_index) const {
+  if (document_index < mapped_.document_count) {
+    return GetText(mapped_, document_index);
+  }
+  const uint32_t offset = document_index - mapped_.document_count;
+  if (is_compressed_ && offset >= block_documents_.back()) {
+    const uint64_t open_offset = text_offsets_[block_documents_.back()];
+    return open_texts_.substr(text_offsets_[offset] - open_offset, text_offsets_[offset + 1] - text_offsets_[offset]);
+  }
+  return GetText(GetLayout(), offset);
+}
+
+DocumentStore::Layout DocumentStore::GetLayout() const {
+  return {text_offsets_.data(), block_documents_.data(), block_offsets_.data(), bytes_.data(),
+          static_cast<uint32_t>(text_offsets_.size() - 1), block_documents_.size() - 1};
+}
+
+size_t DocumentStore::GetByteCount() const {
+  size_t byte_count = bytes_.capacity() + open_texts_.capacity() + text_offsets_.capacity() * sizeof(uint64_t)
+      + block_documents_.capacity() * sizeof(uint32_t) + block_offsets_.capacity() * sizeof(uint64_t);
+  if (mapped_.document_count > 0) {
+    byte_count += GetByteCount(mapped_);
+  }
+  return byte_count;
+}
+
+size_t DocumentStore::GetTextByteCount() const {
+  size_t byte_count = text_offsets_.back();
+  if (mapped_.document_count > 0) {
+    byte_count += mapped_.text_offsets[mapped_.document_count];
+  }
+  return byte_count;
+}
+
+std::string DocumentStore::GetText(const Layout &layout, uint32_t document_index) const {
+  const uint64_t text_offset = layout.text_offsets[document_index];
+  const uint64_t text_size = layout.text_offsets[document_index + 1] - text_offset;
+  if (!is_compressed_) {
+    return {reinterpret_cast<const char *>(layout.bytes) + text_offset, text_size};
+  }
+  const size_t block = std::upper_bound(layout.block_documents, layout.block_documents + layout.block_count + 1,
+                                        document_index) - layout.block_documents - 1;
+  const uint64_t block_text_offset = text_offset - layout.text_offsets[layout.block_documents[block]];
+  const std::string texts = DecompressBlock(layout.bytes + layout.block_offsets[block],
+                                            layout.bytes + layout.block_offsets[block + 1],
+                                            block_text_offset + text_size);
+  return texts.substr(block_text_offset, text_size);
+}
+
+size_t DocumentStore::GetByteCount(const Layout &layout) const {
+  size_t byte_count = (layout.document_count + 1) * sizeof(uint64_t);
+  if (!is_compressed_) {
+    return byte_count + layout.text_offsets[layout.document_count];
+  }
+  return byte_count + (layout.block_count + 1) * (sizeof(uint32_t) + sizeof(uint64_t))
+      + layout.block_offsets[layout.block_count];
+}
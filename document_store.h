@@ -0,0 +1,128 @@
+#pragma once
+#include "block_compression.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+const size_t DOCUMENT_STORE_BLOCK_SIZE = 16 * 1024;
+
+// Texts of every document in one arena with per-document offsets, numbered
+// as in the postings. A compressing store cuts the texts into blocks of whole
+// documents of at least DOCUMENT_STORE_BLOCK_SIZE bytes and compresses every
+// block on its own, so reading a text decodes the front of one block; texts
+// after the last block stay plain until there are enough of them. The first
+// documents may be read in place from an index file.
+class DocumentStore {
+ public:
+  // The text of document i is texts[text_offsets[i]] .. texts[text_offsets[i + 1]].
+  // A plain store keeps the texts in bytes. A compressed one keeps block b,
+  // the texts of documents block_documents[b] .. block_documents[b + 1], in
+  // bytes[block_offsets[b]] .. bytes[block_offsets[b + 1]].
+  struct Layout {
+    const uint64_t *text_offsets = nullptr;
+    const uint32_t *block_documents = nullptr;
+    const uint64_t *block_offsets = nullptr;
+    const uint8_t *bytes = nullptr;
+    uint32_t document_count = 0;
+    size_t block_count = 0;
+  };
+
+  explicit DocumentStore(bool is_compressed);
+  // Documents [0, layout.document_count) read in place, all of them in blocks
+  // when compressed; storage keeps them alive
+  DocumentStore(bool is_compressed, const Layout &layout, std::shared_ptr<const void> storage);
+
+  // Documents come in index order without gaps
+  void AddDocument(const std::string_view &text);
+  // Compresses the texts after the last block into one more block
+  void Flush();
+
+  bool IsCompressed() const;
+  uint32_t GetDocumentCount() const;
+  std::string GetText(uint32_t document_index) const;
+  // Calls visitor(document_index, text) for every document in index order,
+  // decoding every block once; the text view is valid during the call only
+  template<typename Visitor>
+  void ForEachText(Visitor visitor) const {
+    ForEachText(mapped_, 0, visitor);
+    ForEachAddedText(visitor);
+  }
+  // Rewrites the documents added to the store with the texts of those
+  // is_removed(document_index) accepts left empty. Texts read in place stay
+  // until the index is saved again.
+  template<typename IsRemoved>
+  void DropTexts(IsRemoved is_removed) {
+    DocumentStore store(is_compressed_);
+    ForEachAddedText([&](uint32_t document_index, const std::string_view &text) {
+      store.AddDocument(is_removed(document_index) ? std::string_view() : text);
+    });
+    text_offsets_ = std::move(store.text_offsets_);
+    block_documents_ = std::move(store.block_documents_);
+    block_offsets_ = std::move(store.block_offsets_);
+    bytes_ = std::move(store.bytes_);
+    open_texts_ = std::move(store.open_texts_);
+  }
+  // The documents added to the store rather than read in place
+  Layout GetLayout() const;
+  // Bytes of the texts as stored, with their offsets
+  size_t GetByteCount() const;
+  // Bytes of the texts themselves
+  size_t GetTextByteCount() const;
+
+ private:
+  bool is_compressed_;
+  Layout mapped_;
+  std::shared_ptr<const void> storage_;
+  // Documents added after the mapped ones
+  std::vector<uint64_t> text_offsets_{0};
+  std::vector<uint32_t> block_documents_{0};
+  std::vector<uint64_t> block_offsets_{0};
+  std::vector<uint8_t> bytes_;
+  // Texts after the last block of a compressed store
+  std::string open_texts_;
+
+  std::string GetText(const Layout &layout, uint32_t document_index) const;
+  // The texts of the layout that are in blocks when compressed
+  template<typename Visitor>
+  void ForEachText(const Layout &layout, uint32_t first_index, Visitor &visitor) const {
+    const char *bytes = reinterpret_cast<const char *>(layout.bytes);
+    if (!is_compressed_) {
+      for (uint32_t i = 0; i < layout.document_count; ++i) {
+        visitor(first_index + i, std::string_view(bytes + layout.text_offsets[i],
+                                                  layout.text_offsets[i + 1] - layout.text_offsets[i]));
+      }
+      return;
+    }
+    for (size_t block = 0; block < layout.block_count; ++block) {
+      const uint32_t first = layout.block_documents[block];
+      const uint32_t last = layout.block_documents[block + 1];
+      const uint64_t block_text_offset = layout.text_offsets[first];
+      const std::string texts = DecompressBlock(layout.bytes + layout.block_offsets[block],
+                                                layout.bytes + layout.block_offsets[block + 1],
+                                                layout.text_offsets[last] - block_text_offset);
+      for (uint32_t i = first; i < last; ++i) {
+        visitor(first_index + i, std::string_view(texts).substr(layout.text_offsets[i] - block_text_offset,
+                                                                layout.text_offsets[i + 1] - layout.text_offsets[i]));
+      }
+    }
+  }
+  template<typename Visitor>
+  void ForEachAddedText(Visitor visitor) const {
+    const Layout layout = GetLayout();
+    ForEachText(layout, mapped_.document_count, visitor);
+    if (!is_compressed_) {
+      return;
+    }
+    const uint64_t open_offset = text_offsets_[block_documents_.back()];
+    for (uint32_t i = block_documents_.back(); i < layout.document_count; ++i) {
+      visitor(mapped_.document_count + i, std::string_view(open_texts_).substr(
+          text_offsets_[i] - open_offset, text_offsets_[i + 1] - text_offsets_[i]));
+    }
+  }
+  size_t GetByteCount(const Layout &layout) const;
+};
@@ -0,0 +1,76 @@
+#include "duplicate_index.h"
+#include "memory_usage.h"
+
+#include <bitset>
+#include <stdexcept>
+#include <string>
+
+DuplicateIndex::DuplicateIndex(uint32_t max_simhash_distance)
+    : max_simhash_distance_(max_simhash_distance) {
+  using namespace std::literals;
+  if (max_simhash_distance > MAX_SIMHASH_DISTANCE) {
+    throw std::invalid_argument("SimHash distance is too large"s);
+  }
+}
+
+uint32_t DuplicateIndex::GetMaxSimhashDistance() const {
+  return max_simhash_distance_;
+}
+
+std::optional<uint32_t> DuplicateIndex::Find(const DocumentFingerprint &fingerprint) const {
+  const auto it = term_sets_.find(fingerprint.term_set_hash);
+  if (it != term_sets_.end()) {
+    return it->second;
+  }
+  if (max_simhash_distance_ == 0) {
+    return std::nullopt;
+  }
+  for (int band = 0; band < SIMHASH_BAND_COUNT; ++band) {
+    const auto [first, last] = simhash_bands_.equal_range(GetBandKey(fingerprint.simhash, band));
+    for (auto candidate = first; candidate != last; ++candidate) {
+      const auto &[simhash, document_index] = candidate->second;
+      if (std::bitset<64>(simhash ^ fingerprint.simhash).count() <= max_simhash_distance_) {
+        return document_index;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+void DuplicateIndex::Add(const DocumentFingerprint &fingerprint, uint32_t document_index) {
+  term_sets_.emplace(fingerprint.term_set_hash, document_index);
+  if (max_simhash_distance_ == 0) {
+    return;
+  }
+  for (int band = 0; band < SIMHASH_BAND_COUNT; ++band) {
+    simhash_bands_.emplace(GetBandKey(fingerprint.simhash, band), std::pair{fingerprint.simhash, document_index});
+  }
+}
+
+void DuplicateIndex::Remove(const DocumentFingerprint &fingerprint, uint32_t document_index) {
+  const auto it = term_sets_.find(fingerprint.term_set_hash);
+  if (it != term_sets_.end() && it->second == document_index) {
+    term_sets_.erase(it);
+  }
+  if (max_simhash_distance_ == 0) {
+    return;
+  }
+  for (int band = 0; band < SIMHASH_BAND_COUNT; ++band) {
+    const auto [first, last] = simhash_bands_.equal_range(GetBandKey(fingerprint.simhash, band));
+    for (auto candidate = first; candidate != last; ++candidate) {
+      if (candidate->second.second == document_index) {
+        simhash_bands_.erase(candidate);
+        break;
+      }
+    }
+  }
+}
+
+size_t DuplicateIndex::GetByteCount() const {
+  return EstimateHashTableByteCount(term_sets_) + EstimateHashTableByteCount(simhash_bands_);
+}
+
+uint64_t DuplicateIndex::GetBandKey(uint64_t simhash, int band) {
+  const uint64_t bits = (simhash >> (band * SIMHASH_BAND_BITS)) & ((uint64_t{1} << SIMHASH_BAND_BITS) - 1);
+  return (static_cast<uint64_t>(band) << SIMHASH_BAND_BITS) | bits;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+// Near duplicates are found through SimHash bands, which works up to this distance
+const uint32_t MAX_SIMHASH_DISTANCE = 3;
+
+struct DocumentFingerprint {
+  // Hash of the set of terms
+  uint64_t term_set_hash = 0;
+  // SimHash of the set of terms; counts are left out, as the most frequent
+  // words of a text would decide most bits. Zero unless asked for.
+  uint64_t simhash = 0;
+};
+
+inline uint64_t MixFingerprintBits(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+// Words have a term_id and come sorted by term id
+template<typename Word>
+DocumentFingerprint ComputeFingerprint(const Word *first, const Word *last, bool with_simhash) {
+  DocumentFingerprint fingerprint;
+  fingerprint.term_set_hash = MixFingerprintBits(last - first);
+  for (const Word *word = first; word != last; ++word) {
+    fingerprint.term_set_hash = MixFingerprintBits(fingerprint.term_set_hash ^ word->term_id);
+  }
+  if (!with_simhash) {
+    return fingerprint;
+  }
+  // Bit b is set when most terms' hashes have it
+  uint32_t bit_counts[64] = {};
+  for (const Word *word = first; word != last; ++word) {
+    const uint64_t term_hash = MixFingerprintBits(word->term_id + 0x9e3779b97f4a7c15ULL);
+    for (int bit = 0; bit < 64; ++bit) {
+      bit_counts[bit] += (term_hash >> bit) & 1;
+    }
+  }
+  const uint32_t term_count = last - first;
+  for (int bit = 0; bit < 64; ++bit) {
+    if (2 * bit_counts[bit] > term_count) {
+      fingerprint.simhash |= uint64_t{1} << bit;
+    }
+  }
+  return fingerprint;
+}
+
+// Hash index of document fingerprints. A document duplicates an indexed one
+// with the same term set hash or, unless the max SimHash distance is zero,
+// with a SimHash differing in at most that many bits. SimHashes are split in
+// MAX_SIMHASH_DISTANCE + 1 bands, so near ones share a band and a lookup only
+// compares the documents of four buckets.
+class DuplicateIndex {
+ public:
+  // Throws std::invalid_argument above MAX_SIMHASH_DISTANCE
+  explicit DuplicateIndex(uint32_t max_simhash_distance = 0);
+
+  uint32_t GetMaxSimhashDistance() const;
+  // Index of a document the fingerprint duplicates, if any
+  std::optional<uint32_t> Find(const DocumentFingerprint &fingerprint) const;
+  void Add(const DocumentFingerprint &fingerprint, uint32_t document_index);
+  void Remove(const DocumentFingerprint &fingerprint, uint32_t document_index);
+  size_t GetByteCount() const;
+
+ private:
+  static constexpr int SIMHASH_BAND_COUNT = MAX_SIMHASH_DISTANCE + 1;
+  static constexpr int SIMHASH_BAND_BITS = 64 / SIMHASH_BAND_COUNT;
+
+  uint32_t max_simhash_distance_;
+  std::unordered_map<uint64_t, uint32_t> term_sets_;
+  // The band number and its bits to the documents with them, and their SimHash
+  std::unordered_multimap<uint64_t, std::pair<uint64_t, uint32_t>> simhash_bands_;
+
+  static uint64_t GetBandKey(uint64_t simhash, int band);
+};
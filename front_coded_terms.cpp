@@ -0,0 +1,47 @@
+#include "front_coded_terms.h"
+
+FrontCodedTerms::FrontCodedTerms(const Layout &layout)
+    : layout_(layout) {
+}
+
+FrontCodedTerms::FrontCodedTerms(const std::vector<std::pair<std::string_view, uint32_t>> &terms) {
+  std::string_view previous;
+  for (size_t i = 0; i < terms.size(); ++i) {
+    const auto &[term, id] = terms[i];
+    size_t shared_size = 0;
+    if (i % FRONT_CODING_BLOCK_SIZE == 0) {
+      block_offsets_.push_back(bytes_.size());
+    } else {
+      const size_t max_shared_size = std::min(previous.size(), term.size());
+      while (shared_size < max_shared_size && previous[shared_size] == term[shared_size]) {
+        ++shared_size;
+      }
+    }
+    AppendVarint(shared_size, bytes_);
+    AppendVarint(term.size() - shared_size, bytes_);
+    bytes_.insert(bytes_.end(), term.begin() + shared_size, term.end());
+    AppendVarint(id, bytes_);
+    previous = term;
+  }
+  block_offsets_.push_back(bytes_.size());
+  layout_ = {block_offsets_.data(), bytes_.data(), block_offsets_.size() - 1};
+}
+
+const FrontCodedTerms::Layout &FrontCodedTerms::GetLayout() const {
+  return layout_;
+}
+
+size_t FrontCodedTerms::GetByteCount() const {
+  if (layout_.block_count == 0) {
+    return 0;
+  }
+  return layout_.block_offsets[layout_.block_count] + (layout_.block_count + 1) * sizeof(uint64_t);
+}
+
+std::string_view FrontCodedTerms::GetBlockTerm(size_t block) const {
+  // The first entry of a block shares nothing with a previous term
+  const uint8_t *data = layout_.bytes + layout_.block_offsets[block];
+  ReadVarint(data);
+  const uint32_t size = ReadVarint(data);
+  return {reinterpret_cast<const char *>(data), size};
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "varint.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+const size_t FRONT_CODING_BLOCK_SIZE = 16;
+
+// Terms in byte order with their ids, front coded: every entry is the length
+// of the prefix shared with the previous term, the length of the rest, the
+// rest and the id, lengths and id as varints. Entries are grouped in blocks of
+// FRONT_CODING_BLOCK_SIZE whose first term is stored whole, so the blocks are
+// binary searched by it and a prefix is enumerated by decoding forward.
+class FrontCodedTerms {
+ public:
+  // Block i is bytes[block_offsets[i]] .. bytes[block_offsets[i + 1]]
+  struct Layout {
+    const uint64_t *block_offsets = nullptr;
+    const uint8_t *bytes = nullptr;
+    size_t block_count = 0;
+  };
+
+  FrontCodedTerms() = default;
+  // Reads the layout in place
+  explicit FrontCodedTerms(const Layout &layout);
+  // The terms must be sorted and unique
+  explicit FrontCodedTerms(const std::vector<std::pair<std::string_view, uint32_t>> &terms);
+  FrontCodedTerms(const FrontCodedTerms &) = delete;
+  FrontCodedTerms &operator=(const FrontCodedTerms &) = delete;
+  FrontCodedTerms(FrontCodedTerms &&) = default;
+  FrontCodedTerms &operator=(FrontCodedTerms &&) = default;
+
+  // Calls visitor(term, id) for every term starting with prefix, in byte
+  // order; the term view is valid during the call only
+  template<typename Visitor>
+  void ForEachWithPrefix(const std::string_view &prefix, Visitor visitor) const {
+    if (layout_.block_count == 0) {
+      return;
+    }
+    // Terms with the prefix start in the last block whose first term is less than it
+    size_t first = 0;
+    size_t last = layout_.block_count;
+    while (last - first > 1) {
+      const size_t middle = (first + last) / 2;
+      if (GetBlockTerm(middle) < prefix) {
+        first = middle;
+      } else {
+        last = middle;
+      }
+    }
+    std::string term;
+    const uint8_t *data = layout_.bytes + layout_.block_offsets[first];
+    const uint8_t *end = layout_.bytes + layout_.block_offsets[layout_.block_count];
+    while (data != end) {
+      const uint32_t shared_size = ReadVarint(data);
+      const uint32_t rest_size = ReadVarint(data);
+      term.resize(shared_size);
+      term.append(reinterpret_cast<const char *>(data), rest_size);
+      data += rest_size;
+      const uint32_t id = ReadVarint(data);
+      if (term.compare(0, prefix.size(), prefix) == 0) {
+        visitor(std::string_view(term), id);
+      } else if (term > prefix) {
+        return;
+      }
+    }
+  }
+
+  const Layout &GetLayout() const;
+  size_t GetByteCount() const;
+
+ private:
+  Layout layout_;
+  std::vector<uint64_t> block_offsets_;
+  std::vector<uint8_t> bytes_;
+
+  std::string_view GetBlockTerm(size_t block) const;
+};
@@ -0,0 +1,150 @@
+#include "index_file.h"
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::literals;
+
+namespace {
+
+const char INDEX_FILE_MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+uint64_t ComputeChecksum(const void *data, size_t size) {
+  return HashTerm({static_cast<const char *>(data), size});
+}
+
+uint64_t ComputeHeaderChecksum(IndexFileHeader header) {
+  header.header_checksum = 0;
+  return ComputeChecksum(&header, sizeof(header));
+}
+
+uint64_t AlignOffset(uint64_t offset) {
+  return (offset + INDEX_SECTION_ALIGNMENT - 1) / INDEX_SECTION_ALIGNMENT * INDEX_SECTION_ALIGNMENT;
+}
+
+}
+
+IndexFileWriter::IndexFileWriter(const std::string &path)
+    : out_(path, std::ios::binary | std::ios::trunc)
+    , offset_(sizeof(IndexFileHeader)) {
+  if (!out_) {
+    throw std::runtime_error("Can not create index file "s + path);
+  }
+  // Placeholder, the real header is written by Finish
+  const IndexFileHeader header{};
+  out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+void IndexFileWriter::AddSection(IndexSection section, const void *data, size_t size) {
+  const uint64_t section_offset = AlignOffset(offset_);
+  const std::string padding(section_offset - offset_, '\0');
+  out_.write(padding.data(), padding.size());
+  out_.write(static_cast<const char *>(data), size);
+  if (!out_) {
+    throw std::runtime_error("Can not write index file"s);
+  }
+  sections_.push_back({section, 0, section_offset, size, ComputeChecksum(data, size)});
+  offset_ = section_offset + size;
+}
+
+void IndexFileWriter::Finish() {
+  const uint64_t table_offset = AlignOffset(offset_);
+  const std::string padding(table_offset - offset_, '\0');
+  out_.write(padding.data(), padding.size());
+  const size_t table_size = sections_.size() * sizeof(IndexSectionEntry);
+  out_.write(reinterpret_cast<const char *>(sections_.data()), table_size);
+
+  IndexFileHeader header{};
+  std::copy(std::begin(INDEX_FILE_MAGIC), std::end(INDEX_FILE_MAGIC), header.magic);
+  header.version = INDEX_FILE_VERSION;
+  header.byte_order = BYTE_ORDER_MARK;
+  header.section_count = sections_.size();
+  header.section_table_offset = table_offset;
+  header.section_table_checksum = ComputeChecksum(sections_.data(), table_size);
+  header.header_checksum = ComputeHeaderChecksum(header);
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out_.flush();
+  if (!out_) {
+    throw std::runtime_error("Can not write index file"s);
+  }
+}
+
+MappedIndexFile::MappedIndexFile(const std::string &path, bool verify_checksums) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Can not open index file "s + path);
+  }
+  struct stat file_stat{};
+  if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(IndexFileHeader)) {
+    close(fd);
+    throw std::runtime_error("Index file "s + path + " is truncated"s);
+  }
+  size_ = file_stat.st_size;
+  void *data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("Can not map index file "s + path);
+  }
+  data_ = static_cast<const char *>(data);
+
+  try {
+    IndexFileHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    if (!std::equal(std::begin(INDEX_FILE_MAGIC), std::end(INDEX_FILE_MAGIC), header.magic)) {
+      throw std::runtime_error(path + " is not an index file"s);
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+      throw std::runtime_error("Index file "s + path + " was written on a host with another byte order"s);
+    }
+    if (header.version != INDEX_FILE_VERSION) {
+      throw std::runtime_error("Index file "s + path + " has unsupported version "s + std::to_string(header.version));
+    }
+    if (header.header_checksum != ComputeHeaderChecksum(header)) {
+      throw std::runtime_error("Index file "s + path + " has a corrupted header"s);
+    }
+    const uint64_t table_size = header.section_count * sizeof(IndexSectionEntry);
+    if (header.section_table_offset > size_ || table_size > size_ - header.section_table_offset) {
+      throw std::runtime_error("Index file "s + path + " is truncated"s);
+    }
+    if (header.section_table_checksum != ComputeChecksum(data_ + header.section_table_offset, table_size)) {
+      throw std::runtime_error("Index file "s + path + " has a corrupted section table"s);
+    }
+    sections_.resize(header.section_count);
+    std::memcpy(sections_.data(), data_ + header.section_table_offset, table_size);
+    for (const IndexSectionEntry &entry : sections_) {
+      if (entry.offset % INDEX_SECTION_ALIGNMENT != 0 || entry.offset > size_ || entry.size > size_ - entry.offset) {
+        throw std::runtime_error("Index file "s + path + " is truncated"s);
+      }
+      if (verify_checksums && entry.checksum != ComputeChecksum(data_ + entry.offset, entry.size)) {
+        throw std::runtime_error("Index file "s + path + " has a corrupted section "s
+                                     + std::to_string(static_cast<uint32_t>(entry.section)));
+      }
+    }
+  } catch (...) {
+    munmap(const_cast<char *>(data_), size_);
+    throw;
+  }
+}
+
+MappedIndexFile::~MappedIndexFile() {
+  munmap(const_cast<char *>(data_), size_);
+}
+
+std::pair<const char *, size_t> MappedIndexFile::FindSection(IndexSection section) const {
+  const auto it = std::find_if(sections_.begin(), sections_.end(), [section](const IndexSectionEntry &entry) {
+    return entry.section == section;
+  });
+  if (it == sections_.end()) {
+    throw std::runtime_error("Index section "s + std::to_string(static_cast<uint32_t>(section)) + " is missing"s);
+  }
+  return {data_ + it->offset, it->size};
+}
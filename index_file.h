@@ -0,0 +1,115 @@
+#pragma once
+#include "paginator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Binary index file: a header, then sections aligned to INDEX_SECTION_ALIGNMENT
+// so that their arrays can be used in place once the file is mapped, then the
+// table of sections. The header and every section carry a checksum. Arrays
+// are stored in the byte order and layout of the host that wrote them.
+const uint32_t INDEX_FILE_VERSION = 6;
+const size_t INDEX_SECTION_ALIGNMENT = 64;
+
+enum class IndexSection : uint32_t {
+  META,
+  STOP_WORDS,
+  TERM_OFFSETS,
+  TERM_BYTES,
+  PERFECT_HASH_DISPLACEMENTS,
+  PERFECT_HASH_SLOTS,
+  DOCUMENT_FREQS,
+  DOCUMENTS,
+  POSTING_TERM_IDS,
+  POSTING_BLOCK_OFFSETS,
+  POSTING_MAX_TERM_FREQS,
+  POSTING_BLOCKS,
+  POSTING_WORDS,
+  INV_WORD_COUNTS,
+  FORWARD_OFFSETS,
+  FORWARD_TERMS,
+  // Empty unless the index stores word positions
+  POSITION_OFFSETS,
+  POSITION_BYTES,
+  SORTED_TERM_BLOCK_OFFSETS,
+  SORTED_TERM_BYTES,
+  // Empty unless the index stores texts; the block sections only when compressed
+  TEXT_OFFSETS,
+  TEXT_BLOCK_DOCUMENTS,
+  TEXT_BLOCK_OFFSETS,
+  TEXT_BYTES,
+};
+
+struct IndexFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t section_count;
+  uint64_t section_table_offset;
+  uint64_t section_table_checksum;
+  uint64_t header_checksum;
+};
+
+struct IndexSectionEntry {
+  IndexSection section;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+class IndexFileWriter {
+ public:
+  explicit IndexFileWriter(const std::string &path);
+
+  void AddSection(IndexSection section, const void *data, size_t size);
+
+  template<typename Value>
+  void AddSection(IndexSection section, const std::vector<Value> &values) {
+    static_assert(std::is_trivially_copyable_v<Value>, "Index sections hold trivially copyable values only");
+    AddSection(section, values.data(), values.size() * sizeof(Value));
+  }
+
+  // Writes the section table and the header; the file is incomplete until then
+  void Finish();
+
+ private:
+  std::ofstream out_;
+  uint64_t offset_;
+  std::vector<IndexSectionEntry> sections_;
+};
+
+// Read-only shared mapping of an index file. Opening checks the header and the
+// section table; the checksums of the sections are verified on request only,
+// since that reads the whole file.
+class MappedIndexFile {
+ public:
+  explicit MappedIndexFile(const std::string &path, bool verify_checksums = true);
+  ~MappedIndexFile();
+  MappedIndexFile(const MappedIndexFile &) = delete;
+  MappedIndexFile &operator=(const MappedIndexFile &) = delete;
+
+  template<typename Value>
+  IteratorRange<const Value *> GetSection(IndexSection section) const {
+    using namespace std::literals;
+    const auto [data, size] = FindSection(section);
+    if (size % sizeof(Value) != 0) {
+      throw std::runtime_error("Index section "s + std::to_string(static_cast<uint32_t>(section)) + " is truncated"s);
+    }
+    const Value *first = reinterpret_cast<const Value *>(data);
+    return {first, first + size / sizeof(Value)};
+  }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  std::vector<IndexSectionEntry> sections_;
+
+  std::pair<const char *, size_t> FindSection(IndexSection section) const;
+};
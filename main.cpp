@@ -1,22 +1,84 @@
 #include "search_server.h"
 #include "test_example_functions.h"
 #include "process_queries.h"
+#include "benchmark.h"
+#include "concurrent_map.h"
+#include "concurrent_search_server.h"
+#include "sharded_search_server.h"
+#include "request_queue.h"
+#include "remove_duplicates.h"
+#include "work_stealing.h"
 
 #include <execution>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <new>
 
 using namespace std;
 
-int main() {
+// The allocation-free query test counts heap allocations through a global
+// operator new. Only builds with assertions replace it, so benchmarks of
+// NDEBUG builds run on the standard one.
+#ifndef NDEBUG
+// Heap allocations made by the current thread, counted by the global operator new
+thread_local size_t heap_allocation_count = 0;
+
+void *operator new(size_t size) {
+  ++heap_allocation_count;
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+// The library allocates through the nothrow form too, e.g. the buffer of
+// std::stable_sort, and frees through the operator delete below
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  ++heap_allocation_count;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && argv[1] == "--benchmark"s) {
+#ifndef NDEBUG
+    std::cout << "Assertions and heap allocation counting are on, build with NDEBUG for timings"s << endl;
+#endif
+    RunBenchmarks();
+    return 0;
+  }
+
   SearchServer search_server("and with"s);
   const std::vector<std::string> test_strings = {
       "white cat and yellow hat"s, "curly cat curly tail"s, "nasty dog with big eyes"s, "nasty pigeon john"s
   };
-  for (int id = 1; id <= test_strings.size(); ++id) {
-    search_server.AddDocument(id, test_strings[id - 1], DocumentStatus::ACTUAL, {1, 2});
+  for (size_t id = 1; id <= test_strings.size(); ++id) {
+    search_server.AddDocument(static_cast<int>(id), test_strings[id - 1], DocumentStatus::ACTUAL, {1, 2});
   }
 
   cout << "ACTUAL by default:"s << endl;
@@ -152,5 +214,1345 @@ int main() {
     std::cout << "Success" << endl;
   }
 
+  {
+    SearchServer server("in on"sv);
+    server.AddDocument(0, "cat dog"sv, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(1, "cat mouse"sv, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(2, "dog elephant"sv, DocumentStatus::ACTUAL, {3});
+    server.RemoveDocument(2);
+    const auto found = server.FindTopDocuments("dog elephant"sv);
+    assert(found.size() == 1 && found[0].id == 0);
+    server.RemoveDocument(std::execution::par, 1);
+    assert(server.FindTopDocuments("mouse"sv).empty());
+    assert(server.GetDocumentCount() == 1);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server(""sv);
+    {
+      std::string text = "cat dog"s;
+      server.AddDocument(0, text, DocumentStatus::ACTUAL, {1});
+    }
+    server.AddDocument(1, "cat mouse"s, DocumentStatus::ACTUAL, {2});
+    server.RemoveDocument(0);
+    server.FreezeTermDictionary();
+    const auto [words, status] = server.MatchDocument("cat mouse"sv, 1);
+    assert(words.size() == 2 && words[0] == "cat"sv && words[1] == "mouse"sv);
+    server.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, {3});
+    assert(server.FindTopDocuments("bird"sv).size() == 1);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server(""sv);
+    for (int id = 0; id < 10; ++id) {
+      server.AddDocument(id, "cat"s + (id % 2 == 0 ? " dog"s : ""s), DocumentStatus::ACTUAL, {id});
+    }
+    const auto top_three = server.FindTopDocuments("cat dog"sv, DocumentStatus::ACTUAL, 3);
+    assert(top_three.size() == 3);
+    assert(top_three[0].id == 8 && top_three[1].id == 6 && top_three[2].id == 4);
+    const auto top_three_par = server.FindTopDocuments(std::execution::par, "cat dog"sv, DocumentStatus::ACTUAL, 3);
+    assert(top_three_par.size() == 3 && top_three_par[0].id == 8 && top_three_par[2].id == 4);
+    assert(server.FindTopDocuments("cat"sv, DocumentStatus::ACTUAL, 20).size() == 10);
+    // Nothing is allocated for the part of top_k beyond the candidates
+    const size_t huge_top_k = std::numeric_limits<size_t>::max();
+    assert(server.FindTopDocuments("cat"sv, DocumentStatus::ACTUAL, huge_top_k).size() == 10);
+    assert(server.FindTopDocuments(std::execution::par, "cat"sv, DocumentStatus::ACTUAL, huge_top_k).size() == 10);
+    assert(server.FindTopDocumentsPruned("cat dog"sv, DocumentStatus::ACTUAL, huge_top_k).size() == 10);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server("and"sv);
+    server.AddDocument(0, "white cat and fashion collar"sv, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(1, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "groomed dog expressive eyes"sv, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+    server.AddDocument(3, "groomed starling eugene"sv, DocumentStatus::BANNED, {9});
+    for (const auto query : {"fluffy groomed cat"sv, "fluffy groomed cat -collar"sv, "eugene"sv}) {
+      const auto exhaustive = server.FindTopDocuments(query);
+      const auto pruned = server.FindTopDocumentsPruned(query);
+      assert(exhaustive.size() == pruned.size());
+      for (size_t i = 0; i < pruned.size(); ++i) {
+        assert(exhaustive[i].id == pruned[i].id && exhaustive[i].relevance == pruned[i].relevance);
+      }
+    }
+    assert(server.FindTopDocumentsPruned("fluffy groomed cat"sv, DocumentStatus::ACTUAL, 1)[0].id == 1);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server(""sv);
+    const std::vector<std::string> texts = {"cat"s, "cat dog"s, "dog bird"s, "bird"s, "cat bird fish"s};
+    for (int id = 0; id < 40000; ++id) {
+      server.AddDocument(id, texts[id % texts.size()], DocumentStatus::ACTUAL, {id % 7});
+    }
+    const auto seq_result = server.FindTopDocuments(std::execution::seq, "cat bird -fish"sv, DocumentStatus::ACTUAL, 10);
+    const auto par_result = server.FindTopDocuments(std::execution::par, "cat bird -fish"sv, DocumentStatus::ACTUAL, 10);
+    assert(seq_result.size() == 10 && par_result.size() == 10);
+    for (size_t i = 0; i < seq_result.size(); ++i) {
+      assert(seq_result[i].id == par_result[i].id && seq_result[i].relevance == par_result[i].relevance);
+      assert(seq_result[i].id % texts.size() != 4);
+    }
+    std::cout << "Success" << endl;
+  }
+
+  {
+    ConcurrentMap<std::string_view, int> word_counts(4);
+    const std::vector<std::string_view> words = {"cat"sv, "dog"sv, "cat"sv, "bird"sv, "cat"sv};
+    std::for_each(std::execution::par, words.begin(), words.end(), [&word_counts](std::string_view word) {
+      word_counts.Accumulate(word, 1);
+    });
+    word_counts.Erase("bird"sv);
+    const auto ordinary_map = word_counts.BuildOrdinaryMap();
+    assert(ordinary_map.size() == 2 && ordinary_map.at("cat"sv) == 3 && ordinary_map.at("dog"sv) == 1);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server("and with"s);
+    int id = 0;
+    for (const std::string &text : {"funny pet and nasty rat"s, "funny pet with curly hair"s, "funny pet and not very nasty rat"s,
+                                    "pet with rat and rat and rat"s, "nasty rat with curly hair"s}) {
+      server.AddDocument(++id, text, DocumentStatus::ACTUAL, {1, 2});
+    }
+    const std::vector<std::string> queries = {"nasty rat -not"s, "not very funny nasty pet"s, "curly hair"s};
+    const auto batch_results = ProcessQueries(server, queries);
+    assert(batch_results.size() == queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const auto single_results = server.FindTopDocuments(queries[i]);
+      assert(batch_results[i].size() == single_results.size());
+      for (size_t j = 0; j < single_results.size(); ++j) {
+        assert(batch_results[i][j].id == single_results[j].id);
+        assert(batch_results[i][j].relevance == single_results[j].relevance);
+      }
+    }
+    assert(ProcessQueriesJoined(server, queries).size() == 10);
+
+    // Buffers grow with the results, not with top_k
+    QueryResultArena huge_results;
+    server.FindTopDocumentsBatch(queries, huge_results, DocumentStatus::ACTUAL, std::numeric_limits<size_t>::max() / 2 + 1);
+    assert(huge_results.size() == queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      assert(huge_results[i].size() == server.FindTopDocuments(queries[i], DocumentStatus::ACTUAL, 100).size());
+    }
+    // An invalid query in a batch throws on the caller rather than aborting
+    const std::vector<std::string> invalid_queries = {"nasty rat"s, "curly hair"s, "cat --dog"s};
+    const std::vector<std::function<void()>> batch_runs = {
+        [&]() { ProcessQueries(server, invalid_queries); },
+        [&]() { ProcessQueriesJoined(server, invalid_queries); },
+        [&]() { ProcessQueriesFlat(server, invalid_queries); },
+        [&]() { ProcessQueriesStream(server, invalid_queries, [](size_t, const auto &) {}, 1); },
+    };
+    for (const auto &run_batch : batch_runs) {
+      try {
+        run_batch();
+        assert(false);
+      } catch (const std::invalid_argument &) {
+      }
+    }
+    // A task that throws stops the batch and the exception reaches the caller
+    try {
+      ParallelForWorkStealing(1'000, [](size_t task) {
+        if (task == 10) {
+          throw std::runtime_error("task failed"s);
+        }
+      });
+      assert(false);
+    } catch (const std::runtime_error &) {
+    }
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server(""s);
+    for (int id = 0; id < 20; ++id) {
+      server.AddDocument(id, "word"s + std::to_string(id % 4) + " common"s, DocumentStatus::ACTUAL, {id});
+    }
+    std::vector<std::string> queries;
+    for (int i = 0; i < 11; ++i) {
+      queries.push_back("word"s + std::to_string(i % 5));
+    }
+    const auto per_query = ProcessQueries(server, queries);
+    size_t next_query = 0;
+    ProcessQueriesStream(server, queries, [&](size_t query_index, const auto &documents) {
+      assert(query_index == next_query++);
+      assert(documents.size() == per_query[query_index].size());
+      assert(std::equal(documents.begin(), documents.end(), per_query[query_index].begin(), [](const Document &lhs, const Document &rhs) {
+        return lhs.id == rhs.id;
+      }));
+    }, 3);
+    assert(next_query == queries.size());
+    const auto flat = ProcessQueriesFlat(server, queries);
+    assert(flat.size() == queries.size() && flat[4].size() == 0 && flat[5].size() == 5);
+    assert(ProcessQueriesJoined(server, queries).size() == flat.documents.size());
+    std::cout << "Success" << endl;
+  }
+
+  {
+    ConcurrentSearchServer server("and"s);
+    std::atomic<bool> is_writing = true;
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 2; ++reader) {
+      readers.emplace_back([&server, &is_writing] {
+        while (is_writing) {
+          server.Read([](const SearchServer &snapshot) {
+            assert(snapshot.GetDocumentCount() == std::distance(snapshot.begin(), snapshot.end()));
+            for (const Document &document : snapshot.FindTopDocuments("cat dog -mouse"sv, DocumentStatus::ACTUAL, 20)) {
+              const auto [words, status] = snapshot.MatchDocument("cat dog -mouse"sv, document.id);
+              assert(!words.empty() && status == DocumentStatus::ACTUAL);
+            }
+          });
+        }
+      });
+    }
+    for (int id = 0; id < 400; ++id) {
+      server.AddDocument(id, id % 3 == 0 ? "cat and dog"sv : "cat and mouse"sv, DocumentStatus::ACTUAL, {id % 10});
+      if (id % 4 == 3) {
+        server.RemoveDocument(id - 2);
+      }
+    }
+    is_writing = false;
+    for (auto &reader : readers) {
+      reader.join();
+    }
+    assert(server.GetDocumentCount() == 300);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server("and"s);
+    for (int id = 0; id < 5000; ++id) {
+      server.AddDocument(id, "word"s + std::to_string(id % 7) + " and term"s + std::to_string(id % 13) + " common"s,
+                         id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 10});
+      if (id % 3 == 2) {
+        server.RemoveDocument(id - 1);
+      }
+    }
+    const auto before_merge = server.FindTopDocuments("word3 term5 -term7"sv, DocumentStatus::ACTUAL, 50);
+    server.WaitForMerges();
+    // Four sealed segments of 1024 documents merge into one, next to the active segment
+    assert(server.GetSegmentCount() == 2);
+    const auto after_merge = server.FindTopDocuments("word3 term5 -term7"sv, DocumentStatus::ACTUAL, 50);
+    assert(before_merge.size() == 50 && after_merge.size() == 50);
+    for (size_t i = 0; i < after_merge.size(); ++i) {
+      assert(before_merge[i].id == after_merge[i].id && before_merge[i].relevance == after_merge[i].relevance);
+    }
+    const auto pruned = server.FindTopDocumentsPruned("word3 term5 -term7"sv, DocumentStatus::ACTUAL, 50);
+    assert(std::equal(pruned.begin(), pruned.end(), after_merge.begin(), [](const Document &lhs, const Document &rhs) {
+      return lhs.id == rhs.id;
+    }));
+    // Removal from a merged segment
+    server.RemoveDocument(3993);
+    const auto all_documents = server.FindTopDocuments("word3"sv, DocumentStatus::ACTUAL, 5000);
+    assert(std::none_of(all_documents.begin(), all_documents.end(), [](const Document &document) {
+      return document.id == 3993;
+    }));
+    const auto [words, status] = server.MatchDocument("word3 term5"sv, 3);
+    assert(words.size() == 1 && status == DocumentStatus::ACTUAL);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    const auto same_results = [](const std::vector<Document> &lhs, const std::vector<Document> &rhs) {
+      return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document &lhs, const Document &rhs) {
+        return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+      });
+    };
+    SearchServer server("and"s);
+    for (int id = 0; id < 40; ++id) {
+      server.AddDocument(id, "cat"s + std::to_string(id % 3) + " and dog"s + std::to_string(id % 5),
+                         id % 4 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id});
+    }
+    server.RemoveDocument(3);
+    const std::string path = "search_server_test.idx"s;
+    server.SaveIndex(path);
+    SearchServer loaded = SearchServer::LoadIndex(path);
+    assert(loaded.GetDocumentCount() == server.GetDocumentCount());
+    assert(std::equal(loaded.begin(), loaded.end(), server.begin(), server.end()));
+    assert(same_results(loaded.FindTopDocuments("cat1 dog2 -dog4 and"sv, DocumentStatus::ACTUAL, 40),
+                        server.FindTopDocuments("cat1 dog2 -dog4 and"sv, DocumentStatus::ACTUAL, 40)));
+    assert(loaded.MatchDocument("cat1 dog2"sv, 7) == server.MatchDocument("cat1 dog2"sv, 7));
+    assert(loaded.GetWordFrequencies(7) == server.GetWordFrequencies(7));
+    // The loaded index keeps taking documents and removals
+    for (SearchServer *target : {&server, &loaded}) {
+      target->AddDocument(40, "cat1 bird"sv, DocumentStatus::ACTUAL, {5});
+      target->RemoveDocument(5);
+    }
+    assert(same_results(loaded.FindTopDocuments("cat1 bird dog0"sv), server.FindTopDocuments("cat1 bird dog0"sv)));
+
+    {
+      std::ifstream in(path, std::ios::binary);
+      std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      bytes[bytes.size() / 2] ^= 1;
+      std::ofstream(path + ".corrupted"s, std::ios::binary) << bytes;
+    }
+    bool is_rejected = false;
+    try {
+      SearchServer::LoadIndex(path + ".corrupted"s);
+    } catch (const std::runtime_error &) {
+      is_rejected = true;
+    }
+    assert(is_rejected);
+    // Without checksums, the structure of the sections is still checked
+    const auto corrupt_section = [&path](IndexSection section, size_t offset, const auto &value) {
+      std::ifstream in(path, std::ios::binary);
+      std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      IndexFileHeader header;
+      std::memcpy(&header, bytes.data(), sizeof(header));
+      for (uint64_t i = 0; i < header.section_count; ++i) {
+        IndexSectionEntry entry;
+        std::memcpy(&entry, bytes.data() + header.section_table_offset + i * sizeof(entry), sizeof(entry));
+        if (entry.section == section) {
+          std::memcpy(bytes.data() + entry.offset + offset, &value, sizeof(value));
+        }
+      }
+      std::ofstream(path + ".corrupted"s, std::ios::binary) << bytes;
+      try {
+        SearchServer::LoadIndex(path + ".corrupted"s, false);
+        return false;
+      } catch (const std::runtime_error &) {
+        return true;
+      }
+    };
+    assert(corrupt_section(IndexSection::FORWARD_OFFSETS, sizeof(uint64_t), uint64_t{1} << 40));
+    assert(corrupt_section(IndexSection::TERM_OFFSETS, sizeof(uint64_t), uint64_t{1} << 40));
+    assert(corrupt_section(IndexSection::FORWARD_TERMS, 0, TermId{1'000'000}));
+    assert(corrupt_section(IndexSection::DOCUMENTS, 2 * sizeof(int32_t), int32_t{7}));
+    assert(corrupt_section(IndexSection::POSTING_BLOCKS, offsetof(PostingBlock, last_document_index), uint32_t{1'000}));
+    assert(corrupt_section(IndexSection::POSTING_BLOCKS, offsetof(PostingBlock, word_offset), uint64_t{1} << 40));
+    assert(corrupt_section(IndexSection::POSTING_TERM_IDS, 0, TermId{1'000'000}));
+    assert(corrupt_section(IndexSection::SORTED_TERM_BYTES, 1, uint8_t{0xff}));
+    std::remove((path + ".corrupted"s).c_str());
+    std::remove(path.c_str());
+    std::cout << "Success" << endl;
+  }
+
+  {
+    std::mt19937 generator;
+    for (uint32_t bit_width = 0; bit_width <= 32; ++bit_width) {
+      for (const size_t count : {size_t{1}, size_t{37}, BIT_PACKING_BLOCK_SIZE}) {
+        std::vector<uint32_t> values(count);
+        for (uint32_t &value : values) {
+          value = bit_width == 32 ? generator() : generator() & ((uint32_t{1} << bit_width) - 1);
+        }
+        std::vector<uint32_t> words(GetPackedWordCount(count, bit_width), 0);
+        PackValues(values.data(), count, bit_width, words.data());
+        std::vector<uint32_t> unpacked(count);
+        UnpackValues(words.data(), count, bit_width, unpacked.data());
+        assert(unpacked == values);
+      }
+    }
+
+    std::vector<Posting> postings;
+    std::vector<double> inv_word_counts(3000);
+    for (uint32_t document_index = 0; document_index < 3000; ++document_index) {
+      inv_word_counts[document_index] = 1.0 / (document_index % 9 + 3);
+      if (document_index % 7 == 0 || document_index % 11 == 0) {
+        const uint32_t term_count = document_index % 3 + 1;
+        postings.push_back({document_index, term_count, ComputeTermFreq(term_count, inv_word_counts[document_index])});
+      }
+    }
+    std::vector<PostingBlock> blocks;
+    std::vector<uint32_t> words;
+    EncodePostings(postings.data(), postings.data() + postings.size(), blocks, words);
+    assert(blocks.size() == (postings.size() + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE);
+    const PostingList compressed(blocks.data(), blocks.data() + blocks.size(), words.data(), inv_word_counts.data(), 0, 1.0);
+    assert(compressed.size() == postings.size() && compressed.GetByteCount() < postings.size() * sizeof(Posting) / 4);
+    size_t position = 0;
+    for (PostingCursor cursor(compressed); !cursor.IsEnd(); cursor.Next(), ++position) {
+      assert(cursor->document_index == postings[position].document_index);
+      assert(cursor->term_count == postings[position].term_count && cursor->term_freq == postings[position].term_freq);
+    }
+    assert(position == postings.size());
+    PostingCursor cursor(compressed, 1500);
+    assert(cursor->document_index == 1505);
+    cursor.AdvanceTo(2990);
+    assert(cursor->document_index == 2992);
+    cursor.AdvanceTo(2999);
+    assert(cursor.IsEnd());
+    assert(compressed.Contains(2002) && !compressed.Contains(2003));
+
+    // Sealed segments restore term frequencies bit for bit
+    SearchServer server("and"s);
+    for (int id = 0; id < 2000; ++id) {
+      server.AddDocument(id, id % 2 == 0 ? "cat cat and dog"s + std::to_string(id % 3) + " cat"s + std::string(id % 4, 'x')
+                                         : "bird dog"s + std::to_string(id % 3),
+                         DocumentStatus::ACTUAL, {id % 10});
+    }
+    const auto inverse_document_freq = [&server](const std::string &word) {
+      int document_freq = 0;
+      for (const int id : server) {
+        document_freq += server.GetWordFrequencies(id).count(word);
+      }
+      return std::log(server.GetDocumentCount() * 1.0 / document_freq);
+    };
+    const double cat_idf = inverse_document_freq("cat"s);
+    const double dog_idf = inverse_document_freq("dog1"s);
+    const auto documents = server.FindTopDocuments("cat dog1"sv, DocumentStatus::ACTUAL, 2000);
+    assert(documents.size() == 1334);
+    for (const Document &document : documents) {
+      const auto &word_freqs = server.GetWordFrequencies(document.id);
+      double relevance = 0.0;
+      if (word_freqs.count("cat"s) > 0) {
+        relevance += word_freqs.at("cat"s) * cat_idf;
+      }
+      if (word_freqs.count("dog1"s) > 0) {
+        relevance += word_freqs.at("dog1"s) * dog_idf;
+      }
+      assert(document.relevance == relevance);
+    }
+    std::cout << "Success" << endl;
+  }
+
+  {
+    const auto split_byte_by_byte = [](const std::string &text) {
+      std::vector<std::string> words(1);
+      for (const char c : text) {
+        if (c == ' ') {
+          words.emplace_back();
+        } else {
+          words.back() += c;
+        }
+      }
+      words.erase(std::remove(words.begin(), words.end(), ""s), words.end());
+      return words;
+    };
+    std::mt19937 generator;
+    const std::string alphabet = "ab -z\x7f\x80\t"s;
+    WordSplitter &splitter = WordSplitter::ForCurrentThread();
+    for (int length = 0; length < 200; ++length) {
+      std::string text;
+      for (int i = 0; i < length; ++i) {
+        text += alphabet[generator() % (alphabet.size() - (length % 3 == 0 ? 0 : 1))];
+      }
+      const auto &words = splitter.Split(text);
+      assert(std::vector<std::string>(words.begin(), words.end()) == split_byte_by_byte(text));
+      assert(SplitIntoWords(text) == split_byte_by_byte(text));
+      assert(splitter.HasControlCharacter() == (text.find('\t') != std::string::npos));
+    }
+    // The buffer is reused
+    const auto *words_data = splitter.Split(std::string(300, 'a') + " b c"s).data();
+    assert(splitter.Split("d e f"sv).data() == words_data);
+
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat and dog                                   with a long run of spaces"sv, DocumentStatus::ACTUAL, {1});
+    assert(server.GetWordFrequencies(1).size() == 8);
+    try {
+      server.AddDocument(2, "cat and dog                                   with a con\x12trol character"sv,
+                         DocumentStatus::ACTUAL, {1});
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    try {
+      server.FindTopDocuments("cat                                   -do\x1fg"sv);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    assert(server.FindTopDocuments("cat                                   -dog\x80"sv).size() == 1);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server("and in"s);
+    for (int id = 0; id < 3000; ++id) {
+      server.AddDocument(id, (id % 2 == 0 ? "white cat"s : "black dog"s) + " number "s + std::to_string(id % 7),
+                         DocumentStatus::ACTUAL, {id % 5});
+    }
+    // Warm up the arena, the score accumulator and the splitter of this thread
+    server.FindTopDocuments("white cat -dog in number"s);
+    server.FindTopDocumentsPruned("white cat -dog in number"s);
+    server.MatchDocument("white cat -dog number"s, 4);
+    server.MatchDocument(std::execution::par, "white cat -dog number"s, 4);
+
+#ifndef NDEBUG
+    const auto count_allocations = [](const auto &run) {
+      const size_t before = heap_allocation_count;
+      run();
+      return heap_allocation_count - before;
+    };
+    // The returned vector is the only allocation left
+    assert(count_allocations([&] {
+      assert(server.FindTopDocuments("cat -dog in number"sv).size() == 5);
+    }) == 1);
+    assert(count_allocations([&] {
+      assert(server.FindTopDocumentsPruned("white -black number"sv).size() == 5);
+    }) == 1);
+    assert(count_allocations([&] {
+      assert(server.FindTopDocuments("parrot -cat"sv).empty());
+    }) == 0);
+    assert(count_allocations([&] {
+      assert(std::get<0>(server.MatchDocument("white cat -dog number"sv, 4)).size() == 3);
+    }) == 1);
+#endif
+    const size_t capacity = QueryArena::ForCurrentThread().GetCapacity();
+    for (int i = 0; i < 100; ++i) {
+      server.FindTopDocuments("white cat number -black"sv);
+    }
+    assert(QueryArena::ForCurrentThread().GetCapacity() == capacity);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 2'000, 8);
+    const auto texts = GenerateTexts(generator, dictionary, 5'000, 30);
+    std::vector<DocumentInput> documents;
+    for (int id = 0; id < 5'000; ++id) {
+      documents.push_back({id * 3, texts[id], DocumentStatus(id % 3), {id % 7, -(id % 4)}});
+    }
+    SearchServer one_by_one(dictionary[0]);
+    for (int id = 0; id < 1'500; ++id) {
+      one_by_one.AddDocument(id * 3, texts[id], DocumentStatus(id % 3), {id % 7, -(id % 4)});
+    }
+    one_by_one.AddDocuments(std::vector<DocumentInput>(documents.begin() + 1'500, documents.end()));
+    SearchServer batched(dictionary[0]);
+    batched.AddDocuments(std::execution::par, std::vector<DocumentInput>(documents.begin(), documents.begin() + 700));
+    batched.AddDocuments(std::execution::par, std::vector<DocumentInput>(documents.begin() + 700, documents.end()));
+    assert(batched.GetDocumentCount() == one_by_one.GetDocumentCount());
+    assert(batched.GetPostingCount() == one_by_one.GetPostingCount());
+    for (int id = 0; id < 15'000; id += 3 * 97) {
+      assert(batched.GetWordFrequencies(id) == one_by_one.GetWordFrequencies(id));
+    }
+    for (const std::string &query : GenerateTexts(generator, dictionary, 50, 5, 0.2)) {
+      const auto expected = one_by_one.FindTopDocuments(query);
+      const auto found = batched.FindTopDocuments(query);
+      assert(found.size() == expected.size());
+      for (size_t i = 0; i < found.size(); ++i) {
+        assert(found[i].id == expected[i].id && found[i].relevance == expected[i].relevance
+                   && found[i].rating == expected[i].rating);
+      }
+    }
+
+    // Documents before the rejected one stay, the rest are dropped
+    SearchServer server("and"s);
+    server.AddDocument(5, "old cat"sv, DocumentStatus::ACTUAL, {1});
+    std::vector<DocumentInput> with_bad_id(documents.begin(), documents.begin() + 2'000);
+    with_bad_id[1'800].id = 5;
+    try {
+      server.AddDocuments(std::execution::par, with_bad_id);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    assert(server.GetDocumentCount() == 1'801);
+    std::vector<DocumentInput> with_bad_text = {{20'000, "new dog"sv, DocumentStatus::ACTUAL, {}},
+                                                {20'001, "bad \x01 dog"sv, DocumentStatus::ACTUAL, {}},
+                                                {20'002, "parrot"sv, DocumentStatus::ACTUAL, {}}};
+    try {
+      server.AddDocuments(std::execution::par, with_bad_text);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    assert(server.GetDocumentCount() == 1'802);
+    assert(server.FindTopDocuments("parrot"sv).empty());
+    try {
+      server.AddDocuments(std::execution::par, {{20'003, "fox"sv, DocumentStatus::ACTUAL, {}},
+                                                {20'003, "fox"sv, DocumentStatus::ACTUAL, {}}});
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    assert(server.GetDocumentCount() == 1'803);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and fluffy tail"sv, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black cat"sv, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "black dog black tail"sv, DocumentStatus::ACTUAL, {1});
+    const CorpusStatistics &statistics = server.GetCorpusStatistics();
+    assert(statistics.GetDocumentCount() == 3);
+    assert(statistics.GetWordCount() == 10);
+    assert(std::abs(statistics.GetAverageDocumentLength() - 10.0 / 3) < 1e-12);
+    // Terms are numbered in the order they first occur: white, cat, fluffy, tail, black, dog
+    assert(statistics.GetDocumentFreq(0) == 1 && statistics.GetDocumentFreq(1) == 2 && statistics.GetDocumentFreq(4) == 2);
+    const auto black = server.FindTopDocuments("black"sv);
+    assert(black.size() == 2);
+    assert(black[0].relevance == 0.5 * log(3 * 1.0 / 2));
+
+    // Every change starts a new generation and the cached IDF follows it
+    const uint64_t generation = statistics.GetGeneration();
+    server.AddDocument(4, "grey parrot"sv, DocumentStatus::ACTUAL, {1});
+    assert(statistics.GetGeneration() != generation);
+    assert(server.FindTopDocuments("black"sv)[0].relevance == 0.5 * log(4 * 1.0 / 2));
+    server.RemoveDocument(std::execution::par, 2);
+    assert(statistics.GetDocumentCount() == 3 && statistics.GetWordCount() == 10);
+    assert(server.FindTopDocuments("black"sv)[0].relevance == 0.5 * log(3 * 1.0 / 1));
+    server.RemoveDocument(1);
+    assert(statistics.GetDocumentCount() == 2 && statistics.GetWordCount() == 6);
+
+    const std::string path = "search_server_statistics_test.idx"s;
+    server.SaveIndex(path);
+    const SearchServer loaded = SearchServer::LoadIndex(path);
+    std::remove(path.c_str());
+    const CorpusStatistics &loaded_statistics = loaded.GetCorpusStatistics();
+    assert(loaded_statistics.GetDocumentCount() == 2 && loaded_statistics.GetWordCount() == 6);
+    assert(loaded.FindTopDocuments("black tail"sv)[0].relevance == server.FindTopDocuments("black tail"sv)[0].relevance);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat cat dog"sv, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat and parrot with long tail"sv, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "dog"sv, DocumentStatus::ACTUAL, {3});
+    const auto any_document = [](int document_id, DocumentStatus status, int rating) {
+      return true;
+    };
+    // avgdl = (3 + 5 + 1) / 3, idf = log(1 + (3 - 2 + 0.5) / (2 + 0.5))
+    const auto bm25 = [](double term_count, double length) {
+      const double k1 = 1.2;
+      const double b = 0.75;
+      return log(1.0 + 1.5 / 2.5) * term_count * (k1 + 1) / (term_count + k1 * (1 - b + b * length / 3.0));
+    };
+    const auto cat = server.FindTopDocuments<Bm25Scoring>("cat"sv, any_document);
+    assert(cat.size() == 2 && cat[0].id == 1 && cat[1].id == 2);
+    assert(std::abs(cat[0].relevance - bm25(2, 3)) < 1e-12 && std::abs(cat[1].relevance - bm25(1, 5)) < 1e-12);
+    // TF-IDF stays the default
+    assert(server.FindTopDocuments("cat"sv, any_document)[0].relevance == 2.0 / 3 * log(3.0 / 2));
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 500, 8);
+    SearchServer big(dictionary[0]);
+    const auto texts = GenerateTexts(generator, dictionary, 4'000, 40);
+    for (int id = 0; id < 4'000; ++id) {
+      big.AddDocument(id, texts[id], DocumentStatus(id % 2), {id % 9});
+    }
+    const auto is_actual = [](int document_id, DocumentStatus status, int rating) {
+      return status == DocumentStatus::ACTUAL;
+    };
+    for (const std::string &query : GenerateTexts(generator, dictionary, 100, 6, 0.2)) {
+      const auto expected = big.FindTopDocuments<Bm25Scoring>(query, is_actual, 10);
+      const auto parallel = big.FindTopDocuments<Bm25Scoring>(std::execution::par, query, is_actual, 10);
+      const auto pruned = big.FindTopDocumentsPruned<Bm25Scoring>(query, is_actual, 10);
+      assert(parallel.size() == expected.size() && pruned.size() == expected.size());
+      for (size_t i = 0; i < expected.size(); ++i) {
+        assert(parallel[i].id == expected[i].id && parallel[i].relevance == expected[i].relevance);
+        assert(pruned[i].id == expected[i].id && pruned[i].relevance == expected[i].relevance);
+      }
+    }
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat"sv, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black dog"sv, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "black cat"sv, DocumentStatus::BANNED, {3});
+    // Disabled, the cache is bypassed
+    assert(server.FindTopDocumentsCached("cat"sv).size() == 1);
+    assert(server.GetResultCacheStats().miss_count == 0);
+
+    server.EnableResultCache(2, 1);
+    assert(server.FindTopDocumentsCached("cat -dog"sv).size() == 1);
+    // Same terms in another order, with duplicates, stop words and unknown words
+    assert(server.FindTopDocumentsCached("-dog cat and cat parrot"sv).size() == 1);
+    assert(server.GetResultCacheStats().hit_count == 1 && server.GetResultCacheStats().miss_count == 1);
+    // Status and top_k are part of the key
+    assert(server.FindTopDocumentsCached("cat -dog"sv, DocumentStatus::BANNED).size() == 1);
+    assert(server.FindTopDocumentsCached("cat -dog"sv, DocumentStatus::ACTUAL, 1).size() == 1);
+    assert(server.GetResultCacheStats().miss_count == 3 && server.GetResultCacheStats().eviction_count == 1);
+
+    server.AddDocument(4, "grey cat"sv, DocumentStatus::ACTUAL, {4});
+    assert(server.FindTopDocumentsCached("cat -dog"sv, DocumentStatus::ACTUAL, 1).size() == 1);
+    assert(server.FindTopDocumentsCached("cat -dog"sv, DocumentStatus::ACTUAL, 1)[0].id == 4);
+    const QueryCacheStats stats = server.GetResultCacheStats();
+    assert(stats.stale_count == 1 && stats.hit_count == 2 && stats.miss_count == 4);
+    assert(std::abs(stats.GetHitRate() - 2.0 / 6) < 1e-12);
+
+    // The request queue shares the cache of its server
+    RequestQueue request_queue(server);
+    request_queue.AddFindRequest("parrot"s);
+    request_queue.AddFindRequest("parrot"s);
+    assert(request_queue.GetNoResultRequests() == 2);
+    assert(server.GetResultCacheStats().hit_count == 3);
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 6);
+    SearchServer big(dictionary[0]);
+    const auto texts = GenerateTexts(generator, dictionary, 3'000, 20);
+    for (int id = 0; id < 3'000; ++id) {
+      big.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 7});
+    }
+    big.EnableResultCache(64, 4);
+    const auto queries = GenerateTexts(generator, dictionary, 100, 4, 0.2);
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatch_count = 0;
+    for (int thread = 0; thread < 4; ++thread) {
+      threads.emplace_back([&, thread] {
+        for (int i = 0; i < 500; ++i) {
+          const std::string &query = queries[(i * (thread + 3)) % queries.size()];
+          const auto cached = big.FindTopDocumentsCached(query);
+          const auto expected = big.FindTopDocuments(query);
+          if (cached.size() != expected.size() || !std::equal(cached.begin(), cached.end(), expected.begin(),
+              [](const Document &lhs, const Document &rhs) {
+                return lhs.id == rhs.id && lhs.relevance == rhs.relevance;
+              })) {
+            ++mismatch_count;
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    assert(mismatch_count == 0);
+    assert(big.GetResultCacheStats().hit_count + big.GetResultCacheStats().miss_count == 2'000);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    SearchServer plain("and"s);
+    plain.AddDocument(1, "white cat"sv, DocumentStatus::ACTUAL, {1});
+    assert(plain.GetPositionByteCount() == 0);
+    try {
+      plain.FindTopDocuments("\"white cat\""sv);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+
+    SearchServer server("and"s, IndexOptions{true});
+    server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cat white collar"sv, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "fancy white cat"sv, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "white and cat"sv, DocumentStatus::ACTUAL, {4});
+    assert(server.GetPositionByteCount() > 0);
+    const auto ids = [](std::vector<Document> documents) {
+      std::vector<int> result;
+      for (const Document &document : documents) {
+        result.push_back(document.id);
+      }
+      std::sort(result.begin(), result.end());
+      return result;
+    };
+    assert(ids(server.FindTopDocuments("\"white cat\""sv)) == std::vector<int>({1, 3}));
+    // Phrase words score as plus words
+    assert(server.FindTopDocuments("\"white cat\""sv)[0].relevance == server.FindTopDocuments("white cat"sv)[0].relevance);
+    // A stop word holds its place, leading ones are dropped
+    assert(ids(server.FindTopDocuments("\"white and cat\""sv)) == std::vector<int>({4}));
+    assert(ids(server.FindTopDocuments("\"and cat\""sv)) == std::vector<int>({1, 2, 3, 4}));
+    assert(ids(server.FindTopDocuments("cat -\"white cat\""sv)) == std::vector<int>({2, 4}));
+    assert(ids(server.FindTopDocuments("\"white cat\" \"fancy collar\""sv)) == std::vector<int>({1}));
+    assert(server.FindTopDocuments("\"white parrot\" cat"sv).empty());
+    for (const std::string_view query : {"\"white cat"sv, "white cat\""sv, "\"white \"cat\"\""sv, "\"white -cat\""sv}) {
+      try {
+        server.FindTopDocuments(query);
+        assert(false);
+      } catch (const std::invalid_argument &) {
+      }
+    }
+    assert(std::get<0>(server.MatchDocument("\"white cat\" collar"sv, 2)).empty());
+    assert(std::get<0>(server.MatchDocument(std::execution::par, "\"white cat\" collar"sv, 1)).size() == 3);
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 6);
+    const auto texts = GenerateTexts(generator, dictionary, 3'000, 20);
+    std::vector<DocumentInput> documents;
+    SearchServer big(dictionary[0], IndexOptions{true});
+    for (int id = 0; id < 3'000; ++id) {
+      big.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 7});
+      documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {id % 7}});
+    }
+    SearchServer batched(dictionary[0], IndexOptions{true});
+    batched.AddDocuments(std::execution::par, documents);
+    const std::string path = "search_server_positions_test.idx"s;
+    big.SaveIndex(path);
+    const SearchServer loaded = SearchServer::LoadIndex(path);
+    std::remove(path.c_str());
+
+    const auto any_document = [](int document_id, DocumentStatus status, int rating) {
+      return true;
+    };
+    const auto by_id = [](std::vector<Document> documents) {
+      std::sort(documents.begin(), documents.end(), [](const Document &lhs, const Document &rhs) {
+        return lhs.id < rhs.id;
+      });
+      return documents;
+    };
+    const auto same_results = [](const std::vector<Document> &lhs, const std::vector<Document> &rhs) {
+      return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document &lhs, const Document &rhs) {
+        return lhs.id == rhs.id && lhs.relevance == rhs.relevance;
+      });
+    };
+    // Phrases are taken from the documents and checked against a scan of the texts
+    for (int i = 0; i < 200; ++i) {
+      const auto words = SplitIntoWords(std::string_view(texts[i * 13]));
+      const size_t length = 2 + i % 2;
+      // A stop word in a phrase matches any word, which a scan of the text can not tell
+      if (words.size() < length + 1 || std::find(words.begin(), words.begin() + length, dictionary[0]) != words.begin() + length) {
+        continue;
+      }
+      const std::string phrase(words[0].data(), words[length - 1].data() + words[length - 1].size() - words[0].data());
+      const std::string other(words.back());
+      const bool is_minus = i % 3 == 0;
+      const std::string query = is_minus ? other + " -\""s + phrase + "\""s : other + " \""s + phrase + "\""s;
+      std::vector<Document> expected;
+      for (const Document &document : big.FindTopDocuments(is_minus ? other : other + " "s + phrase, any_document, 3'000)) {
+        const bool has_phrase = (" "s + texts[document.id] + " "s).find(" "s + phrase + " "s) != std::string::npos;
+        if (has_phrase != is_minus) {
+          expected.push_back(document);
+        }
+      }
+      assert(same_results(by_id(big.FindTopDocuments(query, any_document, 3'000)), by_id(expected)));
+      const auto top = big.FindTopDocuments(query, any_document);
+      assert(same_results(big.FindTopDocuments(std::execution::par, query, any_document), top));
+      assert(same_results(big.FindTopDocumentsPruned(query, any_document), top));
+      assert(same_results(batched.FindTopDocuments(query, any_document), top));
+      assert(same_results(loaded.FindTopDocuments(query, any_document), top));
+    }
+    std::cout << "Success" << endl;
+  }
+
+  {
+    assert(MatchesWildcard("ca*"sv, "cat"sv) && MatchesWildcard("c*t"sv, "cart"sv) && MatchesWildcard("c*r*"sv, "cr"sv));
+    assert(!MatchesWildcard("c*t"sv, "care"sv) && !MatchesWildcard("ca*rt"sv, "cat"sv) && MatchesWildcard("ca*t"sv, "cat"sv));
+
+    // Prefixes are enumerated from the sorted terms and the recent ones alike
+    std::mt19937 generator;
+    const auto words = GenerateDictionary(generator, 6'000, 5);
+    TermDictionary dictionary;
+    for (size_t i = 0; i < words.size(); ++i) {
+      dictionary.Add(words[i]);
+      if (i % 1'500 == 0 || i + 1 == words.size()) {
+        for (const std::string_view prefix : {"a"sv, "ab"sv, "zz"sv, "q"sv, "mxk"sv}) {
+          std::vector<TermId> found;
+          dictionary.ForEachTermWithPrefix(prefix, [&](const std::string_view &term, TermId term_id) {
+            assert(term == dictionary.GetTerm(term_id));
+            found.push_back(term_id);
+          });
+          std::vector<TermId> expected;
+          for (TermId term_id = 0; term_id <= i; ++term_id) {
+            if (dictionary.GetTerm(term_id).substr(0, prefix.size()) == prefix) {
+              expected.push_back(term_id);
+            }
+          }
+          std::sort(found.begin(), found.end());
+          assert(found == expected);
+        }
+      }
+    }
+    assert(dictionary.GetSortedTermByteCount() > 0);
+
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat and cart"sv, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "care for dog"sv, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "catalog"sv, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "dog"sv, DocumentStatus::ACTUAL, {4});
+    server.RemoveDocument(3);
+    const auto ids = [](std::vector<Document> documents) {
+      std::vector<int> result;
+      for (const Document &document : documents) {
+        result.push_back(document.id);
+      }
+      std::sort(result.begin(), result.end());
+      return result;
+    };
+    // catalog has no live documents, so it is not expanded
+    assert(ids(server.FindTopDocuments("ca*"sv)) == std::vector<int>({1, 2}));
+    assert(server.FindTopDocuments("ca*"sv)[0].relevance == server.FindTopDocuments("cat cart care"sv)[0].relevance);
+    assert(ids(server.FindTopDocuments("c*t"sv)) == std::vector<int>({1}));
+    assert(ids(server.FindTopDocuments("dog -car*"sv)) == std::vector<int>({4}));
+    assert(std::get<0>(server.MatchDocument("ca* dog"sv, 1)) == std::vector<std::string_view>({"cart"sv, "cat"sv}));
+    try {
+      server.FindTopDocuments("*at"sv);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+
+    // Only the terms in most documents are kept
+    SearchServer many("and"s);
+    std::string all_words;
+    for (int word = 0; word < 100; ++word) {
+      all_words += " w"s + std::to_string(word);
+      many.AddDocument(word, all_words, DocumentStatus::ACTUAL, {word});
+    }
+    std::string frequent_words;
+    for (int word = 0; word < static_cast<int>(MAX_WILDCARD_TERM_COUNT); ++word) {
+      frequent_words += " w"s + std::to_string(word);
+    }
+    const auto expanded = many.FindTopDocuments("w*"sv, DocumentStatus::ACTUAL, 100);
+    const auto explicit_terms = many.FindTopDocuments(frequent_words, DocumentStatus::ACTUAL, 100);
+    assert(expanded.size() == explicit_terms.size());
+    for (size_t i = 0; i < expanded.size(); ++i) {
+      assert(expanded[i].id == explicit_terms[i].id && expanded[i].relevance == explicit_terms[i].relevance);
+    }
+    const std::string path = "search_server_prefix_test.idx"s;
+    many.SaveIndex(path);
+    const SearchServer loaded = SearchServer::LoadIndex(path);
+    std::remove(path.c_str());
+    assert(loaded.FindTopDocuments("w9*"sv, DocumentStatus::ACTUAL, 100).size() == many.FindTopDocuments("w9*"sv, DocumentStatus::ACTUAL, 100).size());
+    std::cout << "Success" << endl;
+  }
+
+  {
+    std::mt19937 generator;
+    std::string random_bytes(5'000, ' ');
+    for (char &c : random_bytes) {
+      c = static_cast<char>(std::uniform_int_distribution<int>(0, 255)(generator));
+    }
+    const std::vector<std::string> blocks = {""s, "abc"s, std::string(10'000, 'a'), random_bytes,
+                                             "cat dog cat dog cat dog and a long tail of literals to end with"s};
+    for (const std::string &block : blocks) {
+      std::vector<uint8_t> compressed;
+      CompressBlock(block, compressed);
+      assert(DecompressBlock(compressed.data(), compressed.data() + compressed.size(), block.size()) == block);
+      assert(DecompressBlock(compressed.data(), compressed.data() + compressed.size(), block.size() / 2)
+                 == block.substr(0, block.size() / 2));
+    }
+    const uint8_t corrupt[] = {0x10, 'a', 0x05, 0x00};
+    try {
+      DecompressBlock(corrupt, corrupt + sizeof(corrupt), 100);
+      assert(false);
+    } catch (const std::runtime_error &) {
+    }
+
+    const auto dictionary = GenerateDictionary(generator, 500, 8);
+    const auto texts = GenerateTexts(generator, dictionary, 3'000, 40);
+    std::vector<DocumentInput> inputs;
+    for (int id = 0; id < 1'500; ++id) {
+      inputs.push_back({id + 1'500, texts[id + 1'500], DocumentStatus::ACTUAL, {id}});
+    }
+    SearchServer plain(dictionary[0], IndexOptions{false, TextStorage::PLAIN});
+    SearchServer compressed(dictionary[0], IndexOptions{false, TextStorage::COMPRESSED});
+    SearchServer without_texts(dictionary[0]);
+    for (SearchServer *server : {&plain, &compressed, &without_texts}) {
+      for (int id = 0; id < 1'500; ++id) {
+        server->AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+      }
+      server->AddDocuments(std::execution::par, inputs);
+      server->RemoveDocument(7);
+    }
+    for (int id = 0; id < 3'000; id += id == 6 ? 2 : 1) {
+      assert(plain.GetDocumentText(id) == texts[id] && compressed.GetDocumentText(id) == texts[id]);
+    }
+    assert(plain.GetWordFrequencies(42) == without_texts.GetWordFrequencies(42));
+    try {
+      compressed.GetDocumentText(7);
+      assert(false);
+    } catch (const std::out_of_range &) {
+    }
+    try {
+      without_texts.GetDocumentText(42);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+
+    const MemoryUsage plain_usage = plain.GetMemoryUsage();
+    const MemoryUsage compressed_usage = compressed.GetMemoryUsage();
+    assert(without_texts.GetMemoryUsage().texts == 0);
+    assert(compressed_usage.texts < plain_usage.texts && plain_usage.forward_index == compressed_usage.forward_index);
+    assert(plain_usage.GetTotal() == plain_usage.dictionary + plain_usage.postings + plain_usage.positions
+               + plain_usage.forward_index + plain_usage.texts + plain_usage.documents + plain_usage.statistics);
+
+    // Texts and the forward index survive saving, then grow past the mapped documents
+    const std::string path = "search_server_text_test.idx"s;
+    for (SearchServer *server : {&plain, &compressed, &without_texts}) {
+      server->SaveIndex(path);
+      SearchServer loaded = SearchServer::LoadIndex(path);
+      std::remove(path.c_str());
+      loaded.AddDocument(5'000, "freshly added text"sv, DocumentStatus::ACTUAL, {1});
+      assert(loaded.GetWordFrequencies(42) == server->GetWordFrequencies(42));
+      assert(loaded.GetWordFrequencies(5'000).size() == 3);
+      if (server != &without_texts) {
+        assert(loaded.GetDocumentText(42) == texts[42] && loaded.GetDocumentText(2'999) == texts[2'999]);
+        assert(loaded.GetDocumentText(5'000) == "freshly added text"s);
+        assert(loaded.GetMemoryUsage().texts > 0);
+      }
+    }
+    std::cout << "Success" << endl;
+  }
+
+  {
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 800, 8);
+    const auto texts = GenerateTexts(generator, dictionary, 5'000, 30);
+    std::vector<int> removed_ids;
+    for (int id = 0; id < 4'096; id += 2) {
+      removed_ids.push_back(id);
+    }
+    removed_ids.push_back(-1);
+    removed_ids.push_back(0);
+
+    SearchServer one_by_one(dictionary[0]);
+    SearchServer batch(dictionary[0]);
+    SearchServer parallel_batch(dictionary[0]);
+    SearchServer survivors(dictionary[0]);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+      for (SearchServer *server : {&one_by_one, &batch, &parallel_batch}) {
+        server->AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+      }
+      if (id >= 4'096 || id % 2 == 1) {
+        survivors.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+      }
+    }
+    for (SearchServer *server : {&one_by_one, &batch, &parallel_batch}) {
+      server->WaitForMerges();
+    }
+    for (const int id : removed_ids) {
+      one_by_one.RemoveDocument(id);
+    }
+    batch.RemoveDocuments(removed_ids);
+    parallel_batch.RemoveDocuments(std::execution::par, removed_ids);
+    parallel_batch.Compact();
+    one_by_one.WaitForMerges();
+
+    const auto sorted_results = [](const SearchServer &server, const std::string &query) {
+      std::vector<std::pair<int, double>> results;
+      for (const Document &document : server.FindTopDocuments(query, DocumentStatus::ACTUAL, 5'000)) {
+        results.emplace_back(document.id, document.relevance);
+      }
+      std::sort(results.begin(), results.end());
+      return results;
+    };
+    for (const std::string &query : GenerateTexts(generator, dictionary, 50, 4, 0.2)) {
+      const auto expected = sorted_results(survivors, query);
+      assert(sorted_results(one_by_one, query) == expected);
+      assert(sorted_results(batch, query) == expected);
+      assert(sorted_results(parallel_batch, query) == expected);
+    }
+    for (const SearchServer *server : {&one_by_one, &batch, &parallel_batch}) {
+      assert(server->GetDocumentCount() == survivors.GetDocumentCount());
+      assert(server->GetCorpusStatistics().GetWordCount() == survivors.GetCorpusStatistics().GetWordCount());
+    }
+
+    // Compaction leaves the postings of live documents only; the removed
+    // documents were in sealed segments, half of each, so the background
+    // rewrites did not happen
+    size_t live_posting_count = 0;
+    for (const int id : parallel_batch) {
+      live_posting_count += parallel_batch.GetWordFrequencies(id).size();
+    }
+    assert(parallel_batch.GetPostingCount() == live_posting_count);
+    assert(batch.GetPostingCount() > live_posting_count);
+    assert(parallel_batch.GetMemoryUsage().forward_index < batch.GetMemoryUsage().forward_index);
+
+    // A segment of mostly removed documents is rewritten in the background
+    std::vector<int> more_ids;
+    for (int id = 1; id < 1'024; id += 2) {
+      more_ids.push_back(id);
+    }
+    batch.RemoveDocuments(more_ids);
+    batch.WaitForMerges();
+    live_posting_count = 0;
+    for (const int id : batch) {
+      live_posting_count += batch.GetWordFrequencies(id).size();
+    }
+    assert(batch.GetPostingCount() == live_posting_count);
+
+    // Compaction empties the positions and texts of removed documents too
+    for (const TextStorage text_storage : {TextStorage::PLAIN, TextStorage::COMPRESSED}) {
+      SearchServer stored(dictionary[0], IndexOptions{true, text_storage});
+      for (int id = 0; id < 1'024; ++id) {
+        stored.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+      }
+      std::vector<int> removed_ids;
+      for (int id = 0; id < 1'024; ++id) {
+        if (id % 8 != 0) {
+          removed_ids.push_back(id);
+        }
+      }
+      stored.RemoveDocuments(removed_ids);
+      stored.WaitForMerges();
+      const MemoryUsage before = stored.GetMemoryUsage();
+      stored.Compact();
+      const MemoryUsage after = stored.GetMemoryUsage();
+      assert(after.positions < before.positions / 2 && after.texts < before.texts / 2);
+      assert(after.removed_documents > 0 && after.removed_documents == before.removed_documents);
+      for (int id = 0; id < 1'024; id += 8) {
+        assert(stored.GetDocumentText(id) == texts[id]);
+        if (stored.GetWordFrequencies(id).empty()) {
+          continue;  // Stop words only
+        }
+        const auto found = stored.FindTopDocuments("\""s + texts[id] + "\""s, DocumentStatus::ACTUAL, 1'024);
+        assert(std::any_of(found.begin(), found.end(), [id](const Document &document) {
+          return document.id == id;
+        }));
+      }
+    }
+
+    ConcurrentSearchServer concurrent(dictionary[0]);
+    for (int id = 0; id < 100; ++id) {
+      concurrent.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+    }
+    concurrent.RemoveDocuments({1, 2, 3, 1'000});
+    concurrent.Compact();
+    assert(concurrent.GetDocumentCount() == 97);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 2'000, 8);
+    std::vector<std::string> texts;
+    for (int id = 0; id < 3'000; ++id) {
+      texts.push_back(GenerateText(generator, dictionary, 20));
+    }
+    // Same word sets in another order and with other counts
+    texts[10] = texts[3] + " "s + texts[3];
+    texts[2'500] = texts[7];
+    std::string reversed_text;
+    for (const std::string &word : SplitIntoWords(texts[5])) {
+      reversed_text = word + " "s + reversed_text;
+    }
+    texts[2'999] = reversed_text;
+    // A long text with one word more
+    std::string long_text;
+    for (size_t i = 0; i < 300; ++i) {
+      long_text += dictionary[i] + " "s + dictionary[i] + " "s + dictionary[i] + " "s;
+    }
+    texts[20] = long_text;
+    texts[21] = long_text + dictionary[300];
+    const std::vector<int> exact_duplicate_ids = {10, 2'500, 2'999};
+    std::vector<DocumentInput> documents;
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+      documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {id}});
+    }
+
+    SearchServer kept(""s);
+    kept.AddDocuments(std::execution::par, documents);
+    assert(kept.GetDocumentFingerprint(10).term_set_hash == kept.GetDocumentFingerprint(3).term_set_hash);
+    assert(kept.GetDocumentFingerprint(21).term_set_hash != kept.GetDocumentFingerprint(20).term_set_hash);
+    assert(RemoveDuplicates(kept) == exact_duplicate_ids);
+    assert(kept.GetDocumentCount() == 2'997);
+    assert(RemoveDuplicates(kept).empty());
+    assert(RemoveDuplicates(kept, MAX_SIMHASH_DISTANCE) == std::vector<int>{21});
+
+    // Skipped duplicates leave the server as RemoveDuplicates would, however
+    // they are added; removing the original lets a duplicate in again
+    IndexOptions options;
+    options.duplicates = DuplicatePolicy::SKIP;
+    SearchServer skipping(""s, options);
+    skipping.AddDocuments(std::execution::par, documents);
+    SearchServer skipping_one_by_one(""s, options);
+    skipping_one_by_one.AddDocuments(documents);
+    std::set<int> expected_ids(kept.begin(), kept.end());
+    expected_ids.insert(21);
+    for (const SearchServer *server : {&skipping, &skipping_one_by_one}) {
+      assert(std::set<int>(server->begin(), server->end()) == expected_ids);
+      assert(server->FindTopDocuments(texts[3]).size() == kept.FindTopDocuments(texts[3]).size());
+    }
+    assert(skipping.GetMemoryUsage().duplicates > 0);
+    assert(kept.GetMemoryUsage().duplicates == 0);
+    skipping.RemoveDocument(3);
+    skipping.AddDocument(10, texts[10], DocumentStatus::ACTUAL, {});
+    assert(static_cast<size_t>(skipping.GetDocumentCount()) == expected_ids.size());
+
+    options.duplicates = DuplicatePolicy::REJECT;
+    options.max_simhash_distance = MAX_SIMHASH_DISTANCE;
+    SearchServer rejecting(""s, options);
+    try {
+      rejecting.AddDocuments(std::execution::par, documents);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    assert(rejecting.GetDocumentCount() == 10);
+    rejecting.AddDocument(20, texts[20], DocumentStatus::ACTUAL, {});
+    try {
+      rejecting.AddDocument(21, texts[21], DocumentStatus::ACTUAL, {});
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+
+    // The policy comes back with a loaded index
+    const std::string path = "search_server_duplicates_test.idx"s;
+    rejecting.SaveIndex(path);
+    {
+      SearchServer loaded = SearchServer::LoadIndex(path);
+      try {
+        loaded.AddDocument(100, texts[5], DocumentStatus::ACTUAL, {});
+        assert(false);
+      } catch (const std::invalid_argument &) {
+      }
+      loaded.AddDocument(100, texts[100], DocumentStatus::ACTUAL, {});
+      assert(loaded.GetDocumentCount() == 12);
+    }
+    std::remove(path.c_str());
+
+    options.max_simhash_distance = MAX_SIMHASH_DISTANCE + 1;
+    try {
+      SearchServer invalid(""s, options);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    std::cout << "Success" << endl;
+  }
+
+  {
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 500, 6);
+    const auto texts = GenerateTexts(generator, dictionary, 6'000, 25);
+    const auto queries = GenerateTexts(generator, dictionary, 40, 4, 0.2);
+    SearchServer search_server(dictionary[0]);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+      search_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT),
+                                {id % 21 - 10});
+    }
+    std::vector<int> removed_ids;
+    for (int id = 0; id < 6'000; id += 7) {
+      removed_ids.push_back(id);
+    }
+    search_server.RemoveDocuments(removed_ids);
+
+    // Filters give the results of the predicates they stand for, on every path
+    const auto same_results = [](const std::vector<Document> &lhs, const std::vector<Document> &rhs) {
+      return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document &lhs, const Document &rhs) {
+        return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+      });
+    };
+    const std::string path = "search_server_filter_test.idx"s;
+    search_server.SaveIndex(path);
+    const SearchServer loaded = SearchServer::LoadIndex(path);
+    const std::vector<const SearchServer *> servers = {&search_server, &loaded};
+    const std::vector<DocumentFilter> filters = {
+        DocumentFilter::ForStatus(DocumentStatus::ACTUAL),
+        DocumentFilter::ForStatus(DocumentStatus::BANNED).WithRating(-3, 4),
+        DocumentFilter{GetStatusBit(DocumentStatus::ACTUAL) | GetStatusBit(DocumentStatus::IRRELEVANT), 5, INT_MAX},
+        DocumentFilter().WithRating(INT_MIN, -8),
+    };
+    for (const DocumentFilter &filter : filters) {
+      const auto predicate = [filter](int document_id, DocumentStatus status, int rating) {
+        return filter(document_id, status, rating);
+      };
+      for (const std::string &query : queries) {
+        const auto expected = search_server.FindTopDocuments(query, predicate, 50);
+        for (const SearchServer *server : servers) {
+          assert(same_results(server->FindTopDocuments(query, filter, 50), expected));
+          assert(same_results(server->FindTopDocuments(std::execution::par, query, filter, 50), expected));
+          assert(same_results(server->FindTopDocumentsPruned(query, filter, 50), expected));
+        }
+        for (const Document &document : expected) {
+          assert(document.id % 7 != 0 && document.rating >= filter.min_rating && document.rating <= filter.max_rating);
+        }
+      }
+    }
+    std::remove(path.c_str());
+
+    // A status outside the enumerators is rejected rather than spilling into
+    // the bits of the neighbouring documents
+    SearchServer statuses(dictionary[0]);
+    statuses.AddDocument(0, texts[0], DocumentStatus::ACTUAL, {});
+    for (const int status : {-1, DOCUMENT_STATUS_COUNT, 0xff}) {
+      try {
+        statuses.AddDocument(1, texts[1], static_cast<DocumentStatus>(status), {});
+        assert(false);
+      } catch (const std::invalid_argument &) {
+      }
+      try {
+        statuses.AddDocuments(std::execution::par, {{1, texts[1], DocumentStatus::ACTUAL, {}},
+                                                    {2, texts[2], static_cast<DocumentStatus>(status), {}}});
+        assert(false);
+      } catch (const std::invalid_argument &) {
+      }
+      statuses.RemoveDocument(1);
+    }
+    statuses.AddDocument(2, texts[2], DocumentStatus::BANNED, {});
+    const auto banned = statuses.FindTopDocuments(texts[0] + " "s + texts[2], DocumentStatus::BANNED);
+    assert(banned.size() == 1 && banned[0].id == 2);
+    const auto actual = statuses.FindTopDocuments(texts[0] + " "s + texts[2], DocumentStatus::ACTUAL);
+    assert(actual.size() == 1 && actual[0].id == 0);
+    std::cout << "Success" << endl;
+  }
+
+  {
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 500, 6);
+    const auto texts = GenerateTexts(generator, dictionary, 5'000, 25);
+    const auto queries = GenerateTexts(generator, dictionary, 40, 4, 0.2);
+    std::vector<DocumentInput> documents;
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+      documents.push_back({id, texts[id], static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT), {id % 21 - 10}});
+    }
+    SearchServer search_server(dictionary[0]);
+    search_server.AddDocuments(documents);
+    ShardedSearchServer single_shard(dictionary[0], 1);
+    single_shard.AddDocuments(documents);
+    ShardedSearchServer three_shards(dictionary[0], 3);
+    for (const DocumentInput &document : documents) {
+      three_shards.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    ShardedSearchServer eight_shards(dictionary[0], 8);
+    eight_shards.AddDocuments(documents);
+    assert(eight_shards.GetDocumentCount() == 5'000);
+    for (size_t shard = 0; shard < eight_shards.GetShardCount(); ++shard) {
+      assert(eight_shards.GetShard(shard).GetDocumentCount() > 400);
+    }
+
+    // The IDF over all shards gives the results of a single server
+    const auto same_results = [](const std::vector<Document> &lhs, const std::vector<Document> &rhs) {
+      return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document &lhs, const Document &rhs) {
+        return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+      });
+    };
+    const std::vector<const ShardedSearchServer *> sharded_servers = {&single_shard, &three_shards, &eight_shards};
+    const auto check_results = [&]() {
+      const auto predicate = [](int document_id, DocumentStatus status, int rating) {
+        return document_id % 3 == 1 && rating > 0;
+      };
+      for (const std::string &query : queries) {
+        const auto expected = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 30);
+        const auto expected_banned = search_server.FindTopDocuments(query, DocumentStatus::BANNED);
+        const auto expected_predicate = search_server.FindTopDocuments(query, predicate, 20);
+        for (const ShardedSearchServer *server : sharded_servers) {
+          assert(same_results(server->FindTopDocuments(query, DocumentStatus::ACTUAL, 30), expected));
+          assert(same_results(server->FindTopDocuments(std::execution::par, query, DocumentStatus::ACTUAL, 30), expected));
+          assert(same_results(server->FindTopDocuments(query, DocumentStatus::BANNED), expected_banned));
+          assert(same_results(server->FindTopDocuments(std::execution::par, query, predicate, 20), expected_predicate));
+        }
+      }
+    };
+    check_results();
+
+    std::vector<int> removed_ids;
+    for (int id = 0; id < 5'000; id += 3) {
+      removed_ids.push_back(id);
+    }
+    search_server.RemoveDocuments(removed_ids);
+    three_shards.RemoveDocuments(removed_ids);
+    eight_shards.RemoveDocuments(removed_ids);
+    for (const int id : removed_ids) {
+      single_shard.RemoveDocument(id);
+    }
+    assert(eight_shards.GetDocumentCount() == search_server.GetDocumentCount());
+    check_results();
+
+    for (int id = 1; id < 5'000; id += 99) {
+      const std::string &query = queries[id % queries.size()];
+      assert(eight_shards.MatchDocument(query, id) == search_server.MatchDocument(query, id));
+      assert(eight_shards.GetWordFrequencies(id) == search_server.GetWordFrequencies(id));
+    }
+    try {
+      eight_shards.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {1});
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    try {
+      eight_shards.FindTopDocuments(std::execution::par, "cat --dog"s);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    // Errors of a shard's search are rethrown rather than leaving the parallel round
+    try {
+      eight_shards.FindTopDocuments(std::execution::par, queries[0], [](int document_id, DocumentStatus, int) -> bool {
+        throw std::runtime_error("Predicate failed"s);
+      });
+      assert(false);
+    } catch (const std::runtime_error &) {
+    }
+    // top_k far beyond the documents gives every match, on every shard count
+    const auto expected_all = search_server.FindTopDocuments(queries[0], DocumentStatus::ACTUAL, size_t{1} << 30);
+    assert(!expected_all.empty());
+    for (const ShardedSearchServer *server : sharded_servers) {
+      assert(same_results(server->FindTopDocuments(std::execution::par, queries[0], DocumentStatus::ACTUAL,
+                                                   size_t{1} << 30), expected_all));
+      assert(same_results(server->FindTopDocuments(queries[0], DocumentStatus::ACTUAL, size_t{1} << 30), expected_all));
+    }
+    try {
+      ShardedSearchServer no_shards(dictionary[0], 0);
+      assert(false);
+    } catch (const std::invalid_argument &) {
+    }
+    std::cout << "Success" << endl;
+  }
+
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+#include "posting_list.h"
+#include "top_documents.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory_resource>
+#include <numeric>
+#include <vector>
+
+struct ScoredTerm {
+  PostingList postings;
+  double term_weight;
+  // Bound on the score of any posting of the list
+  double upper_bound;
+};
+
+// Document-at-a-time MaxScore over document-ordered posting lists. Terms whose
+// upper bounds sum below the current top_k threshold become non-essential: a
+// document that only they contain can not reach the result and is skipped, and
+// their lists are only probed for candidates coming from the essential lists.
+// Relevance of every accepted document is summed in plus_terms order, exactly
+// as the exhaustive evaluation does. score_posting(posting, term_weight) is
+// the contribution of a posting. Working state lives in resource.
+template<typename ScorePosting, typename AcceptDocument, typename MakeDocument>
+void CollectTopDocumentsByMaxScore(const std::pmr::vector<ScoredTerm> &plus_terms,
+                                   const std::pmr::vector<PostingList> &minus_terms,
+                                   ScorePosting score_posting,
+                                   AcceptDocument accept_document,
+                                   MakeDocument make_document,
+                                   TopDocuments &top_documents,
+                                   std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+  // Upper bounds are rounded slightly up to absorb different summation orders
+  const double bound_slack = 1e-9;
+  const size_t term_count = plus_terms.size();
+
+  std::pmr::vector<size_t> order(term_count, resource);
+  std::iota(order.begin(), order.end(), 0);
+  std::pmr::vector<double> upper_bounds(term_count, resource);
+  for (size_t i = 0; i < term_count; ++i) {
+    upper_bounds[i] = plus_terms[i].upper_bound;
+  }
+  std::sort(order.begin(), order.end(), [&upper_bounds](size_t lhs, size_t rhs) {
+    return upper_bounds[lhs] < upper_bounds[rhs];
+  });
+  std::pmr::vector<double> bound_prefix(term_count + 1, 0.0, resource);
+  for (size_t k = 0; k < term_count; ++k) {
+    bound_prefix[k + 1] = bound_prefix[k] + upper_bounds[order[k]] + bound_slack;
+  }
+
+  std::pmr::vector<PostingCursor> cursors(resource);
+  cursors.reserve(term_count);
+  for (const size_t term : order) {
+    cursors.emplace_back(plus_terms[term].postings);
+  }
+  std::pmr::vector<PostingCursor> minus_cursors(resource);
+  minus_cursors.reserve(minus_terms.size());
+  for (const PostingList &postings : minus_terms) {
+    minus_cursors.emplace_back(postings);
+  }
+
+  std::pmr::vector<double> contributions(term_count, 0.0, resource);
+  size_t first_essential = 0;
+  while (true) {
+    double limit = -std::numeric_limits<double>::infinity();
+    if (top_documents.IsFull()) {
+      limit = top_documents.GetLeastRelevant().relevance - RELEVANCE_EPSILON;
+    }
+    while (first_essential < term_count && bound_prefix[first_essential + 1] <= limit) {
+      ++first_essential;
+    }
+    if (first_essential == term_count) {
+      break;
+    }
+
+    uint32_t document_index = std::numeric_limits<uint32_t>::max();
+    for (size_t k = first_essential; k < term_count; ++k) {
+      if (!cursors[k].IsEnd()) {
+        document_index = std::min(document_index, cursors[k]->document_index);
+      }
+    }
+    if (document_index == std::numeric_limits<uint32_t>::max()) {
+      break;
+    }
+
+    std::fill(contributions.begin(), contributions.end(), 0.0);
+    double score = 0.0;
+    for (size_t k = first_essential; k < term_count; ++k) {
+      if (!cursors[k].IsEnd() && cursors[k]->document_index == document_index) {
+        const size_t term = order[k];
+        contributions[term] = score_posting(*cursors[k], plus_terms[term].term_weight);
+        score += contributions[term] + bound_slack;
+        cursors[k].Next();
+      }
+    }
+    bool is_candidate = true;
+    for (size_t k = first_essential; k-- > 0;) {
+      if (score + bound_prefix[k + 1] <= limit) {
+        is_candidate = false;
+        break;
+      }
+      cursors[k].AdvanceTo(document_index);
+      if (!cursors[k].IsEnd() && cursors[k]->document_index == document_index) {
+        const size_t term = order[k];
+        contributions[term] = score_posting(*cursors[k], plus_terms[term].term_weight);
+        score += contributions[term] + bound_slack;
+      }
+    }
+    if (!is_candidate || !accept_document(document_index)) {
+      continue;
+    }
+    const bool has_minus_word = std::any_of(minus_cursors.begin(), minus_cursors.end(), [document_index](PostingCursor &cursor) {
+      cursor.AdvanceTo(document_index);
+      return !cursor.IsEnd() && cursor->document_index == document_index;
+    });
+    if (has_minus_word) {
+      continue;
+    }
+    double relevance = 0.0;
+    for (size_t term = 0; term < term_count; ++term) {
+      if (contributions[term] != 0.0) {
+        relevance += contributions[term];
+      }
+    }
+    top_documents.Add(make_document(document_index, relevance));
+  }
+}
@@ -0,0 +1,21 @@
+#include "memory_usage.h"
+
+size_t MemoryUsage::GetTotal() const {
+  return dictionary + postings + positions + forward_index + texts + documents + statistics + duplicates;
+}
+
+std::ostream &operator<<(std::ostream &out, const MemoryUsage &usage) {
+  using namespace std::literals;
+  out << "{ "s
+      << "dictionary = "s << usage.dictionary << ", "s
+      << "postings = "s << usage.postings << ", "s
+      << "positions = "s << usage.positions << ", "s
+      << "forward_index = "s << usage.forward_index << ", "s
+      << "texts = "s << usage.texts << ", "s
+      << "documents = "s << usage.documents << ", "s
+      << "statistics = "s << usage.statistics << ", "s
+      << "duplicates = "s << usage.duplicates << ", "s
+      << "total = "s << usage.GetTotal() << ", "s
+      << "removed_documents = "s << usage.removed_documents << " }"s;
+  return out;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+
+// Heap bytes of a node-based tree: the values plus about four pointers of
+// links and color per node
+template<typename Tree>
+size_t EstimateTreeByteCount(const Tree &tree) {
+  return tree.size() * (sizeof(typename Tree::value_type) + 4 * sizeof(void *));
+}
+
+// Heap bytes of a node-based hash table: the buckets, and the values plus a
+// link and a cached hash per node
+template<typename HashTable>
+size_t EstimateHashTableByteCount(const HashTable &table) {
+  return table.bucket_count() * sizeof(void *)
+      + table.size() * (sizeof(typename HashTable::value_type) + 2 * sizeof(void *));
+}
+
+// Bytes held by every structure of a search server, index file sections read
+// in place included
+struct MemoryUsage {
+  size_t dictionary = 0;
+  size_t postings = 0;
+  size_t positions = 0;
+  size_t forward_index = 0;
+  size_t texts = 0;
+  // Per-document attributes and the id lookups
+  size_t documents = 0;
+  size_t statistics = 0;
+  // The fingerprint index, unless duplicates are kept
+  size_t duplicates = 0;
+  // Part of the above, not counted again in the total: the slots removed
+  // documents keep until the index is saved and loaded, namely attributes,
+  // status bits and offsets into the forward index, positions and texts
+  size_t removed_documents = 0;
+
+  size_t GetTotal() const;
+};
+
+std::ostream &operator<<(std::ostream &out, const MemoryUsage &usage);
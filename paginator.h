@@ -10,7 +10,7 @@ class IteratorRange {
   IteratorRange(Iterator begin, Iterator end)
       : first_(begin)
       , last_(end)
-      , size_(distance(first_, last_)) {
+      , size_(std::distance(first_, last_)) {
   }
 
   Iterator begin() const {
@@ -0,0 +1,128 @@
+#include "positional_index.h"
+#include "varint.h"
+
+#include <algorithm>
+
+PositionalIndex::PositionalIndex(const uint64_t *offsets,
+                                 const uint8_t *bytes,
+                                 uint32_t document_count,
+                                 std::shared_ptr<const void> storage)
+    : mapped_offsets_(offsets)
+    , mapped_bytes_(bytes)
+    , mapped_document_count_(document_count)
+    , storage_(std::move(storage)) {
+}
+
+std::vector<uint8_t> PositionalIndex::EncodeDocument(std::vector<TermPosition> &occurrences) {
+  std::sort(occurrences.begin(), occurrences.end(), [](const TermPosition &lhs, const TermPosition &rhs) {
+    return lhs.term_id < rhs.term_id || (lhs.term_id == rhs.term_id && lhs.position < rhs.position);
+  });
+  std::vector<uint8_t> entry;
+  TermId previous_term_id = 0;
+  for (auto it = occurrences.begin(); it != occurrences.end();) {
+    const auto term_end = std::find_if(it, occurrences.end(), [term_id = it->term_id](const TermPosition &occurrence) {
+      return occurrence.term_id != term_id;
+    });
+    AppendVarint(it->term_id - previous_term_id, entry);
+    AppendVarint(term_end - it, entry);
+    uint32_t previous_position = 0;
+    for (; it != term_end; ++it) {
+      AppendVarint(it->position - previous_position, entry);
+      previous_position = it->position;
+    }
+    previous_term_id = (it - 1)->term_id;
+  }
+  return entry;
+}
+
+void PositionalIndex::AddDocument(const std::vector<uint8_t> &entry) {
+  bytes_.insert(bytes_.end(), entry.begin(), entry.end());
+  offsets_.push_back(bytes_.size());
+}
+
+uint32_t PositionalIndex::GetDocumentCount() const {
+  return mapped_document_count_ + offsets_.size() - 1;
+}
+
+IteratorRange<const uint8_t *> PositionalIndex::GetDocumentEntry(uint32_t document_index) const {
+  if (document_index < mapped_document_count_) {
+    return {mapped_bytes_ + mapped_offsets_[document_index], mapped_bytes_ + mapped_offsets_[document_index + 1]};
+  }
+  const uint32_t offset = document_index - mapped_document_count_;
+  return {bytes_.data() + offsets_[offset], bytes_.data() + offsets_[offset + 1]};
+}
+
+bool PositionalIndex::ContainsPhrase(uint32_t document_index,
+                                     const PhraseTerm *first,
+                                     const PhraseTerm *last,
+                                     std::pmr::memory_resource *resource) const {
+  // Starts of the phrase allowed by every term, concatenated term by term
+  const auto entry = GetDocumentEntry(document_index);
+  std::pmr::vector<uint32_t> starts(resource);
+  std::pmr::vector<size_t> ends(resource);
+  for (const PhraseTerm *term = first; term != last; ++term) {
+    if (!FindPhraseStarts(entry, *term, starts)) {
+      return false;
+    }
+    ends.push_back(starts.size());
+  }
+
+  // Leapfrog over the sorted lists until all of them agree on a start
+  const size_t term_count = ends.size();
+  std::pmr::vector<size_t> cursors(resource);
+  cursors.push_back(0);
+  cursors.insert(cursors.end(), ends.begin(), ends.end() - 1);
+  uint32_t candidate = 0;
+  size_t agreed_count = 0;
+  for (size_t term = 0;; term = (term + 1) % term_count) {
+    size_t &cursor = cursors[term];
+    while (cursor < ends[term] && starts[cursor] < candidate) {
+      ++cursor;
+    }
+    if (cursor == ends[term]) {
+      return false;
+    }
+    if (starts[cursor] != candidate) {
+      candidate = starts[cursor];
+      agreed_count = 0;
+    }
+    if (++agreed_count == term_count) {
+      return true;
+    }
+  }
+}
+
+size_t PositionalIndex::GetByteCount() const {
+  size_t byte_count = bytes_.size() + offsets_.size() * sizeof(uint64_t);
+  if (mapped_document_count_ > 0) {
+    byte_count += mapped_offsets_[mapped_document_count_] + (mapped_document_count_ + 1) * sizeof(uint64_t);
+  }
+  return byte_count;
+}
+
+bool PositionalIndex::FindPhraseStarts(IteratorRange<const uint8_t *> entry,
+                                       const PhraseTerm &term,
+                                       std::pmr::vector<uint32_t> &starts) {
+  const uint8_t *data = entry.begin();
+  TermId term_id = 0;
+  while (data != entry.end()) {
+    term_id += ReadVarint(data);
+    const uint32_t position_count = ReadVarint(data);
+    if (term_id > term.term_id) {
+      return false;
+    }
+    if (term_id < term.term_id) {
+      SkipVarints(data, position_count);
+      continue;
+    }
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < position_count; ++i) {
+      position += ReadVarint(data);
+      if (position >= term.offset) {
+        starts.push_back(position - term.offset);
+      }
+    }
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "term_dictionary.h"
+#include "paginator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Place of a word among all words of its document, stop words included
+struct TermPosition {
+  TermId term_id;
+  uint32_t position;
+};
+
+// Word of a quoted phrase, offset words after the start of the phrase
+struct PhraseTerm {
+  TermId term_id;
+  uint32_t offset;
+};
+
+// Word positions of every document, for phrase queries. The entry of a
+// document lists its terms in ascending order, each as the gap from the
+// previous term id, the number of its positions and the gaps between them,
+// all as varints. Documents are numbered as in the postings; the entries of
+// the first documents may be read in place from an index file.
+class PositionalIndex {
+ public:
+  PositionalIndex() = default;
+  // Documents [0, document_count) read in place: the entry of document i is
+  // bytes[offsets[i]] .. bytes[offsets[i + 1]]; storage keeps them alive
+  PositionalIndex(const uint64_t *offsets,
+                  const uint8_t *bytes,
+                  uint32_t document_count,
+                  std::shared_ptr<const void> storage);
+
+  // Sorts the occurrences of a document and compresses them into its entry
+  static std::vector<uint8_t> EncodeDocument(std::vector<TermPosition> &occurrences);
+  // Documents come in index order without gaps
+  void AddDocument(const std::vector<uint8_t> &entry);
+
+  uint32_t GetDocumentCount() const;
+  IteratorRange<const uint8_t *> GetDocumentEntry(uint32_t document_index) const;
+  // Whether the terms occur in the document at their offsets from one start.
+  // Working state lives in resource.
+  bool ContainsPhrase(uint32_t document_index,
+                      const PhraseTerm *first,
+                      const PhraseTerm *last,
+                      std::pmr::memory_resource *resource) const;
+  // Rewrites the entries added to the index with those of the documents
+  // is_removed(document_index) accepts left empty. Entries read in place stay
+  // until the index is saved again.
+  template<typename IsRemoved>
+  void DropEntries(IsRemoved is_removed) {
+    std::vector<uint64_t> offsets = {0};
+    offsets.reserve(offsets_.size());
+    std::vector<uint8_t> bytes;
+    for (uint32_t offset = 0; offset + 1 < offsets_.size(); ++offset) {
+      if (!is_removed(mapped_document_count_ + offset)) {
+        bytes.insert(bytes.end(), bytes_.begin() + offsets_[offset], bytes_.begin() + offsets_[offset + 1]);
+      }
+      offsets.push_back(bytes.size());
+    }
+    offsets_ = std::move(offsets);
+    bytes_ = std::move(bytes);
+  }
+  // Bytes of the entries and their offsets
+  size_t GetByteCount() const;
+
+ private:
+  const uint64_t *mapped_offsets_ = nullptr;
+  const uint8_t *mapped_bytes_ = nullptr;
+  uint32_t mapped_document_count_ = 0;
+  std::shared_ptr<const void> storage_;
+  // Documents added after the mapped ones
+  std::vector<uint64_t> offsets_{0};
+  std::vector<uint8_t> bytes_;
+
+  // Appends position - offset of every position of the term not less than
+  // offset; false if the document has no such term
+  static bool FindPhraseStarts(IteratorRange<const uint8_t *> entry,
+                               const PhraseTerm &term,
+                               std::pmr::vector<uint32_t> &starts);
+};
@@ -0,0 +1,163 @@
+#include "posting_list.h"
+
+void EncodePostings(const Posting *first, const Posting *last,
+                    std::vector<PostingBlock> &blocks, std::vector<uint32_t> &words) {
+  uint32_t gaps[POSTING_BLOCK_SIZE];
+  uint32_t counts[POSTING_BLOCK_SIZE];
+  while (first != last) {
+    const size_t size = std::min<size_t>(last - first, POSTING_BLOCK_SIZE);
+    uint32_t previous_index = first->document_index;
+    for (size_t i = 0; i < size; ++i) {
+      gaps[i] = first[i].document_index - previous_index;
+      counts[i] = first[i].term_count - 1;
+      previous_index = first[i].document_index;
+    }
+    PostingBlock block{};
+    block.word_offset = words.size();
+    block.first_document_index = first->document_index;
+    block.last_document_index = previous_index;
+    block.size = size;
+    block.gap_bits = GetBitWidth(gaps, size);
+    block.count_bits = GetBitWidth(counts, size);
+    const size_t gap_word_count = GetPackedWordCount(size, block.gap_bits);
+    words.resize(words.size() + gap_word_count + GetPackedWordCount(size, block.count_bits), 0);
+    PackValues(gaps, size, block.gap_bits, words.data() + block.word_offset);
+    PackValues(counts, size, block.count_bits, words.data() + block.word_offset + gap_word_count);
+    blocks.push_back(block);
+    first += size;
+  }
+}
+
+PostingList::PostingList(const Posting *first, const Posting *last, double max_term_freq)
+    : first_(first)
+    , last_(last)
+    , max_term_freq_(max_term_freq) {
+}
+
+PostingList::PostingList(const PostingBlock *first_block,
+                         const PostingBlock *last_block,
+                         const uint32_t *words,
+                         const double *inv_word_counts,
+                         uint32_t first_document_index,
+                         double max_term_freq)
+    : first_block_(first_block)
+    , last_block_(last_block)
+    , words_(words)
+    , inv_word_counts_(inv_word_counts)
+    , first_document_index_(first_document_index)
+    , max_term_freq_(max_term_freq) {
+}
+
+bool PostingList::Contains(uint32_t document_index) const {
+  PostingCursor cursor(*this, document_index);
+  return !cursor.IsEnd() && cursor->document_index == document_index;
+}
+
+size_t PostingList::size() const {
+  size_t size = last_ - first_;
+  for (const PostingBlock *block = first_block_; block != last_block_; ++block) {
+    size += block->size;
+  }
+  return size;
+}
+
+bool PostingList::empty() const {
+  return first_ == last_ && first_block_ == last_block_;
+}
+
+double PostingList::GetMaxTermFreq() const {
+  return max_term_freq_;
+}
+
+size_t PostingList::GetByteCount() const {
+  size_t byte_count = (last_ - first_) * sizeof(Posting);
+  for (const PostingBlock *block = first_block_; block != last_block_; ++block) {
+    byte_count += sizeof(PostingBlock) + (GetPackedWordCount(block->size, block->gap_bits)
+        + GetPackedWordCount(block->size, block->count_bits)) * sizeof(uint32_t);
+  }
+  return byte_count;
+}
+
+PostingCursor::PostingCursor(const PostingList &postings, uint32_t document_index)
+    : list_(postings)
+    , next_block_(postings.first_block_)
+    , postings_(postings.first_)
+    , size_(postings.last_ - postings.first_) {
+  if (size_ == 0) {
+    LoadBlock(FindBlock(document_index));
+  }
+  AdvanceTo(document_index);
+}
+
+PostingCursor::PostingCursor(const PostingCursor &other)
+    : list_(other.list_)
+    , next_block_(other.next_block_)
+    , postings_(other.postings_)
+    , position_(other.position_)
+    , size_(other.size_) {
+  if (other.postings_ == other.buffer_) {
+    std::copy(other.buffer_, other.buffer_ + size_, buffer_);
+    postings_ = buffer_;
+  }
+}
+
+void PostingCursor::AdvanceTo(uint32_t document_index) {
+  if (IsEnd() || postings_[position_].document_index >= document_index) {
+    return;
+  }
+  if (postings_[size_ - 1].document_index < document_index) {
+    position_ = size_;
+    LoadBlock(FindBlock(document_index));
+    if (IsEnd()) {
+      return;
+    }
+  }
+  // Gallops first, targets are usually close to the current position
+  const Posting *end = postings_ + size_;
+  size_t step = 1;
+  const Posting *bound = postings_ + position_;
+  while (end - bound > static_cast<std::ptrdiff_t>(step) && (bound + step)->document_index < document_index) {
+    bound += step;
+    step *= 2;
+  }
+  const Posting *last = end - bound > static_cast<std::ptrdiff_t>(step) ? bound + step + 1 : end;
+  position_ = std::lower_bound(bound, last, document_index, [](const Posting &posting, uint32_t index) {
+    return posting.document_index < index;
+  }) - postings_;
+}
+
+const PostingBlock *PostingCursor::FindBlock(uint32_t document_index) const {
+  return std::lower_bound(next_block_, list_.last_block_, document_index, [](const PostingBlock &block, uint32_t index) {
+    return block.last_document_index < index;
+  });
+}
+
+void PostingCursor::LoadBlock(const PostingBlock *block) {
+  if (block == list_.last_block_) {
+    return;
+  }
+  uint32_t gaps[POSTING_BLOCK_SIZE];
+  const uint32_t *words = list_.words_ + block->word_offset;
+  UnpackValues(words, block->size, block->gap_bits, gaps);
+  const uint32_t first_document_index = list_.first_document_index_;
+  uint32_t document_index = block->first_document_index;
+  if (block->count_bits == 0) {
+    // Every term occurs once per document, the common case
+    for (uint32_t i = 0; i < block->size; ++i) {
+      document_index += gaps[i];
+      buffer_[i] = {document_index, 1, list_.inv_word_counts_[document_index - first_document_index]};
+    }
+  } else {
+    uint32_t counts[POSTING_BLOCK_SIZE];
+    UnpackValues(words + GetPackedWordCount(block->size, block->gap_bits), block->size, block->count_bits, counts);
+    for (uint32_t i = 0; i < block->size; ++i) {
+      document_index += gaps[i];
+      const double inv_word_count = list_.inv_word_counts_[document_index - first_document_index];
+      buffer_[i] = {document_index, counts[i] + 1, ComputeTermFreq(counts[i] + 1, inv_word_count)};
+    }
+  }
+  postings_ = buffer_;
+  position_ = 0;
+  size_ = block->size;
+  next_block_ = block + 1;
+}
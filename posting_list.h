@@ -0,0 +1,126 @@
+#pragma once
+#include "bit_packing.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Documents are numbered densely in the order they were added, so postings
+// of every term stay sorted simply by being appended. term_freq is the
+// document's inv_word_count added up term_count times.
+struct Posting {
+  uint32_t document_index;
+  uint32_t term_count;
+  double term_freq;
+};
+
+const size_t POSTING_BLOCK_SIZE = BIT_PACKING_BLOCK_SIZE;
+
+// Up to POSTING_BLOCK_SIZE compressed postings at words[word_offset]: the gaps
+// between document indexes (the first one is 0), then the term counts minus
+// one, each bit-packed with the smallest width that fits
+struct PostingBlock {
+  uint64_t word_offset;
+  uint32_t first_document_index;
+  uint32_t last_document_index;
+  uint32_t size;
+  uint8_t gap_bits;
+  uint8_t count_bits;
+  uint16_t reserved;
+};
+
+// Bit-identical to the term_freq AddDocument accumulates
+inline double ComputeTermFreq(uint32_t term_count, double inv_word_count) {
+  double term_freq = 0.0;
+  for (uint32_t i = 0; i < term_count; ++i) {
+    term_freq += inv_word_count;
+  }
+  return term_freq;
+}
+
+// Appends the postings, sorted by document index, as compressed blocks
+void EncodePostings(const Posting *first, const Posting *last,
+                    std::vector<PostingBlock> &blocks, std::vector<uint32_t> &words);
+
+// Postings of one term in one segment. The list is a view: the postings are
+// owned by the segment or mapped from an index file. Sealed segments keep them
+// compressed, with the inv_word_count of every document of the segment to
+// restore term_freq; the active segment keeps them plain.
+class PostingList {
+ public:
+  PostingList() = default;
+  PostingList(const Posting *first, const Posting *last, double max_term_freq);
+  // inv_word_counts[i] belongs to document first_document_index + i
+  PostingList(const PostingBlock *first_block,
+              const PostingBlock *last_block,
+              const uint32_t *words,
+              const double *inv_word_counts,
+              uint32_t first_document_index,
+              double max_term_freq);
+
+  bool Contains(uint32_t document_index) const;
+  size_t size() const;
+  bool empty() const;
+  // Upper bound of term_freq over the postings
+  double GetMaxTermFreq() const;
+  // Bytes the postings take in their storage
+  size_t GetByteCount() const;
+
+ private:
+  friend class PostingCursor;
+
+  const Posting *first_ = nullptr;
+  const Posting *last_ = nullptr;
+  const PostingBlock *first_block_ = nullptr;
+  const PostingBlock *last_block_ = nullptr;
+  const uint32_t *words_ = nullptr;
+  const double *inv_word_counts_ = nullptr;
+  uint32_t first_document_index_ = 0;
+  double max_term_freq_ = 0.0;
+};
+
+// Forward-only walk over a posting list in document order. Compressed lists
+// are decoded one block at a time into the cursor; AdvanceTo skips whole
+// blocks by their last document index without decoding them.
+class PostingCursor {
+ public:
+  // Starts at the first posting with document_index not less than the given one
+  explicit PostingCursor(const PostingList &postings, uint32_t document_index = 0);
+  PostingCursor(const PostingCursor &other);
+  PostingCursor &operator=(const PostingCursor &) = delete;
+
+  bool IsEnd() const {
+    return position_ == size_;
+  }
+
+  const Posting &operator*() const {
+    return postings_[position_];
+  }
+
+  const Posting *operator->() const {
+    return postings_ + position_;
+  }
+
+  void Next() {
+    if (++position_ == size_) {
+      LoadBlock(next_block_);
+    }
+  }
+
+  // Moves to the first posting with document_index not less than the given one
+  void AdvanceTo(uint32_t document_index);
+
+ private:
+  PostingList list_;
+  const PostingBlock *next_block_ = nullptr;
+  const Posting *postings_ = nullptr;
+  uint32_t position_ = 0;
+  uint32_t size_ = 0;
+  Posting buffer_[POSTING_BLOCK_SIZE];
+
+  // First block from next_block_ on that may hold the document
+  const PostingBlock *FindBlock(uint32_t document_index) const;
+  // Leaves the cursor at its end for block == list_.last_block_
+  void LoadBlock(const PostingBlock *block);
+};
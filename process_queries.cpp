@@ -3,18 +3,37 @@
 #include <execution>
 #include <algorithm>
 
+QueryResultArena ProcessQueriesBatch(
+    const SearchServer &search_server,
+    const std::vector<std::string> &queries) {
+
+  QueryResultArena results;
+  search_server.FindTopDocumentsBatch(queries, results);
+  return results;
+}
+
+FlatQueryResults ProcessQueriesFlat(
+    const SearchServer &search_server,
+    const std::vector<std::string> &queries) {
+
+  FlatQueryResults results;
+  results.offsets.reserve(queries.size() + 1);
+  ProcessQueriesStream(search_server, queries, [&results](size_t, const auto &documents) {
+    results.Append(documents);
+  });
+  return results;
+}
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer &search_server,
     const std::vector<std::string> &queries) {
 
+  const QueryResultArena batch_results = ProcessQueriesBatch(search_server, queries);
   std::vector<std::vector<Document>> results(queries.size());
-  std::transform(std::execution::par, queries.begin(),
-                 queries.end(),
-                 results.begin(),
-                 [&search_server](const auto &query) {
-                   return search_server.FindTopDocuments(query);
-                 });
-    
+  for (size_t i = 0; i < queries.size(); ++i) {
+    results[i].assign(batch_results[i].begin(), batch_results[i].end());
+  }
+
   return results;
 
 }
@@ -23,11 +42,10 @@ std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
 
-  const std::vector<std::vector<Document>> docs_vector = ProcessQueries(search_server, queries);
   std::vector<Document>results;
-  for (const auto &docs: docs_vector){
-    results.insert(results.end(), docs.begin(), docs.end());
-  }
+  ProcessQueriesStream(search_server, queries, [&results](size_t, const auto &documents) {
+    results.insert(results.end(), documents.begin(), documents.end());
+  });
 
   return results;
 }
\ No newline at end of file
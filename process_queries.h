@@ -1,9 +1,58 @@
 #pragma once
 #include "search_server.h"
 #include "document.h"
+#include "query_result_arena.h"
 
+#include <algorithm>
+#include <future>
 #include <vector>
 
+const size_t QUERY_STREAM_WINDOW = 4096;
+
+QueryResultArena ProcessQueriesBatch(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Runs the queries window by window and hands the results of every query to
+// consumer(query_index, documents) in query order. The next window is searched
+// while the consumer handles the current one, so at most two windows of
+// results are buffered at a time.
+template<typename QueryConsumer>
+void ProcessQueriesStream(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    QueryConsumer consumer,
+    size_t window_size = QUERY_STREAM_WINDOW) {
+
+  const auto search_window = [&search_server, &queries, window_size](size_t first, QueryResultArena &results) {
+    const size_t last = std::min(first + window_size, queries.size());
+    search_server.FindTopDocumentsBatch(queries.begin() + first, queries.begin() + last, results);
+  };
+
+  QueryResultArena current_results;
+  QueryResultArena next_results;
+  if (!queries.empty()) {
+    search_window(0, current_results);
+  }
+  for (size_t first = 0; first < queries.size(); first += window_size) {
+    std::future<void> next_window;
+    if (first + window_size < queries.size()) {
+      next_window = std::async(std::launch::async, search_window, first + window_size, std::ref(next_results));
+    }
+    for (size_t i = 0; i < current_results.size(); ++i) {
+      consumer(first + i, current_results[i]);
+    }
+    if (next_window.valid()) {
+      next_window.get();
+    }
+    std::swap(current_results, next_results);
+  }
+}
+
+FlatQueryResults ProcessQueriesFlat(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
@@ -0,0 +1,53 @@
+#include "query_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+QueryArena &QueryArena::ForCurrentThread() {
+  static thread_local QueryArena arena;
+  return arena;
+}
+
+QueryArena::Scope::Scope(QueryArena &arena)
+    : arena_(arena)
+    , chunk_(arena.chunk_)
+    , offset_(arena.offset_) {
+}
+
+QueryArena::Scope::~Scope() {
+  arena_.chunk_ = chunk_;
+  arena_.offset_ = offset_;
+}
+
+size_t QueryArena::GetCapacity() const {
+  size_t capacity = 0;
+  for (const Chunk &chunk : chunks_) {
+    capacity += chunk.size;
+  }
+  return capacity;
+}
+
+void *QueryArena::do_allocate(size_t bytes, size_t alignment) {
+  while (true) {
+    if (chunk_ == chunks_.size()) {
+      const size_t size = std::max(chunks_.empty() ? FIRST_CHUNK_SIZE : chunks_.back().size * 2, bytes + alignment);
+      chunks_.push_back({std::make_unique<std::byte[]>(size), size});
+    }
+    const Chunk &chunk = chunks_[chunk_];
+    const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data.get());
+    const size_t begin = ((base + offset_ + alignment - 1) & ~uintptr_t{alignment - 1}) - base;
+    if (begin + bytes <= chunk.size) {
+      offset_ = begin + bytes;
+      return chunk.data.get() + begin;
+    }
+    ++chunk_;
+    offset_ = 0;
+  }
+}
+
+void QueryArena::do_deallocate(void *p, size_t bytes, size_t alignment) {
+}
+
+bool QueryArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+  return this == &other;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Memory for the temporary state of queries: a bump allocator over chunks that
+// are kept for good, so once a thread has seen its largest query it stops
+// touching the heap. Deallocation is a no-op; a Scope hands back everything
+// allocated while it was alive. Scopes nest, which keeps a thread safe when it
+// runs another query while waiting inside a parallel algorithm.
+class QueryArena : public std::pmr::memory_resource {
+ public:
+  // Every thread owns one arena, reused from query to query
+  static QueryArena &ForCurrentThread();
+
+  class Scope {
+   public:
+    explicit Scope(QueryArena &arena);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    QueryArena &arena_;
+    size_t chunk_;
+    size_t offset_;
+  };
+
+  // Bytes held in chunks
+  size_t GetCapacity() const;
+
+ private:
+  struct Chunk {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  static constexpr size_t FIRST_CHUNK_SIZE = 64 * 1024;
+
+  std::vector<Chunk> chunks_;
+  // Allocation goes on in chunks_[chunk_] from offset_
+  size_t chunk_ = 0;
+  size_t offset_ = 0;
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
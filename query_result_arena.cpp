@@ -0,0 +1,45 @@
+#include "query_result_arena.h"
+
+#include <algorithm>
+
+QueryResultArena::QueryResultArena(size_t query_count, size_t top_k) {
+  Reset(query_count, top_k);
+}
+
+void QueryResultArena::Reset(size_t query_count, size_t top_k) {
+  top_k_ = top_k;
+  query_count_ = query_count;
+  if (query_documents_.size() < query_count) {
+    query_documents_.resize(query_count);
+  }
+  for (size_t query_index = 0; query_index < query_count; ++query_index) {
+    query_documents_[query_index].clear();
+  }
+}
+
+void QueryResultArena::Assign(size_t query_index, const std::vector<Document> &documents) {
+  const size_t count = std::min(documents.size(), top_k_);
+  query_documents_[query_index].assign(documents.begin(), documents.begin() + count);
+}
+
+size_t QueryResultArena::size() const {
+  return query_count_;
+}
+
+IteratorRange<std::vector<Document>::const_iterator> QueryResultArena::operator[](size_t query_index) const {
+  const auto &documents = query_documents_[query_index];
+  return {documents.begin(), documents.end()};
+}
+
+void FlatQueryResults::Append(IteratorRange<std::vector<Document>::const_iterator> query_documents) {
+  documents.insert(documents.end(), query_documents.begin(), query_documents.end());
+  offsets.push_back(documents.size());
+}
+
+size_t FlatQueryResults::size() const {
+  return offsets.size() - 1;
+}
+
+IteratorRange<std::vector<Document>::const_iterator> FlatQueryResults::operator[](size_t query_index) const {
+  return {documents.begin() + offsets[query_index], documents.begin() + offsets[query_index + 1]};
+}
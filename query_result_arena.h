@@ -0,0 +1,38 @@
+#pragma once
+#include "document.h"
+#include "paginator.h"
+
+#include <cstddef>
+#include <vector>
+
+// Results of a batch of queries, at most top_k per query, each query in a
+// buffer of its own that is reused by the next batch
+class QueryResultArena {
+ public:
+  QueryResultArena() = default;
+  QueryResultArena(size_t query_count, size_t top_k);
+
+  // Keeps the buffers of the previous batch for the first query_count queries
+  void Reset(size_t query_count, size_t top_k);
+  // Different queries may be assigned from different threads
+  void Assign(size_t query_index, const std::vector<Document> &documents);
+
+  size_t size() const;
+  IteratorRange<std::vector<Document>::const_iterator> operator[](size_t query_index) const;
+
+ private:
+  size_t top_k_ = 0;
+  size_t query_count_ = 0;
+  std::vector<std::vector<Document>> query_documents_;
+};
+
+// Results of consecutive queries packed back to back; the documents of
+// query i are documents[offsets[i]] .. documents[offsets[i + 1]]
+struct FlatQueryResults {
+  std::vector<Document> documents;
+  std::vector<size_t> offsets = {0};
+
+  void Append(IteratorRange<std::vector<Document>::const_iterator> query_documents);
+  size_t size() const;
+  IteratorRange<std::vector<Document>::const_iterator> operator[](size_t query_index) const;
+};
@@ -0,0 +1,114 @@
+#include "query_result_cache.h"
+
+#include <stdexcept>
+
+bool operator==(const QueryCacheKey &lhs, const QueryCacheKey &rhs) {
+  return lhs.filter_tag == rhs.filter_tag && lhs.top_k == rhs.top_k
+      && lhs.plus_terms == rhs.plus_terms && lhs.minus_terms == rhs.minus_terms && lhs.phrases == rhs.phrases;
+}
+
+size_t QueryCacheKeyHash::operator()(const QueryCacheKey &key) const {
+  uint64_t hash = MixHashBits(key.filter_tag * 31 + key.top_k);
+  for (const TermId term_id : key.plus_terms) {
+    hash = MixHashBits(hash ^ term_id);
+  }
+  // Separates the two sets, so moving a term between them changes the hash
+  hash = MixHashBits(hash + 0x9e3779b97f4a7c15ULL);
+  for (const TermId term_id : key.minus_terms) {
+    hash = MixHashBits(hash ^ term_id);
+  }
+  for (const uint32_t value : key.phrases) {
+    hash = MixHashBits(hash ^ value);
+  }
+  return hash;
+}
+
+double QueryCacheStats::GetHitRate() const {
+  const uint64_t lookup_count = hit_count + miss_count;
+  return lookup_count == 0 ? 0.0 : hit_count * 1.0 / lookup_count;
+}
+
+QueryResultCache::QueryResultCache(size_t capacity, size_t shard_count)
+    : shards_(std::make_unique<Shard[]>(shard_count))
+    , shard_count_(shard_count)
+    , shard_capacity_(shard_count == 0 ? 0 : (capacity + shard_count - 1) / shard_count) {
+  using namespace std::literals;
+  if (shard_count == 0 || capacity == 0) {
+    throw std::invalid_argument("QueryResultCache needs a capacity and at least one shard"s);
+  }
+}
+
+bool QueryResultCache::Find(const QueryCacheKey &key, uint64_t generation, std::vector<Document> &documents) {
+  Shard &shard = GetShard(key);
+  std::lock_guard lock(shard.mx);
+  const auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    ++shard.stats.miss_count;
+    return false;
+  }
+  if (it->second.generation != generation) {
+    ++shard.stats.miss_count;
+    ++shard.stats.stale_count;
+    shard.recency.erase(it->second.position);
+    shard.entries.erase(it);
+    return false;
+  }
+  ++shard.stats.hit_count;
+  shard.recency.splice(shard.recency.begin(), shard.recency, it->second.position);
+  documents = it->second.documents;
+  return true;
+}
+
+void QueryResultCache::Insert(const QueryCacheKey &key, uint64_t generation, const std::vector<Document> &documents) {
+  Shard &shard = GetShard(key);
+  std::lock_guard lock(shard.mx);
+  const auto [it, inserted] = shard.entries.try_emplace(key);
+  Entry &entry = it->second;
+  if (inserted) {
+    shard.recency.push_front(&it->first);
+    entry.position = shard.recency.begin();
+  } else {
+    shard.recency.splice(shard.recency.begin(), shard.recency, entry.position);
+  }
+  entry.generation = generation;
+  entry.documents = documents;
+  if (shard.entries.size() > shard_capacity_) {
+    const QueryCacheKey *least_recent = shard.recency.back();
+    shard.recency.pop_back();
+    shard.entries.erase(shard.entries.find(*least_recent));
+    ++shard.stats.eviction_count;
+  }
+}
+
+void QueryResultCache::Clear() {
+  for (size_t i = 0; i < shard_count_; ++i) {
+    std::lock_guard lock(shards_[i].mx);
+    shards_[i].entries.clear();
+    shards_[i].recency.clear();
+  }
+}
+
+size_t QueryResultCache::size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < shard_count_; ++i) {
+    std::lock_guard lock(shards_[i].mx);
+    size += shards_[i].entries.size();
+  }
+  return size;
+}
+
+QueryCacheStats QueryResultCache::GetStats() const {
+  QueryCacheStats stats;
+  for (size_t i = 0; i < shard_count_; ++i) {
+    std::lock_guard lock(shards_[i].mx);
+    stats.hit_count += shards_[i].stats.hit_count;
+    stats.miss_count += shards_[i].stats.miss_count;
+    stats.stale_count += shards_[i].stats.stale_count;
+    stats.eviction_count += shards_[i].stats.eviction_count;
+  }
+  return stats;
+}
+
+QueryResultCache::Shard &QueryResultCache::GetShard(const QueryCacheKey &key) const {
+  return shards_[(QueryCacheKeyHash()(key) >> 32) % shard_count_];
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "document.h"
+#include "term_dictionary.h"
+#include "concurrent_map.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// A parsed query in normal form: known terms only, each set unique and
+// ordered, plus what else decides the result
+struct QueryCacheKey {
+  std::vector<TermId> plus_terms;
+  std::vector<TermId> minus_terms;
+  // Every quoted phrase as its sign and term count, then the id and offset of each of its terms
+  std::vector<uint32_t> phrases;
+  // Same tag, same document filter
+  uint64_t filter_tag = 0;
+  size_t top_k = 0;
+};
+
+bool operator==(const QueryCacheKey &lhs, const QueryCacheKey &rhs);
+
+struct QueryCacheKeyHash {
+  size_t operator()(const QueryCacheKey &key) const;
+};
+
+struct QueryCacheStats {
+  uint64_t hit_count = 0;
+  uint64_t miss_count = 0;
+  // Misses on entries cached before the index changed
+  uint64_t stale_count = 0;
+  uint64_t eviction_count = 0;
+
+  double GetHitRate() const;
+};
+
+// Results of recent queries, sharded by key hash with an LRU list per shard.
+// Every entry remembers the index generation it was computed at; a lookup
+// under another generation misses and drops it, so mutating the index
+// invalidates the whole cache without touching it.
+class QueryResultCache {
+ public:
+  explicit QueryResultCache(size_t capacity, size_t shard_count = 16);
+
+  // Copies the cached result to documents
+  bool Find(const QueryCacheKey &key, uint64_t generation, std::vector<Document> &documents);
+  void Insert(const QueryCacheKey &key, uint64_t generation, const std::vector<Document> &documents);
+  void Clear();
+
+  size_t size() const;
+  QueryCacheStats GetStats() const;
+
+ private:
+  struct Entry {
+    uint64_t generation;
+    std::vector<Document> documents;
+    // Position in the recency list of the shard
+    std::list<const QueryCacheKey *>::iterator position;
+  };
+
+  struct alignas(CACHE_LINE_SIZE) Shard {
+    mutable std::mutex mx;
+    std::unordered_map<QueryCacheKey, Entry, QueryCacheKeyHash> entries;
+    // Most recently used first; points to keys of entries
+    std::list<const QueryCacheKey *> recency;
+    QueryCacheStats stats;
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_count_;
+  size_t shard_capacity_;
+
+  Shard &GetShard(const QueryCacheKey &key) const;
+};
@@ -0,0 +1,26 @@
+#include "remove_duplicates.h"
+#include "duplicate_index.h"
+
+#include <algorithm>
+#include <execution>
+
+std::vector<int> RemoveDuplicates(SearchServer &search_server, uint32_t max_simhash_distance) {
+  DuplicateIndex duplicate_index(max_simhash_distance);
+  const std::vector<int> document_ids(search_server.begin(), search_server.end());
+  std::vector<DocumentFingerprint> fingerprints(document_ids.size());
+  std::transform(std::execution::par, document_ids.begin(), document_ids.end(), fingerprints.begin(),
+                 [&search_server](int document_id) {
+                   return search_server.GetDocumentFingerprint(document_id);
+                 });
+
+  std::vector<int> duplicate_ids;
+  for (size_t i = 0; i < document_ids.size(); ++i) {
+    if (duplicate_index.Find(fingerprints[i])) {
+      duplicate_ids.push_back(document_ids[i]);
+    } else {
+      duplicate_index.Add(fingerprints[i], i);
+    }
+  }
+  search_server.RemoveDocuments(std::execution::par, duplicate_ids);
+  return duplicate_ids;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "search_server.h"
+
+#include <vector>
+
+// Removes every document that duplicates one with a smaller id: one with the
+// same word set or, when max_simhash_distance is not zero, a SimHash of that
+// set at most that many bits away. Fingerprints are computed on all threads
+// and looked up in a hash index; the removed ids come back in ascending order.
+std::vector<int> RemoveDuplicates(SearchServer& search_server, uint32_t max_simhash_distance = 0);
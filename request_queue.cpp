@@ -6,14 +6,15 @@ RequestQueue::RequestQueue(const SearchServer &search_server)
     , no_result_requests_(0) {
 }
 
+// Requests by status go through the result cache of the server, if it has one
 std::vector<Document> RequestQueue::AddFindRequest(const std::string &raw_query, DocumentStatus status) {
-  const auto result = search_server_.FindTopDocuments(raw_query, status);
+  const auto result = search_server_.FindTopDocumentsCached(raw_query, status);
   AddStatistic(result.empty());
   return result;
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string &raw_query) {
-  const auto result = search_server_.FindTopDocuments(raw_query);
+  const auto result = search_server_.FindTopDocumentsCached(raw_query);
   AddStatistic(result.empty());
   return result;
 }
@@ -0,0 +1,24 @@
+#include "score_accumulator.h"
+
+ScoreAccumulator &ScoreAccumulator::ForCurrentThread() {
+  static thread_local ScoreAccumulator accumulator;
+  return accumulator;
+}
+
+void ScoreAccumulator::Reset(uint32_t first_index, size_t document_count) {
+  for (const uint32_t offset : touched_) {
+    is_touched_[offset] = false;
+  }
+  touched_.clear();
+  for (const uint32_t word : excluded_words_) {
+    excluded_[word] = 0;
+  }
+  excluded_words_.clear();
+
+  first_index_ = first_index;
+  if (scores_.size() < document_count) {
+    scores_.resize(document_count);
+    is_touched_.resize(document_count, false);
+    excluded_.resize((document_count + 63) / 64, 0);
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Relevance accumulator over a window of internal document numbers. Scores
+// live in a dense array, documents with minus words in a bitmap, and only the
+// slots touched by the previous query are cleared on Reset.
+class ScoreAccumulator {
+ public:
+  // Every thread owns one accumulator, reused from query to query
+  static ScoreAccumulator &ForCurrentThread();
+
+  void Reset(uint32_t first_index, size_t document_count);
+
+  void Exclude(uint32_t document_index) {
+    const uint32_t offset = document_index - first_index_;
+    uint64_t &word = excluded_[offset / 64];
+    if (word == 0) {
+      excluded_words_.push_back(offset / 64);
+    }
+    word |= uint64_t{1} << (offset % 64);
+  }
+
+  bool IsExcluded(uint32_t document_index) const {
+    const uint32_t offset = document_index - first_index_;
+    return (excluded_[offset / 64] >> (offset % 64)) & 1;
+  }
+
+  void Add(uint32_t document_index, double score) {
+    const uint32_t offset = document_index - first_index_;
+    if (is_touched_[offset]) {
+      scores_[offset] += score;
+    } else {
+      is_touched_[offset] = true;
+      scores_[offset] = score;
+      touched_.push_back(offset);
+    }
+  }
+
+  // Visits (document_index, relevance) of every scored document without minus words
+  template<typename Visitor>
+  void ForEach(Visitor visitor) const {
+    for (const uint32_t offset : touched_) {
+      const uint32_t document_index = first_index_ + offset;
+      if (!IsExcluded(document_index)) {
+        visitor(document_index, scores_[offset]);
+      }
+    }
+  }
+
+ private:
+  uint32_t first_index_ = 0;
+  std::vector<double> scores_;
+  std::vector<char> is_touched_;
+  std::vector<uint32_t> touched_;
+  std::vector<uint64_t> excluded_;
+  std::vector<uint32_t> excluded_words_;
+};
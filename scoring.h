@@ -0,0 +1,77 @@
+#pragma once
+#include "corpus_statistics.h"
+#include "posting_list.h"
+
+#include <cmath>
+#include <cstdint>
+
+// Scoring models are template parameters of the search, so scoring a posting
+// is an inlined expression rather than a virtual call. A model is built from
+// the corpus statistics once per query and provides:
+//   GetTermWeight(term_id)             the per-query factor of a term
+//   Score(posting, document_length, term_weight)
+//                                      the contribution of a posting
+//   GetUpperBound(max_term_freq, term_weight)
+//                                      a bound on Score over a posting list,
+//                                      for MaxScore pruning
+// Relevance of a document is the sum of the scores of its postings.
+
+// term_freq * IDF, the relevance SearchServer has always used
+class TfIdfScoring {
+ public:
+  explicit TfIdfScoring(const CorpusStatistics &statistics)
+      : statistics_(statistics) {
+  }
+
+  double GetTermWeight(TermId term_id) const {
+    return statistics_.GetInverseDocumentFreq(term_id);
+  }
+
+  double Score(const Posting &posting, uint32_t document_length, double term_weight) const {
+    return posting.term_freq * term_weight;
+  }
+
+  double GetUpperBound(double max_term_freq, double term_weight) const {
+    return max_term_freq * term_weight;
+  }
+
+ private:
+  const CorpusStatistics &statistics_;
+};
+
+// Okapi BM25. Document lengths are counted at indexing time; the length norm
+// k1 * (1 - b + b * length / average length) is folded into two per-query
+// constants, leaving a multiply-add and a division per posting.
+class Bm25Scoring {
+ public:
+  static constexpr double K1 = 1.2;
+  static constexpr double B = 0.75;
+
+  explicit Bm25Scoring(const CorpusStatistics &statistics)
+      : statistics_(statistics)
+      , length_base_(K1 * (1.0 - B))
+      , length_scale_(statistics.GetDocumentCount() == 0 ? 0.0 : K1 * B / statistics.GetAverageDocumentLength()) {
+  }
+
+  double GetTermWeight(TermId term_id) const {
+    const double document_freq = statistics_.GetDocumentFreq(term_id);
+    return log(1.0 + (statistics_.GetDocumentCount() - document_freq + 0.5) / (document_freq + 0.5));
+  }
+
+  double Score(const Posting &posting, uint32_t document_length, double term_weight) const {
+    const double term_count = posting.term_count;
+    return term_weight * term_count * (K1 + 1.0) / (term_count + length_base_ + length_scale_ * document_length);
+  }
+
+  // With term_freq = term_count / length the score is
+  // weight * (K1 + 1) * term_freq / (term_freq + length_base / length + length_scale),
+  // which grows with term_freq and stays below the value at length_base = 0
+  double GetUpperBound(double max_term_freq, double term_weight) const {
+    return term_weight * (K1 + 1.0) * max_term_freq / (max_term_freq + length_scale_);
+  }
+
+ private:
+  const CorpusStatistics &statistics_;
+  double length_base_;
+  double length_scale_;
+};
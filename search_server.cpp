@@ -1,16 +1,173 @@
 #include "search_server.h"
+#include "work_stealing.h"
+#include "varint.h"
 
 #include <cmath>
 #include <execution>
 #include <algorithm>
+#include <chrono>
+#include <exception>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
+namespace {
 
-SearchServer::SearchServer(const std::string &stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text)) {
+struct IndexMeta {
+  uint64_t document_count;
+  uint64_t term_count;
+  uint64_t perfect_hash_seed;
+  // A TextStorage
+  uint64_t text_storage;
+  // A DuplicatePolicy
+  uint64_t duplicate_policy;
+  uint64_t max_simhash_distance;
+};
+
+struct IndexDocument {
+  int32_t id;
+  int32_t rating;
+  int32_t status;
+  uint32_t is_removed;
+};
+
+// Words of a run of documents, numbered by their first occurrence in the run,
+// so that the dictionary learns them in the order AddDocument would
+struct PartialIndex {
+  std::vector<std::string_view> terms;
+  std::vector<TermId> term_ids;
+  // Per parsed document: where its words end in term_ids and how many terms
+  // the run knew after it
+  std::vector<size_t> term_id_ends;
+  std::vector<size_t> term_counts;
+  // Places of the words of term_ids in their documents, when the server stores positions
+  std::vector<uint32_t> positions;
+  // Thrown by the document after the parsed ones
+  std::exception_ptr error;
+};
+
+// Checks of the structure of a mapped index file, made whether or not its
+// checksums are verified, so that a corrupt file throws instead of sending
+// reads out of its sections
+
+// Offsets of the parts of a section: from zero, ascending, ending at its size
+bool AreValidOffsets(IteratorRange<const uint64_t *> offsets, uint64_t section_size) {
+  return offsets.size() != 0 && *offsets.begin() == 0 && *(offsets.end() - 1) == section_size
+      && std::is_sorted(offsets.begin(), offsets.end());
+}
+
+bool AreValidPostings(IteratorRange<const TermId *> term_ids,
+                      IteratorRange<const uint64_t *> block_offsets,
+                      IteratorRange<const PostingBlock *> blocks,
+                      IteratorRange<const uint32_t *> words,
+                      uint64_t document_count,
+                      uint64_t term_count) {
+  if (!AreValidOffsets(block_offsets, blocks.size())) {
+    return false;
+  }
+  uint32_t gaps[POSTING_BLOCK_SIZE];
+  for (size_t term = 0; term < term_ids.size(); ++term) {
+    if (term_ids.begin()[term] >= term_count || (term > 0 && term_ids.begin()[term] <= term_ids.begin()[term - 1])) {
+      return false;
+    }
+    const PostingBlock *first_block = blocks.begin() + block_offsets.begin()[term];
+    const PostingBlock *last_block = blocks.begin() + block_offsets.begin()[term + 1];
+    for (const PostingBlock *block = first_block; block != last_block; ++block) {
+      if (block->size == 0 || block->size > POSTING_BLOCK_SIZE || block->gap_bits > 32 || block->count_bits > 32
+          || block->first_document_index > block->last_document_index || block->last_document_index >= document_count
+          || (block != first_block && (block - 1)->last_document_index >= block->first_document_index)) {
+        return false;
+      }
+      const uint64_t word_count = GetPackedWordCount(block->size, block->gap_bits)
+          + GetPackedWordCount(block->size, block->count_bits);
+      if (block->word_offset > words.size() || words.size() - block->word_offset < word_count) {
+        return false;
+      }
+      // Decoded documents must end at the last one, so none lies past it
+      UnpackValues(words.begin() + block->word_offset, block->size, block->gap_bits, gaps);
+      uint64_t document_index = block->first_document_index;
+      for (uint32_t i = 0; i < block->size; ++i) {
+        document_index += gaps[i];
+      }
+      if (document_index != block->last_document_index) {
+        return false;
+      }
+    }
+  }
+  return true;
 }
 
-SearchServer::SearchServer(const std::string_view &stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text)) {
+// Every entry of every document decodes within the document's bytes
+bool AreValidPositions(IteratorRange<const uint64_t *> offsets, IteratorRange<const uint8_t *> bytes, uint64_t term_count) {
+  if (!AreValidOffsets(offsets, bytes.size())) {
+    return false;
+  }
+  for (const uint64_t *offset = offsets.begin(); offset + 1 != offsets.end(); ++offset) {
+    const uint8_t *data = bytes.begin() + offset[0];
+    const uint8_t *last = bytes.begin() + offset[1];
+    uint64_t term_id = 0;
+    while (data != last) {
+      uint32_t term_id_gap;
+      uint32_t position_count;
+      if (!ReadVarintChecked(data, last, term_id_gap) || !ReadVarintChecked(data, last, position_count)) {
+        return false;
+      }
+      term_id += term_id_gap;
+      if (term_id >= term_count) {
+        return false;
+      }
+      for (uint32_t position_gap; position_count > 0; --position_count) {
+        if (!ReadVarintChecked(data, last, position_gap)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Every block of front-coded terms decodes within its bytes
+bool AreValidSortedTerms(IteratorRange<const uint64_t *> block_offsets,
+                         IteratorRange<const uint8_t *> bytes,
+                         uint64_t term_count) {
+  if (!AreValidOffsets(block_offsets, bytes.size())) {
+    return false;
+  }
+  for (const uint64_t *offset = block_offsets.begin(); offset + 1 != block_offsets.end(); ++offset) {
+    const uint8_t *data = bytes.begin() + offset[0];
+    const uint8_t *last = bytes.begin() + offset[1];
+    if (data == last) {
+      return false;
+    }
+    uint64_t previous_size = 0;
+    while (data != last) {
+      uint32_t shared_size;
+      uint32_t rest_size;
+      uint32_t id;
+      if (!ReadVarintChecked(data, last, shared_size) || !ReadVarintChecked(data, last, rest_size)
+          || shared_size > previous_size || rest_size > static_cast<uint64_t>(last - data)) {
+        return false;
+      }
+      data += rest_size;
+      if (!ReadVarintChecked(data, last, id) || id >= term_count) {
+        return false;
+      }
+      previous_size = static_cast<uint64_t>(shared_size) + rest_size;
+    }
+  }
+  return true;
+}
+
+}
+
+SearchServer::SearchServer(const std::string &stop_words_text, const IndexOptions &options)
+    : SearchServer(SplitIntoWords(stop_words_text), options) {
+}
+
+SearchServer::SearchServer(const std::string_view &stop_words_text, const IndexOptions &options)
+    : SearchServer(SplitIntoWords(stop_words_text), options) {
 }
 
 void SearchServer::AddDocument(int document_id,
@@ -21,22 +178,232 @@ void SearchServer::AddDocument(int document_id,
   if ((document_id < 0) || (documents_.count(document_id) > 0)) {
     throw std::invalid_argument("Invalid document_id"s);
   }
-  const auto doc_data = documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status , std::string(document)});
-  const auto words = SplitIntoWordsNoStop(doc_data.first->second.doc_text);
+  if (!IsValidStatus(status)) {
+    throw std::invalid_argument("Invalid document status"s);
+  }
+  std::vector<uint32_t> positions;
+  const auto &words = SplitIntoWordsNoStop(document, positional_index_ ? &positions : nullptr);
+  const uint32_t document_index = document_attributes_.size();
 
-  const double inv_word_count = 1.0 / words.size();
-  for (const std::string_view &word : words) {
-    word_to_document_freqs_[word][document_id] += inv_word_count;
-    id_to_words_freqs_[document_id][word] += inv_word_count;
+  std::vector<TermId> term_ids(words.size());
+  std::transform(words.begin(), words.end(), term_ids.begin(), [this](const std::string_view &word) {
+    return dictionary_.Add(word);
+  });
+  statistics_.Reserve(dictionary_.size());
+  std::vector<TermPosition> occurrences(positional_index_ ? term_ids.size() : 0);
+  for (size_t i = 0; i < occurrences.size(); ++i) {
+    occurrences[i] = {term_ids[i], positions[i]};
   }
 
-  document_ids_.insert(document_id);
+  std::vector<TermFrequency> word_freqs = CountTermFrequencies(term_ids);
+  if (duplicate_index_) {
+    const auto duplicated_index = IndexFingerprint(FingerprintDocument(word_freqs), document_index);
+    if (duplicated_index && duplicate_policy_ == DuplicatePolicy::REJECT) {
+      throw std::invalid_argument("Document duplicates document "s
+                                  + std::to_string(document_attributes_[*duplicated_index].id));
+    }
+    if (duplicated_index) {
+      return;
+    }
+  }
+  if (positional_index_) {
+    positional_index_->AddDocument(PositionalIndex::EncodeDocument(occurrences));
+  }
+  segments_.back()->AddDocument(document_index, word_freqs);
+  RegisterDocument(document_id, document, status, ratings, word_freqs);
+
+  InstallMerge(false);
+  if (segments_.back()->GetDocumentCount() == SEGMENT_DOCUMENT_COUNT) {
+    SealActiveSegment();
+  }
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view &raw_query, DocumentStatus status) const {
-  return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-    return document_status == status;
+void SearchServer::AddDocuments(const std::vector<DocumentInput> &documents) {
+  AddDocuments(std::execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const std::execution::sequenced_policy seq, const std::vector<DocumentInput> &documents) {
+  for (const DocumentInput &document : documents) {
+    AddDocument(document.id, document.text, document.status, document.ratings);
+  }
+}
+
+void SearchServer::AddDocuments(const std::execution::parallel_policy par, const std::vector<DocumentInput> &documents) {
+  using namespace std::literals;
+  const size_t min_run_size = 1024;
+  const size_t max_run_count = 4 * std::max(std::thread::hardware_concurrency(), 1u);
+  const size_t run_count = std::clamp<size_t>(documents.size() / min_run_size, 1, max_run_count);
+  const auto get_run_first = [&documents, run_count](size_t run) {
+    return documents.size() * run / run_count;
+  };
+  std::vector<size_t> runs(run_count);
+  std::iota(runs.begin(), runs.end(), 0);
+
+  std::vector<PartialIndex> partial_indexes(run_count);
+  std::for_each(par, runs.begin(), runs.end(), [&](size_t run) {
+    PartialIndex &partial_index = partial_indexes[run];
+    std::unordered_map<std::string_view, TermId, TermHash> term_to_id;
+    std::vector<uint32_t> positions;
+    for (size_t i = get_run_first(run); i < get_run_first(run + 1); ++i) {
+      try {
+        const auto &words = SplitIntoWordsNoStop(documents[i].text, positional_index_ ? &positions : nullptr);
+        partial_index.positions.insert(partial_index.positions.end(), positions.begin(), positions.end());
+        for (const std::string_view &word : words) {
+          const auto [it, inserted] = term_to_id.emplace(word, partial_index.terms.size());
+          if (inserted) {
+            partial_index.terms.push_back(word);
+          }
+          partial_index.term_ids.push_back(it->second);
+        }
+      } catch (...) {
+        partial_index.error = std::current_exception();
+        return;
+      }
+      partial_index.term_id_ends.push_back(partial_index.term_ids.size());
+      partial_index.term_counts.push_back(partial_index.terms.size());
+    }
   });
+
+  // Documents are accepted up to the first one AddDocument would reject
+  std::exception_ptr error;
+  size_t accepted_count = 0;
+  std::unordered_set<int> batch_ids;
+  for (size_t run = 0; run < run_count && !error; ++run) {
+    const PartialIndex &partial_index = partial_indexes[run];
+    for (size_t i = get_run_first(run); i < get_run_first(run + 1); ++i, ++accepted_count) {
+      const int document_id = documents[i].id;
+      if (document_id < 0 || documents_.count(document_id) > 0 || !batch_ids.insert(document_id).second) {
+        error = std::make_exception_ptr(std::invalid_argument("Invalid document_id"s));
+        break;
+      }
+      if (!IsValidStatus(documents[i].status)) {
+        error = std::make_exception_ptr(std::invalid_argument("Invalid document status"s));
+        break;
+      }
+      if (i - get_run_first(run) == partial_index.term_counts.size()) {
+        error = partial_index.error;
+        break;
+      }
+    }
+  }
+
+  // Terms of the accepted documents get dictionary ids, run by run
+  std::vector<std::vector<TermId>> dictionary_ids(run_count);
+  for (size_t run = 0; run < run_count && get_run_first(run) < accepted_count; ++run) {
+    const size_t accepted_in_run = std::min(accepted_count, get_run_first(run + 1)) - get_run_first(run);
+    const PartialIndex &partial_index = partial_indexes[run];
+    const size_t term_count = partial_index.term_counts[accepted_in_run - 1];
+    dictionary_ids[run].resize(term_count);
+    std::transform(partial_index.terms.begin(), partial_index.terms.begin() + term_count, dictionary_ids[run].begin(),
+                   [this](const std::string_view &term) {
+                     return dictionary_.Add(term);
+                   });
+  }
+  statistics_.Reserve(dictionary_.size());
+
+  std::vector<std::vector<TermFrequency>> word_freqs(accepted_count);
+  std::vector<std::vector<uint8_t>> position_entries(positional_index_ ? accepted_count : 0);
+  std::vector<DocumentFingerprint> fingerprints(duplicate_index_ ? accepted_count : 0);
+  std::for_each(par, runs.begin(), runs.end(), [&](size_t run) {
+    const PartialIndex &partial_index = partial_indexes[run];
+    const std::vector<TermId> &ids = dictionary_ids[run];
+    size_t term_id_begin = 0;
+    for (size_t i = get_run_first(run); i < std::min(accepted_count, get_run_first(run + 1)); ++i) {
+      const size_t term_id_end = partial_index.term_id_ends[i - get_run_first(run)];
+      std::vector<TermId> term_ids(term_id_end - term_id_begin);
+      std::transform(partial_index.term_ids.begin() + term_id_begin, partial_index.term_ids.begin() + term_id_end,
+                     term_ids.begin(), [&ids](TermId local_id) {
+                       return ids[local_id];
+                     });
+      if (positional_index_) {
+        std::vector<TermPosition> occurrences(term_ids.size());
+        for (size_t j = 0; j < term_ids.size(); ++j) {
+          occurrences[j] = {term_ids[j], partial_index.positions[term_id_begin + j]};
+        }
+        position_entries[i] = PositionalIndex::EncodeDocument(occurrences);
+      }
+      word_freqs[i] = CountTermFrequencies(term_ids);
+      if (duplicate_index_) {
+        fingerprints[i] = FingerprintDocument(word_freqs[i]);
+      }
+      term_id_begin = term_id_end;
+    }
+  });
+
+  // Duplicates are found in document order, among the batch's own documents
+  // too, and the kept ones close up
+  const uint32_t first_index = document_attributes_.size();
+  std::vector<size_t> kept(accepted_count);
+  std::iota(kept.begin(), kept.end(), 0);
+  if (duplicate_index_) {
+    kept.clear();
+    for (size_t i = 0; i < accepted_count; ++i) {
+      const auto duplicated_index = IndexFingerprint(fingerprints[i], first_index + kept.size());
+      if (!duplicated_index) {
+        if (kept.size() != i) {
+          word_freqs[kept.size()] = std::move(word_freqs[i]);
+          if (positional_index_) {
+            position_entries[kept.size()] = std::move(position_entries[i]);
+          }
+        }
+        kept.push_back(i);
+      } else if (duplicate_policy_ == DuplicatePolicy::REJECT) {
+        const int duplicated_id = *duplicated_index < first_index ? document_attributes_[*duplicated_index].id
+                                                                  : documents[kept[*duplicated_index - first_index]].id;
+        error = std::make_exception_ptr(
+            std::invalid_argument("Document duplicates document "s + std::to_string(duplicated_id)));
+        break;
+      }
+    }
+  }
+  const size_t kept_count = kept.size();
+
+  // Fills up the active segment, builds the whole segments that follow on all
+  // threads and leaves the rest in a new active segment
+  size_t position = std::min<size_t>(kept_count, SEGMENT_DOCUMENT_COUNT - segments_.back()->GetDocumentCount());
+  for (size_t i = 0; i < position; ++i) {
+    segments_.back()->AddDocument(first_index + i, word_freqs[i]);
+  }
+  if (segments_.back()->GetDocumentCount() == SEGMENT_DOCUMENT_COUNT) {
+    segments_.back()->Seal();
+    std::vector<std::shared_ptr<Segment>> sealed_segments((kept_count - position) / SEGMENT_DOCUMENT_COUNT);
+    std::vector<size_t> sealed_indexes(sealed_segments.size());
+    std::iota(sealed_indexes.begin(), sealed_indexes.end(), 0);
+    std::for_each(par, sealed_indexes.begin(), sealed_indexes.end(), [&](size_t sealed_index) {
+      const size_t first = position + sealed_index * SEGMENT_DOCUMENT_COUNT;
+      auto segment = std::make_shared<Segment>(first_index + first);
+      for (size_t i = first; i < first + SEGMENT_DOCUMENT_COUNT; ++i) {
+        segment->AddDocument(first_index + i, word_freqs[i]);
+      }
+      segment->Seal();
+      sealed_segments[sealed_index] = std::move(segment);
+    });
+    segments_.insert(segments_.end(), sealed_segments.begin(), sealed_segments.end());
+    position += sealed_segments.size() * SEGMENT_DOCUMENT_COUNT;
+    segments_.push_back(std::make_shared<Segment>(first_index + position));
+    for (; position < kept_count; ++position) {
+      segments_.back()->AddDocument(first_index + position, word_freqs[position]);
+    }
+    ScheduleMerge();
+  }
+
+  for (size_t i = 0; i < kept_count; ++i) {
+    if (positional_index_) {
+      positional_index_->AddDocument(position_entries[i]);
+    }
+    const DocumentInput &document = documents[kept[i]];
+    RegisterDocument(document.id, document.text, document.status, document.ratings, word_freqs[i]);
+  }
+  InstallMerge(false);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view &raw_query,
+                                                     DocumentStatus status,
+                                                     size_t top_k) const {
+  return FindTopDocuments(raw_query, DocumentFilter::ForStatus(status), top_k);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view &raw_query) const {
@@ -45,10 +412,9 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view &raw
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy seq,
                                                      const std::string_view &raw_query,
-                                                     DocumentStatus status) const {
-  return FindTopDocuments(seq, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-    return document_status == status;
-  });
+                                                     DocumentStatus status,
+                                                     size_t top_k) const {
+  return FindTopDocuments(seq, raw_query, DocumentFilter::ForStatus(status), top_k);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy seq,
@@ -57,10 +423,9 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::execution::seque
 }
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy par,
                                                      const std::string_view &raw_query,
-                                                     DocumentStatus status) const {
-  return FindTopDocuments(par, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-    return document_status == status;
-  });
+                                                     DocumentStatus status,
+                                                     size_t top_k) const {
+  return FindTopDocuments(par, raw_query, DocumentFilter::ForStatus(status), top_k);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy par,
@@ -68,10 +433,149 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::execution::paral
   return FindTopDocuments(par, raw_query, DocumentStatus::ACTUAL);
 }
 
+std::vector<Document> SearchServer::FindTopDocumentsPruned(const std::string_view &raw_query,
+                                                           DocumentStatus status,
+                                                           size_t top_k) const {
+  return FindTopDocumentsPruned(raw_query, DocumentFilter::ForStatus(status), top_k);
+}
+
+std::vector<std::pair<std::string_view, uint32_t>> SearchServer::GetQueryDocumentFreqs(const std::string_view &raw_query) const {
+  QueryArena &arena = QueryArena::ForCurrentThread();
+  const QueryArena::Scope scope(arena);
+  const auto query = ParseQuery(raw_query, &arena);
+  std::vector<std::pair<std::string_view, uint32_t>> document_freqs;
+  for (const TermId word : query.plus_words) {
+    const uint32_t document_freq = statistics_.GetDocumentFreq(word);
+    if (document_freq != 0) {
+      document_freqs.emplace_back(dictionary_.GetTerm(word), document_freq);
+    }
+  }
+  return document_freqs;
+}
+
+void SearchServer::FindTopDocumentsBatch(const std::vector<std::string> &raw_queries,
+                                         QueryResultArena &results,
+                                         DocumentStatus status,
+                                         size_t top_k) const {
+  FindTopDocumentsBatch(raw_queries.begin(), raw_queries.end(), results, status, top_k);
+}
+
+void SearchServer::FindTopDocumentsBatch(std::vector<std::string>::const_iterator first_query,
+                                         std::vector<std::string>::const_iterator last_query,
+                                         QueryResultArena &results,
+                                         DocumentStatus status,
+                                         size_t top_k) const {
+  // An exception must not leave the parallel algorithm, which would call
+  // std::terminate; the one of the first invalid query is rethrown
+  std::vector<Query> queries(last_query - first_query);
+  std::vector<std::exception_ptr> errors(queries.size());
+  std::vector<size_t> query_indexes(queries.size());
+  std::iota(query_indexes.begin(), query_indexes.end(), 0);
+  std::for_each(std::execution::par, query_indexes.begin(), query_indexes.end(), [&](size_t query_index) {
+    try {
+      queries[query_index] = ParseQuery(first_query[query_index], std::pmr::get_default_resource());
+    } catch (...) {
+      errors[query_index] = std::current_exception();
+    }
+  });
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  std::vector<TermId> batch_terms;
+  for (const Query &query : queries) {
+    batch_terms.insert(batch_terms.end(), query.plus_words.begin(), query.plus_words.end());
+    batch_terms.insert(batch_terms.end(), query.minus_words.begin(), query.minus_words.end());
+  }
+  std::sort(batch_terms.begin(), batch_terms.end());
+  batch_terms.erase(std::unique(batch_terms.begin(), batch_terms.end()), batch_terms.end());
+  std::vector<double> batch_inverse_document_freqs(batch_terms.size());
+  std::transform(std::execution::par, batch_terms.begin(), batch_terms.end(), batch_inverse_document_freqs.begin(),
+                 [this](TermId term_id) {
+                   return statistics_.GetDocumentFreq(term_id) == 0 ? 0.0 : statistics_.GetInverseDocumentFreq(term_id);
+                 });
+  const auto find_inverse_document_freq = [&](TermId term_id) {
+    const auto it = std::lower_bound(batch_terms.begin(), batch_terms.end(), term_id);
+    return batch_inverse_document_freqs[it - batch_terms.begin()];
+  };
+
+  results.Reset(queries.size(), top_k);
+  const DocumentFilter filter = DocumentFilter::ForStatus(status);
+  ParallelForWorkStealing(queries.size(), [&](size_t query_index) {
+    QueryArena &arena = QueryArena::ForCurrentThread();
+    const QueryArena::Scope scope(arena);
+    PreparedQuery query{std::pmr::vector<WeightedTerm>(&arena), std::pmr::vector<TermId>(&arena),
+                        std::pmr::vector<PhraseTerm>(queries[query_index].phrase_terms, &arena),
+                        std::pmr::vector<QueryPhrase>(queries[query_index].phrases, &arena)};
+    for (const TermId word : queries[query_index].plus_words) {
+      if (statistics_.GetDocumentFreq(word) != 0) {
+        query.plus_terms.push_back({word, find_inverse_document_freq(word)});
+      }
+    }
+    for (const TermId word : queries[query_index].minus_words) {
+      if (statistics_.GetDocumentFreq(word) != 0) {
+        query.minus_terms.push_back(word);
+      }
+    }
+    const auto matched_documents = FindDocumentsInRange(query, TfIdfScoring(statistics_), filter, 0,
+                                                        document_attributes_.size(), &arena);
+    results.Assign(query_index, SelectTopDocuments(std::execution::seq, matched_documents, top_k, &arena));
+  });
+}
+
+void SearchServer::EnableResultCache(size_t capacity, size_t shard_count) {
+  result_cache_ = std::make_unique<QueryResultCache>(capacity, shard_count);
+}
+
+std::vector<Document> SearchServer::FindTopDocumentsCached(const std::string_view &raw_query,
+                                                           DocumentStatus status,
+                                                           size_t top_k) const {
+  if (!result_cache_) {
+    return FindTopDocuments(raw_query, status, top_k);
+  }
+  QueryCacheKey key;
+  {
+    QueryArena &arena = QueryArena::ForCurrentThread();
+    const QueryArena::Scope scope(arena);
+    const auto query = ParseQuery(raw_query, &arena);
+    key.plus_terms.assign(query.plus_words.begin(), query.plus_words.end());
+    key.minus_terms.assign(query.minus_words.begin(), query.minus_words.end());
+    for (const QueryPhrase &phrase : query.phrases) {
+      key.phrases.push_back(phrase.is_minus);
+      key.phrases.push_back(phrase.last_term - phrase.first_term);
+      for (uint32_t term = phrase.first_term; term < phrase.last_term; ++term) {
+        key.phrases.push_back(query.phrase_terms[term].term_id);
+        key.phrases.push_back(query.phrase_terms[term].offset);
+      }
+    }
+  }
+  key.filter_tag = static_cast<uint64_t>(status);
+  key.top_k = top_k;
+
+  // Any add or remove starts a new generation of the statistics
+  const uint64_t generation = statistics_.GetGeneration();
+  std::vector<Document> result;
+  if (!result_cache_->Find(key, generation, result)) {
+    result = FindTopDocuments(raw_query, status, top_k);
+    result_cache_->Insert(key, generation, result);
+  }
+  return result;
+}
+
+QueryCacheStats SearchServer::GetResultCacheStats() const {
+  return result_cache_ ? result_cache_->GetStats() : QueryCacheStats();
+}
+
 int SearchServer::GetDocumentCount() const {
   return documents_.size();
 }
 
+const CorpusStatistics &SearchServer::GetCorpusStatistics() const {
+  return statistics_;
+}
+
 std::set<int>::const_iterator SearchServer::begin() const {
   return document_ids_.begin();
 }
@@ -90,60 +594,66 @@ std::tuple<std::vector<std::string_view>
            , DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy seq,
                                                          const std::string_view &raw_query,
                                                          int document_id) const {
-  const auto query = ParseQuery(raw_query);
+  QueryArena &arena = QueryArena::ForCurrentThread();
+  const QueryArena::Scope scope(arena);
+  const auto query = ParseQuery(raw_query, &arena);
 
-  std::vector<std::string_view> matched_words;
-  for (const std::string_view &word : query.plus_words) {
-    if (word_to_document_freqs_.count(word) == 0) {
-      continue;
-    }
-    if (word_to_document_freqs_.at(word).count(document_id)) {
-      matched_words.push_back(word);
+  const uint32_t document_index = documents_.at(document_id).index;
+  const auto &attributes = document_attributes_[document_index];
+  const Segment &segment = **FindSegment(document_index);
+
+  for (const TermId word : query.minus_words) {
+    if (ContainsWord(segment, word, document_index)) {
+      return {std::vector<std::string_view>(), attributes.status};
     }
   }
-  for (const std::string_view &word : query.minus_words) {
-    if (word_to_document_freqs_.count(word) == 0) {
-      continue;
-    }
-    if (word_to_document_freqs_.at(word).count(document_id)) {
-      matched_words.clear();
-      break;
+  if (!query.phrases.empty() && !MatchesPhrases(document_index, query)) {
+    return {std::vector<std::string_view>(), attributes.status};
+  }
+  std::pmr::vector<TermId> matched_ids(&arena);
+  for (const TermId word : query.plus_words) {
+    if (ContainsWord(segment, word, document_index)) {
+      matched_ids.push_back(word);
     }
   }
-  return {matched_words, documents_.at(document_id).status};
 
+  // The result is the only allocation on the heap
+  std::vector<std::string_view> matched_words(matched_ids.size());
+  std::transform(matched_ids.begin(), matched_ids.end(), matched_words.begin(), [this](const TermId word) {
+    return dictionary_.GetTerm(word);
+  });
+  return {std::move(matched_words), attributes.status};
 }
 
 std::tuple<std::vector<std::string_view>
            , DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy par,
                                                          const std::string_view &raw_query,
                                                          int document_id) const {
-  const auto query = ParseQuery(raw_query);
+  QueryArena &arena = QueryArena::ForCurrentThread();
+  const QueryArena::Scope scope(arena);
+  const auto query = ParseQuery(raw_query, &arena);
 
-  std::vector<std::string_view> matched_words(query.plus_words.size());
-  std::copy_if(par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [&](const auto &word) {
-    if (word_to_document_freqs_.count(word) != 0) {
-      if (word_to_document_freqs_.at(word).count(document_id)) {
-        return true;
-      }
-    }
-    return false;
-  });
-  matched_words.erase(std::remove(matched_words.begin(),matched_words.end(), ""), matched_words.end());
+  const uint32_t document_index = documents_.at(document_id).index;
+  const auto &attributes = document_attributes_[document_index];
+  const Segment &segment = **FindSegment(document_index);
 
-  const auto minus_word_it = std::find_if(par, query.minus_words.begin(), query.minus_words.end(), [&](const auto &word) {
-    if (word_to_document_freqs_.count(word) != 0) {
-      if (word_to_document_freqs_.at(word).count(document_id)) {
-          return true;
-      }
-    }
-    return false;
+  std::pmr::vector<TermId> matched_ids(query.plus_words.size(), &arena);
+  matched_ids.erase(std::copy_if(par, query.plus_words.begin(), query.plus_words.end(), matched_ids.begin(), [&](const TermId word) {
+    return ContainsWord(segment, word, document_index);
+  }), matched_ids.end());
+
+  const auto minus_word_it = std::find_if(par, query.minus_words.begin(), query.minus_words.end(), [&](const TermId word) {
+    return ContainsWord(segment, word, document_index);
   });
-  if (minus_word_it != query.minus_words.end()) {
-    matched_words.clear();
+  if (minus_word_it != query.minus_words.end() || (!query.phrases.empty() && !MatchesPhrases(document_index, query))) {
+    matched_ids.clear();
   }
 
-  return {matched_words, documents_.at(document_id).status};
+  std::vector<std::string_view> matched_words(matched_ids.size());
+  std::transform(matched_ids.begin(), matched_ids.end(), matched_words.begin(), [this](const TermId word) {
+    return dictionary_.GetTerm(word);
+  });
+  return {std::move(matched_words), attributes.status};
 }
 
 bool SearchServer::IsStopWord(const std::string_view &word) const {
@@ -157,20 +667,74 @@ bool SearchServer::IsValidWord(const std::string_view &word) {
   });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view &text) const {
+const std::vector<std::string_view> &SearchServer::SplitIntoWordsNoStop(const std::string_view &text,
+                                                                        std::vector<uint32_t> *positions) const {
   using namespace std::literals;
-  std::vector<std::string_view> words;
-  for (const std::string_view &word : SplitIntoWords(text)) {
-    if (!IsValidWord(word)) {
-      throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
-    }
-    if (!IsStopWord(word)) {
-      words.push_back(word);
+  WordSplitter &splitter = WordSplitter::ForCurrentThread();
+  std::vector<std::string_view> &words = splitter.Split(text);
+  if (splitter.HasControlCharacter()) {
+    const auto invalid_word = std::find_if_not(words.begin(), words.end(), IsValidWord);
+    throw std::invalid_argument("Word "s + std::string(*invalid_word) + " is invalid"s);
+  }
+  if (positions) {
+    positions->clear();
+    for (uint32_t position = 0; position < words.size(); ++position) {
+      if (!IsStopWord(words[position])) {
+        positions->push_back(position);
+      }
     }
   }
+  words.erase(std::remove_if(words.begin(), words.end(), [this](const std::string_view &word) {
+    return IsStopWord(word);
+  }), words.end());
   return words;
 }
 
+std::vector<TermFrequency> SearchServer::CountTermFrequencies(std::vector<TermId> &term_ids) {
+  std::sort(term_ids.begin(), term_ids.end());
+  std::vector<TermFrequency> word_freqs;
+  const double inv_word_count = 1.0 / term_ids.size();
+  for (const TermId term_id : term_ids) {
+    if (word_freqs.empty() || word_freqs.back().term_id != term_id) {
+      word_freqs.push_back({term_id, 0, 0.0});
+    }
+    ++word_freqs.back().term_count;
+    word_freqs.back().term_freq += inv_word_count;
+  }
+  return word_freqs;
+}
+
+void SearchServer::RegisterDocument(int document_id,
+                                    const std::string_view &text,
+                                    DocumentStatus status,
+                                    const std::vector<int> &ratings,
+                                    const std::vector<TermFrequency> &word_freqs) {
+  uint32_t word_count = 0;
+  for (const TermFrequency &word : word_freqs) {
+    forward_terms_.push_back({word.term_id, word.term_count});
+    word_count += word.term_count;
+  }
+  statistics_.AddDocument(forward_terms_.data() + forward_offsets_.back(), forward_terms_.data() + forward_terms_.size());
+  forward_offsets_.push_back(forward_terms_.size());
+  if (document_store_) {
+    document_store_->AddDocument(text);
+  }
+  const uint32_t document_index = document_attributes_.size();
+  document_attributes_.push_back({document_id, ComputeAverageRating(ratings), status, word_count});
+  SetLiveStatusBits(document_index, GetStatusBit(status));
+  documents_.emplace(document_id, DocumentData{document_index});
+  document_ids_.insert(document_id);
+}
+
+void SearchServer::SetLiveStatusBits(uint32_t document_index, uint32_t status_bits) {
+  if (live_statuses_.size() <= document_index / 16) {
+    live_statuses_.resize(document_index / 16 + 1);
+  }
+  uint64_t &word = live_statuses_[document_index / 16];
+  const int shift = document_index % 16 * 4;
+  word = (word & ~(uint64_t{0xf} << shift)) | (static_cast<uint64_t>(status_bits & 0xf) << shift);
+}
+
 int SearchServer::ComputeAverageRating(const std::vector<int> &ratings) {
   if (ratings.empty()) {
     return 0;
@@ -193,31 +757,219 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view &tex
     is_minus = true;
     word = word.substr(1);
   }
-  if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+  if (word.empty() || word[0] == '-') {
     throw std::invalid_argument("Query word "s + std::string(word) + " is invalid");
   }
 
   return {word, is_minus, IsStopWord(word)};
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view &text) const {
-  Query result;
-  for (const std::string_view &word : SplitIntoWords(text)) {
+SearchServer::Query SearchServer::ParseQuery(const std::string_view &text,
+                                             std::pmr::memory_resource *resource) const {
+  using namespace std::literals;
+  Query result{std::pmr::vector<TermId>(resource), std::pmr::vector<TermId>(resource),
+               std::pmr::vector<PhraseTerm>(resource), std::pmr::vector<QueryPhrase>(resource)};
+  WordSplitter &splitter = WordSplitter::ForCurrentThread();
+  // Offset of the next word of the open phrase, stop words included
+  std::optional<uint32_t> phrase_offset;
+  for (std::string_view word : splitter.Split(text)) {
+    // The splitter has already checked the whole text for control characters
+    if (splitter.HasControlCharacter() && !IsValidWord(word)) {
+      throw std::invalid_argument("Query word "s + std::string(word) + " is invalid"s);
+    }
+    const bool is_minus_phrase = word.size() > 1 && word[0] == '-' && word[1] == '"';
+    if ((!word.empty() && word[0] == '"') || is_minus_phrase) {
+      if (phrase_offset) {
+        throw std::invalid_argument("Query has a quote inside a phrase"s);
+      }
+      if (!positional_index_) {
+        throw std::invalid_argument("Phrase queries need a server storing positions"s);
+      }
+      word.remove_prefix(is_minus_phrase ? 2 : 1);
+      phrase_offset = 0;
+      const uint32_t first_term = result.phrase_terms.size();
+      result.phrases.push_back({first_term, first_term, is_minus_phrase});
+    }
+    const bool is_phrase_end = !word.empty() && word.back() == '"';
+    if (is_phrase_end) {
+      if (!phrase_offset) {
+        throw std::invalid_argument("Query has a closing quote without an opening one"s);
+      }
+      word.remove_suffix(1);
+    }
+    if (phrase_offset) {
+      ParsePhraseWord(word, *phrase_offset, result);
+      // Stop words only shift the words after them, so leading ones are dropped
+      QueryPhrase &phrase = result.phrases.back();
+      if (phrase.first_term != phrase.last_term) {
+        ++*phrase_offset;
+      }
+      if (is_phrase_end) {
+        if (phrase.first_term == phrase.last_term) {
+          result.phrases.pop_back();
+        }
+        phrase_offset.reset();
+      }
+      continue;
+    }
+
     const auto query_word = ParseQueryWord(word);
-    if (!query_word.is_stop) {
-      if (query_word.is_minus) {
-        result.minus_words.insert(query_word.data);
-      } else {
-        result.plus_words.insert(query_word.data);
+    if (query_word.is_stop) {
+      continue;
+    }
+    if (query_word.data.find('*') != std::string_view::npos) {
+      ExpandWildcard(query_word.data, query_word.is_minus ? result.minus_words : result.plus_words);
+      continue;
+    }
+    const TermId term_id = dictionary_.Find(query_word.data);
+    if (term_id == TermDictionary::NO_TERM) {
+      continue;
+    }
+    if (query_word.is_minus) {
+      result.minus_words.push_back(term_id);
+    } else {
+      result.plus_words.push_back(term_id);
+    }
+  }
+  if (phrase_offset) {
+    throw std::invalid_argument("Query has an unclosed phrase"s);
+  }
+  SortUniqueTerms(result.plus_words);
+  SortUniqueTerms(result.minus_words);
+  return result;
+}
+
+void SearchServer::ExpandWildcard(const std::string_view &pattern, std::pmr::vector<TermId> &term_ids) const {
+  using namespace std::literals;
+  const size_t prefix_size = pattern.find('*');
+  if (prefix_size == 0) {
+    throw std::invalid_argument("Query word "s + std::string(pattern) + " has no prefix before *"s);
+  }
+  const bool is_prefix = prefix_size + 1 == pattern.size();
+  const size_t first = term_ids.size();
+  dictionary_.ForEachTermWithPrefix(pattern.substr(0, prefix_size), [&](const std::string_view &term, TermId term_id) {
+    if (statistics_.GetDocumentFreq(term_id) != 0 && (is_prefix || MatchesWildcard(pattern, term))) {
+      term_ids.push_back(term_id);
+    }
+  });
+  if (term_ids.size() - first > MAX_WILDCARD_TERM_COUNT) {
+    const auto by_document_freq = [this](TermId lhs, TermId rhs) {
+      const uint32_t lhs_freq = statistics_.GetDocumentFreq(lhs);
+      const uint32_t rhs_freq = statistics_.GetDocumentFreq(rhs);
+      return lhs_freq > rhs_freq || (lhs_freq == rhs_freq && lhs < rhs);
+    };
+    std::nth_element(term_ids.begin() + first, term_ids.begin() + first + MAX_WILDCARD_TERM_COUNT, term_ids.end(),
+                     by_document_freq);
+    term_ids.resize(first + MAX_WILDCARD_TERM_COUNT);
+  }
+}
+
+void SearchServer::ParsePhraseWord(const std::string_view &word, uint32_t offset, Query &query) const {
+  using namespace std::literals;
+  const auto query_word = ParseQueryWord(word);
+  if (query_word.is_minus || query_word.data.find('*') != std::string_view::npos) {
+    throw std::invalid_argument("Query word "s + std::string(word) + " is invalid inside a phrase"s);
+  }
+  if (query_word.is_stop) {
+    return;
+  }
+  QueryPhrase &phrase = query.phrases.back();
+  const TermId term_id = dictionary_.Find(query_word.data);
+  query.phrase_terms.push_back({term_id, offset});
+  ++phrase.last_term;
+  if (term_id != TermDictionary::NO_TERM && !phrase.is_minus) {
+    query.plus_words.push_back(term_id);
+  }
+}
+
+// Relevance is summed term by term, so keeping the text order keeps the results reproducible
+void SearchServer::SortUniqueTerms(std::pmr::vector<TermId> &term_ids) const {
+  std::sort(term_ids.begin(), term_ids.end());
+  term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+  std::sort(term_ids.begin(), term_ids.end(), [this](TermId lhs, TermId rhs) {
+    return dictionary_.GetTerm(lhs) < dictionary_.GetTerm(rhs);
+  });
+}
+
+std::vector<std::shared_ptr<Segment>>::const_iterator SearchServer::FindSegment(uint32_t document_index) const {
+  const auto it = std::upper_bound(segments_.begin(), segments_.end(), document_index,
+                                   [](uint32_t index, const std::shared_ptr<Segment> &segment) {
+                                     return index < segment->GetFirstIndex();
+                                   });
+  return it - 1;
+}
+
+bool SearchServer::ContainsWord(const Segment &segment, TermId term_id, uint32_t document_index) {
+  return segment.FindPostings(term_id).Contains(document_index);
+}
+
+SearchServer::PhraseDocuments SearchServer::FindPhraseDocuments(const Segment &segment,
+                                                                const PreparedQuery &query,
+                                                                uint32_t first_index,
+                                                                uint32_t last_index,
+                                                                std::pmr::memory_resource *resource) const {
+  PhraseDocuments result{std::pmr::vector<uint32_t>(resource), std::pmr::vector<uint32_t>(resource)};
+  std::pmr::vector<PostingCursor> cursors(resource);
+  for (const QueryPhrase &phrase : query.phrases) {
+    // Plus phrases after the first one only filter the documents it found
+    if (!phrase.is_minus && result.has_plus_phrase) {
+      result.required.erase(std::remove_if(result.required.begin(), result.required.end(), [&](uint32_t document_index) {
+        return !ContainsPhrase(document_index, query.phrase_terms, phrase);
+      }), result.required.end());
+      continue;
+    }
+    std::pmr::vector<uint32_t> &documents = phrase.is_minus ? result.excluded : result.required;
+    result.has_plus_phrase |= !phrase.is_minus;
+
+    // Candidates have every term of the phrase: the posting lists leapfrog
+    // each other until they agree on a document, then positions decide
+    cursors.clear();
+    for (uint32_t term = phrase.first_term; term < phrase.last_term; ++term) {
+      const PostingList postings = segment.FindPostings(query.phrase_terms[term].term_id);
+      if (postings.empty()) {
+        cursors.clear();
+        break;
+      }
+      cursors.emplace_back(postings, first_index);
+    }
+    uint32_t candidate = first_index;
+    size_t agreed_count = 0;
+    for (size_t term = 0; !cursors.empty(); term = (term + 1) % cursors.size()) {
+      PostingCursor &cursor = cursors[term];
+      cursor.AdvanceTo(candidate);
+      if (cursor.IsEnd() || cursor->document_index >= last_index) {
+        break;
+      }
+      if (cursor->document_index != candidate) {
+        candidate = cursor->document_index;
+        agreed_count = 0;
+      }
+      if (++agreed_count == cursors.size()) {
+        if (ContainsPhrase(candidate, query.phrase_terms, phrase)) {
+          documents.push_back(candidate);
+        }
+        ++candidate;
+        agreed_count = 0;
       }
     }
   }
+  std::sort(result.excluded.begin(), result.excluded.end());
   return result;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view &word) const {
-  return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+bool SearchServer::ContainsPhrase(uint32_t document_index,
+                                  const std::pmr::vector<PhraseTerm> &phrase_terms,
+                                  const QueryPhrase &phrase) const {
+  QueryArena &arena = QueryArena::ForCurrentThread();
+  const QueryArena::Scope scope(arena);
+  return positional_index_->ContainsPhrase(document_index, phrase_terms.data() + phrase.first_term,
+                                           phrase_terms.data() + phrase.last_term, &arena);
+}
+
+bool SearchServer::MatchesPhrases(uint32_t document_index, const Query &query) const {
+  return std::all_of(query.phrases.begin(), query.phrases.end(), [&](const QueryPhrase &phrase) {
+    return ContainsPhrase(document_index, query.phrase_terms, phrase) != phrase.is_minus;
+  });
 }
 
 void SearchServer::RemoveDocument(int document_id) {
@@ -225,54 +977,602 @@ void SearchServer::RemoveDocument(int document_id) {
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy seq, int document_id) {
-  const auto it_document_ids = document_ids_.find(document_id);
-  if (it_document_ids == document_ids_.end()) {
+  const auto document_index = UnregisterDocument(document_id);
+  if (!document_index) {
     return;
   }
-  document_ids_.erase(it_document_ids);
-  for (const auto &[word, _] : SearchServer::GetWordFrequencies(document_id)) {
-    const auto it_words_freq = word_to_document_freqs_.find(word);
-    auto &map_id_freq = it_words_freq->second;
-    map_id_freq.erase(document_id);
-    if (map_id_freq.empty()) {
-      word_to_document_freqs_.erase(it_words_freq);
+  const auto words_to_del = GetDocumentTerms(*document_index);
+  statistics_.RemoveDocument(words_to_del.begin(), words_to_del.end());
+  InstallMerge(false);
+  ScheduleMerge();
+}
+
+void SearchServer::RemoveDocument(const std::execution::parallel_policy par, int document_id) {
+  const auto document_index = UnregisterDocument(document_id);
+  if (!document_index) {
+    return;
+  }
+  const auto words_to_del = GetDocumentTerms(*document_index);
+  statistics_.RemoveDocument(par, words_to_del.begin(), words_to_del.end());
+  InstallMerge(false);
+  ScheduleMerge();
+}
+
+void SearchServer::RemoveDocuments(const std::vector<int> &document_ids) {
+  RemoveDocuments(std::execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(const std::execution::sequenced_policy seq, const std::vector<int> &document_ids) {
+  for (const int document_id : document_ids) {
+    if (const auto document_index = UnregisterDocument(document_id)) {
+      const auto words_to_del = GetDocumentTerms(*document_index);
+      statistics_.RemoveDocument(words_to_del.begin(), words_to_del.end());
     }
   }
-  id_to_words_freqs_.erase(document_id);
-  documents_.erase(document_id);
+  InstallMerge(false);
+  ScheduleMerge();
 }
 
-void SearchServer::RemoveDocument(const std::execution::parallel_policy par, int document_id) {
+void SearchServer::RemoveDocuments(const std::execution::parallel_policy par, const std::vector<int> &document_ids) {
+  std::vector<IteratorRange<const TermCount *>> removed_terms;
+  removed_terms.reserve(document_ids.size());
+  for (const int document_id : document_ids) {
+    if (const auto document_index = UnregisterDocument(document_id)) {
+      removed_terms.push_back(GetDocumentTerms(*document_index));
+    }
+  }
+  statistics_.RemoveDocuments(par, removed_terms);
+  InstallMerge(false);
+  ScheduleMerge();
+}
+
+void SearchServer::Compact() {
+  WaitForMerges();
+  std::vector<size_t> positions;
+  for (size_t position = 0; position + 1 < segments_.size(); ++position) {
+    if (segments_[position]->GetPendingRemovalCount() > 0) {
+      positions.push_back(position);
+    }
+  }
+  // Every rewrite reads one sealed segment and builds a new one, nothing is shared
+  std::vector<std::shared_ptr<Segment>> compacted(positions.size());
+  std::vector<size_t> indexes(positions.size());
+  std::iota(indexes.begin(), indexes.end(), 0);
+  std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+    const std::shared_ptr<const Segment> segment = segments_[positions[i]];
+    compacted[i] = Segment::Merge({segment}, {segment->GetRemovedBits()});
+  });
+  for (size_t i = 0; i < positions.size(); ++i) {
+    segments_[positions[i]] = std::move(compacted[i]);
+  }
+
+  const auto is_removed = [this](uint32_t document_index) {
+    return (*FindSegment(document_index))->IsRemoved(document_index);
+  };
+  std::vector<uint64_t> forward_offsets = {0};
+  forward_offsets.reserve(forward_offsets_.size());
+  size_t live_term_count = 0;
+  for (uint32_t offset = 0; offset + 1 < forward_offsets_.size(); ++offset) {
+    if (!is_removed(mapped_document_count_ + offset)) {
+      live_term_count += forward_offsets_[offset + 1] - forward_offsets_[offset];
+    }
+    forward_offsets.push_back(live_term_count);
+  }
+  std::vector<TermCount> forward_terms;
+  forward_terms.reserve(live_term_count);
+  for (uint32_t offset = 0; offset + 1 < forward_offsets_.size(); ++offset) {
+    if (forward_offsets[offset + 1] != forward_offsets[offset]) {
+      forward_terms.insert(forward_terms.end(), forward_terms_.begin() + forward_offsets_[offset],
+                           forward_terms_.begin() + forward_offsets_[offset + 1]);
+    }
+  }
+  forward_offsets_ = std::move(forward_offsets);
+  forward_terms_ = std::move(forward_terms);
+  if (positional_index_) {
+    positional_index_->DropEntries(is_removed);
+  }
+  if (document_store_) {
+    document_store_->DropTexts(is_removed);
+  }
+}
+
+std::optional<uint32_t> SearchServer::UnregisterDocument(int document_id) {
   const auto it_document_ids = document_ids_.find(document_id);
   if (it_document_ids == document_ids_.end()) {
-    return;
+    return std::nullopt;
   }
   document_ids_.erase(it_document_ids);
-  const auto &words_to_del = SearchServer::GetWordFrequencies(document_id);
-  std::mutex mx;
-  std::for_each(par, words_to_del.begin(), words_to_del.end(), [&](const auto &word) {
-    const auto it_words_freq = word_to_document_freqs_.find(word.first);
-    auto &map_id_freq = it_words_freq->second;
-    map_id_freq.erase(document_id);
-    if (map_id_freq.empty()) {
-      {
-        std::lock_guard lock(mx);
-        word_to_document_freqs_.erase(it_words_freq);
-      }
+  const auto it_document = documents_.find(document_id);
+  const uint32_t document_index = it_document->second.index;
+  (*FindSegment(document_index))->MarkRemoved(document_index);
+  SetLiveStatusBits(document_index, 0);
+  documents_.erase(it_document);
+  if (duplicate_index_) {
+    const auto terms = GetDocumentTerms(document_index);
+    duplicate_index_->Remove(ComputeFingerprint(terms.begin(), terms.end(), duplicate_index_->GetMaxSimhashDistance() > 0),
+                             document_index);
+  }
+  return document_index;
+}
+
+DocumentFingerprint SearchServer::FingerprintDocument(const std::vector<TermFrequency> &word_freqs) const {
+  return ComputeFingerprint(word_freqs.data(), word_freqs.data() + word_freqs.size(),
+                            duplicate_index_->GetMaxSimhashDistance() > 0);
+}
+
+std::optional<uint32_t> SearchServer::IndexFingerprint(const DocumentFingerprint &fingerprint, uint32_t document_index) {
+  const auto duplicated_index = duplicate_index_->Find(fingerprint);
+  if (duplicated_index) {
+    return duplicated_index;
+  }
+  duplicate_index_->Add(fingerprint, document_index);
+  return std::nullopt;
+}
+
+void SearchServer::SealActiveSegment() {
+  segments_.back()->Seal();
+  segments_.push_back(std::make_shared<Segment>(segments_.back()->GetEndIndex()));
+  ScheduleMerge();
+}
+
+// Sealed segments only grow by merging MERGE_FACTOR equal ones, so their sizes
+// are SEGMENT_DOCUMENT_COUNT times powers of MERGE_FACTOR
+void SearchServer::ScheduleMerge() {
+  if (pending_merge_.valid()) {
+    return;
+  }
+  const size_t sealed_count = segments_.size() - 1;
+  for (size_t first = 0; first + MERGE_FACTOR <= sealed_count; ++first) {
+    const size_t size = segments_[first]->GetDocumentCount();
+    const bool is_same_size = std::all_of(segments_.begin() + first, segments_.begin() + first + MERGE_FACTOR,
+                                          [size](const std::shared_ptr<Segment> &segment) {
+                                            return segment->GetDocumentCount() == size;
+                                          });
+    if (!is_same_size) {
+      continue;
+    }
+    StartMerge(first, MERGE_FACTOR);
+    return;
+  }
+  // Otherwise a segment mostly of removed documents is rewritten on its own
+  for (size_t position = 0; position < sealed_count; ++position) {
+    const Segment &segment = *segments_[position];
+    if (segment.GetPendingRemovalCount() * 2 > segment.GetDocumentCount()) {
+      StartMerge(position, 1);
+      return;
     }
+  }
+}
+
+void SearchServer::StartMerge(size_t first, size_t segment_count) {
+  // The merge reads sealed postings only; removals made meanwhile are
+  // replayed on the result when it is installed
+  std::vector<std::shared_ptr<const Segment>> segments(segments_.begin() + first,
+                                                       segments_.begin() + first + segment_count);
+  std::vector<std::vector<uint64_t>> removed_bits;
+  for (const auto &segment : segments) {
+    removed_bits.push_back(segment->GetRemovedBits());
+  }
+  merge_position_ = first;
+  merge_segment_count_ = segment_count;
+  pending_merge_ = std::async(std::launch::async, [segments = std::move(segments),
+                                                   removed_bits = std::move(removed_bits)]() {
+    return Segment::Merge(segments, removed_bits);
   });
+}
+
+void SearchServer::InstallMerge(bool wait) {
+  if (!pending_merge_.valid()) {
+    return;
+  }
+  if (!wait && pending_merge_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    return;
+  }
+  std::shared_ptr<Segment> merged = pending_merge_.get();
+  const auto first = segments_.begin() + merge_position_;
+  const auto last = first + merge_segment_count_;
+  for (auto it = first; it != last; ++it) {
+    merged->MarkRemovedFrom(**it);
+  }
+  segments_.insert(segments_.erase(first, last), std::move(merged));
+  ScheduleMerge();
+}
 
-  id_to_words_freqs_.erase(document_id);
-  documents_.erase(document_id);
+uint32_t SearchServer::GetParallelRangeCount() const {
+  const uint32_t min_range_size = 16 * 1024;
+  const uint32_t max_range_count = 4 * std::max(std::thread::hardware_concurrency(), 1u);
+  return std::clamp<uint32_t>(document_attributes_.size() / min_range_size, 1, max_range_count);
 }
 
-const std::map<std::string_view, double, std::less<>> &SearchServer::GetWordFrequencies(int document_id) const {
-  const auto it = id_to_words_freqs_.find(document_id);
-  if (it != id_to_words_freqs_.end()) {
-    return it->second;
-  } else {
-    static const std::map<std::string_view, double, std::less<>> result;
-    return result;
+std::map<std::string_view, double, std::less<>> SearchServer::GetWordFrequencies(int document_id) const {
+  std::map<std::string_view, double, std::less<>> result;
+  const auto it = documents_.find(document_id);
+  if (it != documents_.end()) {
+    // Summed as CountTermFrequencies does, so the freqs match the postings bit for bit
+    const double inv_word_count = 1.0 / document_attributes_[it->second.index].word_count;
+    for (const TermCount &word : GetDocumentTerms(it->second.index)) {
+      double term_freq = 0.0;
+      for (uint32_t i = 0; i < word.term_count; ++i) {
+        term_freq += inv_word_count;
+      }
+      result.emplace(dictionary_.GetTerm(word.term_id), term_freq);
+    }
   }
+  return result;
 }
 
+std::string SearchServer::GetDocumentText(int document_id) const {
+  using namespace std::literals;
+  if (!document_store_) {
+    throw std::invalid_argument("Document texts need a server storing them"s);
+  }
+  return document_store_->GetText(documents_.at(document_id).index);
+}
+
+DocumentFingerprint SearchServer::GetDocumentFingerprint(int document_id) const {
+  const auto terms = GetDocumentTerms(documents_.at(document_id).index);
+  return ComputeFingerprint(terms.begin(), terms.end(), true);
+}
+
+void SearchServer::FreezeTermDictionary() {
+  dictionary_.Freeze();
+}
+
+void SearchServer::WaitForMerges() {
+  while (pending_merge_.valid()) {
+    InstallMerge(true);
+  }
+}
+
+size_t SearchServer::GetSegmentCount() const {
+  return segments_.size();
+}
+
+size_t SearchServer::GetPostingCount() const {
+  size_t posting_count = 0;
+  for (const auto &segment : segments_) {
+    posting_count += segment->GetPostingCount();
+  }
+  return posting_count;
+}
+
+size_t SearchServer::GetPostingByteCount() const {
+  size_t byte_count = 0;
+  for (const auto &segment : segments_) {
+    byte_count += segment->GetPostingByteCount();
+  }
+  return byte_count;
+}
+
+size_t SearchServer::GetPositionByteCount() const {
+  return positional_index_ ? positional_index_->GetByteCount() : 0;
+}
+
+MemoryUsage SearchServer::GetMemoryUsage() const {
+  MemoryUsage usage;
+  usage.dictionary = dictionary_.GetByteCount();
+  usage.postings = GetPostingByteCount();
+  usage.positions = GetPositionByteCount();
+  usage.forward_index = forward_offsets_.capacity() * sizeof(uint64_t) + forward_terms_.capacity() * sizeof(TermCount);
+  if (mapped_document_count_ > 0) {
+    usage.forward_index += (mapped_document_count_ + 1) * sizeof(uint64_t)
+        + mapped_forward_offsets_[mapped_document_count_] * sizeof(TermCount);
+  }
+  usage.texts = document_store_ ? document_store_->GetByteCount() : 0;
+  usage.documents = document_attributes_.capacity() * sizeof(DocumentAttributes)
+      + live_statuses_.capacity() * sizeof(uint64_t) + EstimateTreeByteCount(documents_)
+      + EstimateTreeByteCount(document_ids_);
+  usage.statistics = statistics_.GetByteCount();
+  usage.duplicates = duplicate_index_ ? duplicate_index_->GetByteCount() : 0;
+  const size_t removed_document_count = document_attributes_.size() - documents_.size();
+  const size_t document_slot_byte_count = sizeof(DocumentAttributes) + sizeof(uint64_t)
+      + (positional_index_ ? sizeof(uint64_t) : 0) + (document_store_ ? sizeof(uint64_t) : 0);
+  usage.removed_documents = removed_document_count * document_slot_byte_count + removed_document_count / 2;
+  return usage;
+}
+
+void SearchServer::SaveIndex(const std::string &path) const {
+  IndexFileWriter writer(path);
+  const TermDictionary::PerfectHash perfect_hash = dictionary_.BuildPerfectHash();
+  TextStorage text_storage = TextStorage::NONE;
+  if (document_store_) {
+    text_storage = document_store_->IsCompressed() ? TextStorage::COMPRESSED : TextStorage::PLAIN;
+  }
+  const std::vector<IndexMeta> meta = {{document_attributes_.size(), dictionary_.size(), perfect_hash.seed,
+                                        static_cast<uint64_t>(text_storage), static_cast<uint64_t>(duplicate_policy_),
+                                        duplicate_index_ ? duplicate_index_->GetMaxSimhashDistance() : 0}};
+  writer.AddSection(IndexSection::META, meta);
+
+  std::string stop_words_text;
+  for (const std::string &stop_word : stop_words_) {
+    stop_words_text += stop_word;
+    stop_words_text.push_back(' ');
+  }
+  writer.AddSection(IndexSection::STOP_WORDS, stop_words_text.data(), stop_words_text.size());
+
+  std::vector<uint64_t> term_offsets = {0};
+  std::string term_bytes;
+  for (TermId term_id = 0; term_id < dictionary_.size(); ++term_id) {
+    term_bytes += dictionary_.GetTerm(term_id);
+    term_offsets.push_back(term_bytes.size());
+  }
+  writer.AddSection(IndexSection::TERM_OFFSETS, term_offsets);
+  writer.AddSection(IndexSection::TERM_BYTES, term_bytes.data(), term_bytes.size());
+  writer.AddSection(IndexSection::PERFECT_HASH_DISPLACEMENTS, perfect_hash.displacements);
+  writer.AddSection(IndexSection::PERFECT_HASH_SLOTS, perfect_hash.slots);
+  const FrontCodedTerms sorted_terms = dictionary_.BuildSortedTerms();
+  const FrontCodedTerms::Layout &sorted_layout = sorted_terms.GetLayout();
+  writer.AddSection(IndexSection::SORTED_TERM_BLOCK_OFFSETS, sorted_layout.block_offsets,
+                    (sorted_layout.block_count + 1) * sizeof(uint64_t));
+  writer.AddSection(IndexSection::SORTED_TERM_BYTES, sorted_layout.bytes,
+                    sorted_layout.block_offsets[sorted_layout.block_count]);
+  std::vector<uint32_t> document_freqs = statistics_.GetDocumentFreqs();
+  document_freqs.resize(dictionary_.size(), 0);
+  writer.AddSection(IndexSection::DOCUMENT_FREQS, document_freqs);
+
+  // Records are value-initialized before their fields are set, so padding is written as zeros
+  std::vector<IndexDocument> documents(document_attributes_.size());
+  std::vector<uint64_t> forward_offsets = {0};
+  std::vector<TermCount> forward_terms;
+  std::vector<double> inv_word_counts(document_attributes_.size(), 0.0);
+  std::vector<uint64_t> position_offsets;
+  std::vector<uint8_t> position_bytes;
+  if (positional_index_) {
+    position_offsets.push_back(0);
+  }
+  for (uint32_t document_index = 0; document_index < document_attributes_.size(); ++document_index) {
+    const auto &attributes = document_attributes_[document_index];
+    const auto it_document = documents_.find(attributes.id);
+    const bool is_removed = it_document == documents_.end() || it_document->second.index != document_index;
+    documents[document_index] = {attributes.id, attributes.rating, static_cast<int32_t>(attributes.status), is_removed};
+    if (!is_removed) {
+      uint32_t word_count = 0;
+      for (const TermCount &word : GetDocumentTerms(document_index)) {
+        forward_terms.push_back(word);
+        word_count += word.term_count;
+      }
+      inv_word_counts[document_index] = 1.0 / word_count;
+      if (positional_index_) {
+        const auto entry = positional_index_->GetDocumentEntry(document_index);
+        position_bytes.insert(position_bytes.end(), entry.begin(), entry.end());
+      }
+    }
+    forward_offsets.push_back(forward_terms.size());
+    if (positional_index_) {
+      position_offsets.push_back(position_bytes.size());
+    }
+  }
+  writer.AddSection(IndexSection::DOCUMENTS, documents);
+
+  // Texts of removed documents are left out as empty ones
+  DocumentStore texts(text_storage == TextStorage::COMPRESSED);
+  if (document_store_) {
+    document_store_->ForEachText([&](uint32_t document_index, const std::string_view &text) {
+      texts.AddDocument(documents[document_index].is_removed ? std::string_view() : text);
+    });
+    texts.Flush();
+  }
+  const DocumentStore::Layout text_layout = texts.GetLayout();
+  const bool is_compressed = text_storage == TextStorage::COMPRESSED;
+  const size_t text_block_count = is_compressed ? text_layout.block_count + 1 : 0;
+  writer.AddSection(IndexSection::TEXT_OFFSETS, text_layout.text_offsets,
+                    document_store_ ? (text_layout.document_count + 1) * sizeof(uint64_t) : 0);
+  writer.AddSection(IndexSection::TEXT_BLOCK_DOCUMENTS, text_layout.block_documents, text_block_count * sizeof(uint32_t));
+  writer.AddSection(IndexSection::TEXT_BLOCK_OFFSETS, text_layout.block_offsets, text_block_count * sizeof(uint64_t));
+  writer.AddSection(IndexSection::TEXT_BYTES, text_layout.bytes,
+                    is_compressed ? text_layout.block_offsets[text_layout.block_count]
+                                  : text_layout.text_offsets[text_layout.document_count]);
+
+  // All segments are written as one, without the postings of removed documents
+  std::vector<TermId> posting_term_ids;
+  std::vector<uint64_t> block_offsets = {0};
+  std::vector<double> max_term_freqs;
+  std::vector<PostingBlock> blocks;
+  std::vector<uint32_t> words;
+  std::vector<Posting> postings;
+  for (TermId term_id = 0; term_id < dictionary_.size(); ++term_id) {
+    double max_term_freq = 0.0;
+    postings.clear();
+    for (const auto &segment : segments_) {
+      for (PostingCursor cursor(segment->FindPostings(term_id)); !cursor.IsEnd(); cursor.Next()) {
+        if (!segment->IsRemoved(cursor->document_index)) {
+          postings.push_back(*cursor);
+          max_term_freq = std::max(max_term_freq, cursor->term_freq);
+        }
+      }
+    }
+    if (!postings.empty()) {
+      EncodePostings(postings.data(), postings.data() + postings.size(), blocks, words);
+      posting_term_ids.push_back(term_id);
+      block_offsets.push_back(blocks.size());
+      max_term_freqs.push_back(max_term_freq);
+    }
+  }
+  writer.AddSection(IndexSection::POSTING_TERM_IDS, posting_term_ids);
+  writer.AddSection(IndexSection::POSTING_BLOCK_OFFSETS, block_offsets);
+  writer.AddSection(IndexSection::POSTING_MAX_TERM_FREQS, max_term_freqs);
+  writer.AddSection(IndexSection::POSTING_BLOCKS, blocks);
+  writer.AddSection(IndexSection::POSTING_WORDS, words);
+  writer.AddSection(IndexSection::INV_WORD_COUNTS, inv_word_counts);
+  writer.AddSection(IndexSection::FORWARD_OFFSETS, forward_offsets);
+  writer.AddSection(IndexSection::FORWARD_TERMS, forward_terms);
+  writer.AddSection(IndexSection::POSITION_OFFSETS, position_offsets);
+  writer.AddSection(IndexSection::POSITION_BYTES, position_bytes);
+  writer.Finish();
+}
+
+SearchServer SearchServer::LoadIndex(const std::string &path, bool verify_checksums) {
+  auto index_file = std::make_shared<const MappedIndexFile>(path, verify_checksums);
+  const auto stop_words_text = index_file->GetSection<char>(IndexSection::STOP_WORDS);
+  SearchServer search_server(std::string_view(stop_words_text.begin(), stop_words_text.size()));
+  search_server.MapIndex(std::move(index_file));
+  return search_server;
+}
+
+// Postings, terms and the forward index are used in place; only the
+// per-document columns and the id lookups are built in memory
+void SearchServer::MapIndex(std::shared_ptr<const MappedIndexFile> index_file) {
+  using namespace std::literals;
+  const auto meta = index_file->GetSection<IndexMeta>(IndexSection::META);
+  const auto term_offsets = index_file->GetSection<uint64_t>(IndexSection::TERM_OFFSETS);
+  const auto term_bytes = index_file->GetSection<char>(IndexSection::TERM_BYTES);
+  const auto displacements = index_file->GetSection<uint32_t>(IndexSection::PERFECT_HASH_DISPLACEMENTS);
+  const auto perfect_slots = index_file->GetSection<TermId>(IndexSection::PERFECT_HASH_SLOTS);
+  const auto sorted_term_block_offsets = index_file->GetSection<uint64_t>(IndexSection::SORTED_TERM_BLOCK_OFFSETS);
+  const auto sorted_term_bytes = index_file->GetSection<uint8_t>(IndexSection::SORTED_TERM_BYTES);
+  const auto document_freqs = index_file->GetSection<uint32_t>(IndexSection::DOCUMENT_FREQS);
+  const auto documents = index_file->GetSection<IndexDocument>(IndexSection::DOCUMENTS);
+  const auto posting_term_ids = index_file->GetSection<TermId>(IndexSection::POSTING_TERM_IDS);
+  const auto block_offsets = index_file->GetSection<uint64_t>(IndexSection::POSTING_BLOCK_OFFSETS);
+  const auto max_term_freqs = index_file->GetSection<double>(IndexSection::POSTING_MAX_TERM_FREQS);
+  const auto blocks = index_file->GetSection<PostingBlock>(IndexSection::POSTING_BLOCKS);
+  const auto words = index_file->GetSection<uint32_t>(IndexSection::POSTING_WORDS);
+  const auto inv_word_counts = index_file->GetSection<double>(IndexSection::INV_WORD_COUNTS);
+  const auto forward_offsets = index_file->GetSection<uint64_t>(IndexSection::FORWARD_OFFSETS);
+  const auto forward_terms = index_file->GetSection<TermCount>(IndexSection::FORWARD_TERMS);
+  const auto position_offsets = index_file->GetSection<uint64_t>(IndexSection::POSITION_OFFSETS);
+  const auto position_bytes = index_file->GetSection<uint8_t>(IndexSection::POSITION_BYTES);
+  const auto text_offsets = index_file->GetSection<uint64_t>(IndexSection::TEXT_OFFSETS);
+  const auto text_block_documents = index_file->GetSection<uint32_t>(IndexSection::TEXT_BLOCK_DOCUMENTS);
+  const auto text_block_offsets = index_file->GetSection<uint64_t>(IndexSection::TEXT_BLOCK_OFFSETS);
+  const auto text_bytes = index_file->GetSection<uint8_t>(IndexSection::TEXT_BYTES);
+  if (meta.size() != 1) {
+    throw std::runtime_error("Index file has no metadata"s);
+  }
+  const uint64_t document_count = meta.begin()->document_count;
+  const uint64_t term_count = meta.begin()->term_count;
+  const auto text_storage = static_cast<TextStorage>(meta.begin()->text_storage);
+  bool are_texts_consistent = meta.begin()->text_storage <= static_cast<uint64_t>(TextStorage::COMPRESSED)
+      && (text_storage == TextStorage::NONE || text_offsets.size() == document_count + 1);
+  if (text_storage == TextStorage::PLAIN) {
+    are_texts_consistent = are_texts_consistent && *(text_offsets.end() - 1) == text_bytes.size();
+  } else if (text_storage == TextStorage::COMPRESSED) {
+    are_texts_consistent = are_texts_consistent && text_block_documents.size() != 0
+        && text_block_offsets.size() == text_block_documents.size()
+        && *(text_block_documents.end() - 1) == document_count && *(text_block_offsets.end() - 1) == text_bytes.size();
+  }
+  if (term_offsets.size() != term_count + 1 || document_freqs.size() != term_count
+      || documents.size() != document_count || forward_offsets.size() != document_count + 1
+      || inv_word_counts.size() != document_count || block_offsets.size() != posting_term_ids.size() + 1
+      || max_term_freqs.size() != posting_term_ids.size()
+      || (position_offsets.size() != 0 && position_offsets.size() != document_count + 1)
+      || sorted_term_block_offsets.size() == 0
+      || *(sorted_term_block_offsets.end() - 1) != sorted_term_bytes.size() || !are_texts_consistent
+      || meta.begin()->duplicate_policy > static_cast<uint64_t>(DuplicatePolicy::REJECT)
+      || meta.begin()->max_simhash_distance > MAX_SIMHASH_DISTANCE) {
+    throw std::runtime_error("Index file sections do not match each other"s);
+  }
+  const auto check_section = [](bool is_valid, const std::string &name) {
+    if (!is_valid) {
+      throw std::runtime_error("Index file has a corrupt "s + name);
+    }
+  };
+  check_section(AreValidOffsets(term_offsets, term_bytes.size())
+                    && (displacements.size() == 0) == (perfect_slots.size() == 0)
+                    && std::all_of(perfect_slots.begin(), perfect_slots.end(), [term_count](TermId term_id) {
+                      return term_id == TermDictionary::NO_TERM || term_id < term_count;
+                    }), "term dictionary"s);
+  check_section(AreValidSortedTerms(sorted_term_block_offsets, sorted_term_bytes, term_count), "sorted term list"s);
+  check_section(std::all_of(documents.begin(), documents.end(), [](const IndexDocument &document) {
+    return IsValidStatus(static_cast<DocumentStatus>(document.status)) && document.is_removed <= 1;
+  }), "document table"s);
+  check_section(AreValidPostings(posting_term_ids, block_offsets, blocks, words, document_count, term_count),
+                "posting list"s);
+  check_section(AreValidOffsets(forward_offsets, forward_terms.size())
+                    && std::all_of(forward_terms.begin(), forward_terms.end(), [term_count](const TermCount &term) {
+                      return term.term_id < term_count;
+                    }), "forward index"s);
+  check_section(position_offsets.size() == 0 || AreValidPositions(position_offsets, position_bytes, term_count),
+                "positional index"s);
+  if (text_storage == TextStorage::PLAIN) {
+    check_section(AreValidOffsets(text_offsets, text_bytes.size()), "text store"s);
+  } else if (text_storage == TextStorage::COMPRESSED) {
+    // Offsets of the texts count uncompressed bytes
+    check_section(AreValidOffsets(text_offsets, *(text_offsets.end() - 1))
+                      && AreValidOffsets(text_block_offsets, text_bytes.size())
+                      && *text_block_documents.begin() == 0
+                      && std::is_sorted(text_block_documents.begin(), text_block_documents.end()), "text store"s);
+  }
+
+  TermDictionary::FrozenLayout dictionary_layout;
+  dictionary_layout.term_offsets = term_offsets.begin();
+  dictionary_layout.term_bytes = term_bytes.begin();
+  dictionary_layout.term_count = term_count;
+  dictionary_layout.perfect_hash_seed = meta.begin()->perfect_hash_seed;
+  dictionary_layout.displacements = displacements.begin();
+  dictionary_layout.displacement_count = displacements.size();
+  dictionary_layout.perfect_slots = perfect_slots.begin();
+  dictionary_layout.perfect_slot_count = perfect_slots.size();
+  dictionary_layout.sorted_terms = {sorted_term_block_offsets.begin(), sorted_term_bytes.begin(),
+                                    sorted_term_block_offsets.size() - 1};
+  dictionary_ = TermDictionary(dictionary_layout, index_file);
+
+  segments_.clear();
+  if (document_count > 0) {
+    const Segment::SealedLayout segment_layout = {posting_term_ids.begin(), block_offsets.begin(),
+                                                  max_term_freqs.begin(), blocks.begin(), words.begin(),
+                                                  inv_word_counts.begin(), posting_term_ids.size()};
+    segments_.push_back(std::make_shared<Segment>(0, document_count, segment_layout, index_file));
+  }
+  segments_.push_back(std::make_shared<Segment>(document_count));
+
+  document_attributes_.reserve(document_count);
+  live_statuses_.resize((document_count + 15) / 16);
+  uint64_t total_word_count = 0;
+  for (const IndexDocument &document : documents) {
+    const uint32_t document_index = document_attributes_.size();
+    uint32_t word_count = 0;
+    if (!document.is_removed) {
+      const uint64_t *offset = forward_offsets.begin() + document_index;
+      for (const TermCount *word = forward_terms.begin() + offset[0]; word != forward_terms.begin() + offset[1]; ++word) {
+        word_count += word->term_count;
+      }
+    }
+    document_attributes_.push_back({document.id, document.rating, static_cast<DocumentStatus>(document.status), word_count});
+    if (document.is_removed) {
+      segments_.front()->MarkRemoved(document_index);
+    } else {
+      SetLiveStatusBits(document_index, GetStatusBit(static_cast<DocumentStatus>(document.status)));
+      if (!documents_.emplace(document.id, DocumentData{document_index}).second) {
+        throw std::runtime_error("Index file has a corrupt document table"s);
+      }
+      document_ids_.insert(document.id);
+      total_word_count += word_count;
+    }
+  }
+  statistics_.Assign(std::vector<uint32_t>(document_freqs.begin(), document_freqs.end()), documents_.size(),
+                     total_word_count);
+  if (position_offsets.size() != 0) {
+    positional_index_ = std::make_unique<PositionalIndex>(position_offsets.begin(), position_bytes.begin(),
+                                                          document_count, index_file);
+  }
+  if (text_storage != TextStorage::NONE) {
+    const DocumentStore::Layout text_layout = {text_offsets.begin(), text_block_documents.begin(),
+                                               text_block_offsets.begin(), text_bytes.begin(),
+                                               static_cast<uint32_t>(document_count),
+                                               text_block_documents.size() == 0 ? 0 : text_block_documents.size() - 1};
+    document_store_ = std::make_unique<DocumentStore>(text_storage == TextStorage::COMPRESSED, text_layout, index_file);
+  }
+  mapped_forward_offsets_ = forward_offsets.begin();
+  mapped_forward_terms_ = forward_terms.begin();
+  mapped_document_count_ = document_count;
+  index_file_ = std::move(index_file);
+  duplicate_policy_ = static_cast<DuplicatePolicy>(meta.begin()->duplicate_policy);
+  if (duplicate_policy_ != DuplicatePolicy::KEEP) {
+    duplicate_index_ = std::make_unique<DuplicateIndex>(meta.begin()->max_simhash_distance);
+    for (const auto &[document_id, document] : documents_) {
+      const auto terms = GetDocumentTerms(document.index);
+      duplicate_index_->Add(ComputeFingerprint(terms.begin(), terms.end(), meta.begin()->max_simhash_distance > 0),
+                            document.index);
+    }
+  }
+}
+
+IteratorRange<const TermCount *> SearchServer::GetDocumentTerms(uint32_t document_index) const {
+  if (document_index < mapped_document_count_) {
+    return {mapped_forward_terms_ + mapped_forward_offsets_[document_index],
+            mapped_forward_terms_ + mapped_forward_offsets_[document_index + 1]};
+  }
+  const uint32_t offset = document_index - mapped_document_count_;
+  return {forward_terms_.data() + forward_offsets_[offset], forward_terms_.data() + forward_offsets_[offset + 1]};
+}
@@ -1,7 +1,23 @@
 #pragma once
 #include "string_processing.h"
 #include "document.h"
-#include "concurrent_map.h"
+#include "document_filter.h"
+#include "posting_list.h"
+#include "segment.h"
+#include "term_dictionary.h"
+#include "positional_index.h"
+#include "document_store.h"
+#include "duplicate_index.h"
+#include "memory_usage.h"
+#include "corpus_statistics.h"
+#include "top_documents.h"
+#include "max_score.h"
+#include "scoring.h"
+#include "score_accumulator.h"
+#include "query_arena.h"
+#include "query_result_arena.h"
+#include "query_result_cache.h"
+#include "index_file.h"
 
 #include <vector>
 #include <algorithm>
@@ -10,14 +26,52 @@
 #include <string>
 #include <stdexcept>
 #include <execution>
+#include <future>
+#include <memory>
+#include <memory_resource>
 #include <string_view>
+#include <numeric>
+#include <optional>
+#include <type_traits>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
+// A query word with '*' expands into at most this many terms
+const size_t MAX_WILDCARD_TERM_COUNT = 64;
+
+enum class TextStorage {
+  NONE,
+  PLAIN,
+  // In blocks of several documents, each compressed on its own
+  COMPRESSED,
+};
+
+// What adding a duplicate of a live document does
+enum class DuplicatePolicy {
+  KEEP,
+  // Leaves the duplicate out
+  SKIP,
+  // Throws std::invalid_argument
+  REJECT,
+};
+
+// What the index keeps besides the term frequencies
+struct IndexOptions {
+  // Word positions, needed by quoted phrases in queries
+  bool store_positions = false;
+  // Document texts, needed by GetDocumentText
+  TextStorage text_storage = TextStorage::NONE;
+  // A duplicate has the word set of a live document or, when
+  // max_simhash_distance is not zero, a SimHash of its word set at most that
+  // many bits away, up to MAX_SIMHASH_DISTANCE. Unless duplicates are kept,
+  // the server holds a hash index of the live documents' fingerprints.
+  DuplicatePolicy duplicates = DuplicatePolicy::KEEP;
+  uint32_t max_simhash_distance = 0;
+};
 
 class SearchServer {
  public:
   template<typename StringContainer>
-  explicit SearchServer(const StringContainer &stop_words)
+  explicit SearchServer(const StringContainer &stop_words, const IndexOptions &options = {})
       : stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
   {
     using namespace std::literals;
@@ -25,54 +79,170 @@ class SearchServer {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
       throw std::invalid_argument("Some of stop words are invalid"s);
     }
+    if (options.store_positions) {
+      positional_index_ = std::make_unique<PositionalIndex>();
+    }
+    if (options.text_storage != TextStorage::NONE) {
+      document_store_ = std::make_unique<DocumentStore>(options.text_storage == TextStorage::COMPRESSED);
+    }
+    if (options.duplicates != DuplicatePolicy::KEEP) {
+      duplicate_policy_ = options.duplicates;
+      duplicate_index_ = std::make_unique<DuplicateIndex>(options.max_simhash_distance);
+    }
   }
 
-  explicit SearchServer(const std::string &stop_words_text);
-  explicit SearchServer(const std::string_view &stop_words_text);
+  explicit SearchServer(const std::string &stop_words_text, const IndexOptions &options = {});
+  explicit SearchServer(const std::string_view &stop_words_text, const IndexOptions &options = {});
 
   void AddDocument(int document_id,
                    const std::string_view &document,
                    DocumentStatus status,
                    const std::vector<int> &ratings);
+  // Adds the documents in their order, as that many AddDocument calls would.
+  // The parallel version tokenizes, counts terms and builds whole segments on
+  // all threads, then records the documents in one sequential pass. When a
+  // document is rejected, those before it stay added and its invalid_argument
+  // is thrown.
+  void AddDocuments(const std::vector<DocumentInput> &documents);
+  void AddDocuments(const std::execution::sequenced_policy seq, const std::vector<DocumentInput> &documents);
+  void AddDocuments(const std::execution::parallel_policy par, const std::vector<DocumentInput> &documents);
 
-  template<typename DocumentPredicate>
+  // Scoring is a model of scoring.h, e.g. FindTopDocuments<Bm25Scoring>(raw_query, predicate).
+  // Words in double quotes form a phrase the documents must contain, or must
+  // not with a minus before the opening quote; phrase words still score as
+  // plus words. Phrases need a server storing positions. A word with '*',
+  // such as cat* or c*t, stands for the terms it matches that have documents,
+  // up to MAX_WILDCARD_TERM_COUNT of those in the most documents.
+  template<typename Scoring = TfIdfScoring, typename DocumentPredicate>
   std::vector<Document> FindTopDocuments(const std::string_view &raw_query,
-                                         DocumentPredicate document_predicate) const {
+                                         DocumentPredicate document_predicate,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const {
 
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    return FindTopDocuments<Scoring>(std::execution::seq, raw_query, document_predicate, top_k);
   }
-  template<typename DocumentPredicate, typename ExecutionPolicy>
+  template<typename Scoring = TfIdfScoring, typename DocumentPredicate, typename ExecutionPolicy>
   std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view &raw_query,
-                                         DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query);
-
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+                                         DocumentPredicate document_predicate,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const {
+    // Everything but the result lives in the arena of the calling thread
+    QueryArena &arena = QueryArena::ForCurrentThread();
+    const QueryArena::Scope scope(arena);
+    const Scoring scoring(statistics_);
+    const auto query = PrepareQuery(ParseQuery(raw_query, &arena), scoring, &arena);
 
-    std::sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document &lhs, const Document &rhs) {
-      if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-        return lhs.rating > rhs.rating;
-      } else {
-        return lhs.relevance > rhs.relevance;
-      }
-    });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-      matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+    const auto matched_documents = FindAllDocuments(policy, query, scoring, document_predicate, &arena);
 
-    return matched_documents;
+    return SelectTopDocuments(policy, matched_documents, top_k, &arena);
   }
 
-  std::vector<Document> FindTopDocuments(const std::string_view &raw_query, DocumentStatus status) const;
+  std::vector<Document> FindTopDocuments(const std::string_view &raw_query,
+                                         DocumentStatus status,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
   std::vector<Document> FindTopDocuments(const std::string_view &raw_query) const;
   std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy seq,
                                          const std::string_view &raw_query,
-                                         DocumentStatus status) const;
+                                         DocumentStatus status,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
   std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy seq, const std::string_view &raw_query) const;
   std::vector<Document> FindTopDocuments(const std::execution::parallel_policy par,
                                          const std::string_view &raw_query,
-                                         DocumentStatus status) const;
+                                         DocumentStatus status,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
   std::vector<Document> FindTopDocuments(const std::execution::parallel_policy par, const std::string_view &raw_query) const;
+  // Same results as FindTopDocuments, but skips documents that can not reach the top
+  template<typename Scoring = TfIdfScoring, typename DocumentPredicate>
+  std::vector<Document> FindTopDocumentsPruned(const std::string_view &raw_query,
+                                               DocumentPredicate document_predicate,
+                                               size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const {
+    if (top_k == 0) {
+      return {};
+    }
+    QueryArena &arena = QueryArena::ForCurrentThread();
+    const QueryArena::Scope scope(arena);
+    const Scoring scoring(statistics_);
+    const auto query = PrepareQuery(ParseQuery(raw_query, &arena), scoring, &arena);
+
+    // Segments cover ascending ranges, so the top_k threshold reached in one
+    // segment carries over to prune the next
+    TopDocuments top_documents(top_k, &arena);
+    std::pmr::vector<ScoredTerm> plus_terms(&arena);
+    std::pmr::vector<PostingList> minus_terms(&arena);
+    for (const auto &segment : segments_) {
+      ResolveSegmentTerms(*segment, query, scoring, plus_terms, minus_terms);
+      if (plus_terms.empty()) {
+        continue;
+      }
+      const QueryArena::Scope segment_scope(arena);
+      PhraseDocuments phrase_documents{std::pmr::vector<uint32_t>(&arena), std::pmr::vector<uint32_t>(&arena)};
+      if (!query.phrases.empty()) {
+        phrase_documents = FindPhraseDocuments(*segment, query, segment->GetFirstIndex(), segment->GetEndIndex(), &arena);
+      }
+      CollectTopDocumentsByMaxScore(plus_terms, minus_terms, [&](const Posting &posting, double term_weight) {
+        return scoring.Score(posting, document_attributes_[posting.document_index].word_count, term_weight);
+      }, [&](uint32_t document_index) {
+        return AcceptsDocument(*segment, document_index, document_predicate)
+            && (query.phrases.empty() || phrase_documents.Accepts(document_index));
+      }, [&](uint32_t document_index, double relevance) {
+        const auto &attributes = document_attributes_[document_index];
+        return Document{attributes.id, relevance, attributes.rating};
+      }, top_documents, &arena);
+    }
+    return std::move(top_documents).Extract();
+  }
+  std::vector<Document> FindTopDocumentsPruned(const std::string_view &raw_query,
+                                               DocumentStatus status = DocumentStatus::ACTUAL,
+                                               size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+  // Plus terms of the query with live documents here and their document
+  // freqs, for weighting the query over several servers
+  std::vector<std::pair<std::string_view, uint32_t>> GetQueryDocumentFreqs(const std::string_view &raw_query) const;
+  // FindTopDocuments with TF-IDF, where the IDF of a plus term is
+  // inverse_document_freq(term) rather than the one of this server, e.g. the
+  // IDF over a collection this server holds part of
+  template<typename InverseDocumentFreq, typename DocumentPredicate>
+  std::vector<Document> FindTopDocumentsWithIdf(const std::string_view &raw_query,
+                                                InverseDocumentFreq inverse_document_freq,
+                                                DocumentPredicate document_predicate,
+                                                size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const {
+    QueryArena &arena = QueryArena::ForCurrentThread();
+    const QueryArena::Scope scope(arena);
+    const TfIdfScoring scoring(statistics_);
+    auto query = PrepareQuery(ParseQuery(raw_query, &arena), scoring, &arena);
+    for (auto &term : query.plus_terms) {
+      term.term_weight = inverse_document_freq(dictionary_.GetTerm(term.term_id));
+    }
+
+    const auto matched_documents = FindAllDocuments(std::execution::seq, query, scoring, document_predicate, &arena);
+
+    return SelectTopDocuments(std::execution::seq, matched_documents, top_k, &arena);
+  }
+
+  // Keeps the results of up to capacity recent queries for FindTopDocumentsCached
+  void EnableResultCache(size_t capacity, size_t shard_count = 16);
+  // FindTopDocuments served from the result cache when it is enabled. Queries
+  // that parse to the same terms share an entry; any added or removed
+  // document invalidates every entry.
+  std::vector<Document> FindTopDocumentsCached(const std::string_view &raw_query,
+                                               DocumentStatus status = DocumentStatus::ACTUAL,
+                                               size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+  // All zeros while the cache is disabled
+  QueryCacheStats GetResultCacheStats() const;
+
+  // Runs every query of the batch with the given status. Terms shared by
+  // several queries are resolved and weighted once for the whole batch.
+  void FindTopDocumentsBatch(const std::vector<std::string> &raw_queries,
+                             QueryResultArena &results,
+                             DocumentStatus status = DocumentStatus::ACTUAL,
+                             size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+  void FindTopDocumentsBatch(std::vector<std::string>::const_iterator first_query,
+                             std::vector<std::string>::const_iterator last_query,
+                             QueryResultArena &results,
+                             DocumentStatus status = DocumentStatus::ACTUAL,
+                             size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
   int GetDocumentCount() const;
+  // Document count, lengths and document freqs of the live documents, with cached IDF
+  const CorpusStatistics &GetCorpusStatistics() const;
   std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view &raw_query,
                                                                           int document_id) const;
   std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy seq,
@@ -83,27 +253,129 @@ class SearchServer {
                                                                           int document_id) const;
   std::set<int>::const_iterator begin() const;
   std::set<int>::const_iterator end() const;
-  const std::map<std::string_view, double, std::less<>> &GetWordFrequencies(int document_id) const;
+  std::map<std::string_view, double, std::less<>> GetWordFrequencies(int document_id) const;
+  // The text the document was added with; needs a server storing texts
+  std::string GetDocumentText(int document_id) const;
+  // Hash of the document's word set and SimHash of it, comparable
+  // between documents of this server
+  DocumentFingerprint GetDocumentFingerprint(int document_id) const;
   void RemoveDocument(int document_id);
   void RemoveDocument(const std::execution::sequenced_policy seq, int document_id);
   void RemoveDocument(const std::execution::parallel_policy par, int document_id);
+  // Removes the documents with the given ids, skipping unknown ones. Removed
+  // documents are only marked in the bitmaps of their segments, which every
+  // posting walk checks; merges drop their postings later, and a segment
+  // mostly of removed documents is rewritten in the background. The parallel
+  // version updates the document freqs on all threads, each over its own
+  // range of terms.
+  void RemoveDocuments(const std::vector<int> &document_ids);
+  void RemoveDocuments(const std::execution::sequenced_policy seq, const std::vector<int> &document_ids);
+  void RemoveDocuments(const std::execution::parallel_policy par, const std::vector<int> &document_ids);
+  // Drops the postings of removed documents from every sealed segment, the
+  // segments being rewritten in parallel, and their terms from the forward
+  // index, and empties their positions and texts added since the index was
+  // loaded. Their attributes, status bits and offsets, and whatever is read
+  // in place, stay until the index is saved and loaded again.
+  void Compact();
+  // Switches term lookups to a perfect hash until a new term is added
+  void FreezeTermDictionary();
+  // Blocks until background merges are done and installed
+  void WaitForMerges();
+  size_t GetSegmentCount() const;
+  // Postings of removed documents count until their segment is merged
+  size_t GetPostingCount() const;
+  size_t GetPostingByteCount() const;
+  // Zero unless the server stores positions
+  size_t GetPositionByteCount() const;
+  MemoryUsage GetMemoryUsage() const;
+
+  // Writes the index, without removed documents' postings, to a binary file
+  void SaveIndex(const std::string &path) const;
+  // Maps a file written by SaveIndex and serves queries straight from the
+  // mapped pages. The file must not change while the server is alive.
+  static SearchServer LoadIndex(const std::string &path, bool verify_checksums = true);
 
  private:
+  // The active segment takes documents until it holds SEGMENT_DOCUMENT_COUNT;
+  // every MERGE_FACTOR adjacent sealed segments of one size are merged
+  static constexpr size_t SEGMENT_DOCUMENT_COUNT = 1024;
+  static constexpr size_t MERGE_FACTOR = 4;
+
   struct DocumentData {
+    uint32_t index;
+  };
+  // Dense per-document column read on every posting walk
+  struct DocumentAttributes {
+    int id;
     int rating;
     DocumentStatus status;
-    std::string doc_text;
+    // Without stop words, for length-normalizing scoring models
+    uint32_t word_count;
   };
   const std::set<std::string, std::less<>> stop_words_;
-  std::map<std::string_view, std::map<int, double>, std::less<>> word_to_document_freqs_;
+  TermDictionary dictionary_;
+  // Global statistics of the live documents behind IDF
+  CorpusStatistics statistics_;
+  // Sealed segments in index order, the active one last
+  std::vector<std::shared_ptr<Segment>> segments_{std::make_shared<Segment>(0)};
+  // The merge in flight replaces merge_segment_count_ segments from merge_position_
+  std::future<std::shared_ptr<Segment>> pending_merge_;
+  size_t merge_position_ = 0;
+  size_t merge_segment_count_ = 0;
+  // Forward index of the documents loaded from index_file_
+  std::shared_ptr<const MappedIndexFile> index_file_;
+  const uint64_t *mapped_forward_offsets_ = nullptr;
+  const TermCount *mapped_forward_terms_ = nullptr;
+  uint32_t mapped_document_count_ = 0;
+  // Forward index of the documents added since: the terms of document
+  // mapped_document_count_ + i, by term id, are forward_terms_[forward_offsets_[i]] ..
+  // forward_terms_[forward_offsets_[i + 1]]. Removed documents keep theirs.
+  std::vector<uint64_t> forward_offsets_{0};
+  std::vector<TermCount> forward_terms_;
   std::map<int, DocumentData> documents_;
+  std::unique_ptr<QueryResultCache> result_cache_;
+  // Only with IndexOptions::store_positions
+  std::unique_ptr<PositionalIndex> positional_index_;
+  // Only with IndexOptions::text_storage
+  std::unique_ptr<DocumentStore> document_store_;
+  // Fingerprints of the live documents, unless duplicates are kept
+  DuplicatePolicy duplicate_policy_ = DuplicatePolicy::KEEP;
+  std::unique_ptr<DuplicateIndex> duplicate_index_;
+  std::vector<DocumentAttributes> document_attributes_;
+  // Bitmaps of the live documents by status, interleaved: four bits per
+  // document, sixteen documents per word, holding GetStatusBit of its status
+  // until the document is removed
+  std::vector<uint64_t> live_statuses_;
   std::set<int> document_ids_;
-  std::map<int, std::map<std::string_view, double, std::less<>>> id_to_words_freqs_;
 
   bool IsStopWord(const std::string_view &word) const;
   static bool IsValidWord(const std::string_view &word);
-  std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view &text) const;
+  // The words live in the splitter of the current thread until its next Split.
+  // positions, if given, gets the place of every word among all words of the text.
+  const std::vector<std::string_view> &SplitIntoWordsNoStop(const std::string_view &text,
+                                                            std::vector<uint32_t> *positions = nullptr) const;
   static int ComputeAverageRating(const std::vector<int> &ratings);
+  uint32_t GetLiveStatusBits(uint32_t document_index) const {
+    return (live_statuses_[document_index / 16] >> (document_index % 16 * 4)) & 0xf;
+  }
+  // Sets or clears the status bits of a document
+  void SetLiveStatusBits(uint32_t document_index, uint32_t status_bits);
+  // Sorts the term ids of a document and sums the term frequencies
+  static std::vector<TermFrequency> CountTermFrequencies(std::vector<TermId> &term_ids);
+  // Everything AddDocument records once the postings are in a segment
+  void RegisterDocument(int document_id,
+                        const std::string_view &text,
+                        DocumentStatus status,
+                        const std::vector<int> &ratings,
+                        const std::vector<TermFrequency> &word_freqs);
+  // Forgets the id and marks the document removed in its segment; the index
+  // of the document, unless the id is unknown
+  std::optional<uint32_t> UnregisterDocument(int document_id);
+  // With the SimHash only if the duplicate index needs it
+  DocumentFingerprint FingerprintDocument(const std::vector<TermFrequency> &word_freqs) const;
+  // The index of the live document the fingerprint duplicates, if any;
+  // otherwise indexes the fingerprint as the one of document_index
+  std::optional<uint32_t> IndexFingerprint(const DocumentFingerprint &fingerprint, uint32_t document_index);
 
   struct QueryWord {
     std::string_view data;
@@ -113,82 +385,275 @@ class SearchServer {
 
   QueryWord ParseQueryWord(const std::string_view &text) const;
 
+  // Quoted phrase of a query, made of phrase_terms[first_term .. last_term)
+  struct QueryPhrase {
+    uint32_t first_term;
+    uint32_t last_term;
+    bool is_minus;
+  };
+
+  // Known terms only, unique and ordered by their text. Phrase terms keep
+  // their order and may be unknown, then the phrase matches nothing.
   struct Query {
-    std::set<std::string_view> plus_words;
-    std::set<std::string_view> minus_words;
+    std::pmr::vector<TermId> plus_words;
+    std::pmr::vector<TermId> minus_words;
+    std::pmr::vector<PhraseTerm> phrase_terms;
+    std::pmr::vector<QueryPhrase> phrases;
   };
 
-  Query ParseQuery(const std::string_view &text) const;
-  // Existence required
-  double ComputeWordInverseDocumentFreq(const std::string_view &word) const;
+  Query ParseQuery(const std::string_view &text, std::pmr::memory_resource *resource) const;
+  // Appends the terms matching a pattern with '*' and a prefix before it
+  void ExpandWildcard(const std::string_view &pattern, std::pmr::vector<TermId> &term_ids) const;
+  // Appends a word of the open phrase, the last one of the query
+  void ParsePhraseWord(const std::string_view &word, uint32_t offset, Query &query) const;
 
-  template<typename DocumentPredicate>
-  std::vector<Document> FindAllDocuments(const Query &query, DocumentPredicate document_predicate) const{
-    return FindAllDocuments(std::execution::seq, query, document_predicate);
-  }
+  struct WeightedTerm {
+    TermId term_id;
+    double term_weight;
+  };
 
-  template<typename DocumentPredicate>
-  std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy seq, const Query &query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view &word : query.plus_words) {
-      if (word_to_document_freqs_.count(word) == 0) {
-        continue;
+  // Query terms with live documents, plus terms with their weight in the scoring model
+  struct PreparedQuery {
+    std::pmr::vector<WeightedTerm> plus_terms;
+    std::pmr::vector<TermId> minus_terms;
+    std::pmr::vector<PhraseTerm> phrase_terms;
+    std::pmr::vector<QueryPhrase> phrases;
+  };
+
+  template<typename Scoring>
+  PreparedQuery PrepareQuery(const Query &query, const Scoring &scoring, std::pmr::memory_resource *resource) const {
+    PreparedQuery result{std::pmr::vector<WeightedTerm>(resource), std::pmr::vector<TermId>(resource),
+                         std::pmr::vector<PhraseTerm>(query.phrase_terms, resource),
+                         std::pmr::vector<QueryPhrase>(query.phrases, resource)};
+    for (const TermId word : query.plus_words) {
+      if (statistics_.GetDocumentFreq(word) != 0) {
+        result.plus_terms.push_back({word, scoring.GetTermWeight(word)});
       }
-      const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-      for (const auto[document_id, term_freq] : word_to_document_freqs_.at(word)) {
-        const auto &document_data = documents_.at(document_id);
-        if (document_predicate(document_id, document_data.status, document_data.rating)) {
-          document_to_relevance[document_id] += term_freq * inverse_document_freq;
-        }
+    }
+    for (const TermId word : query.minus_words) {
+      if (statistics_.GetDocumentFreq(word) != 0) {
+        result.minus_terms.push_back(word);
       }
     }
+    return result;
+  }
 
-    for (const std::string_view &word : query.minus_words) {
-      if (word_to_document_freqs_.count(word) == 0) {
-        continue;
+  void SortUniqueTerms(std::pmr::vector<TermId> &term_ids) const;
+
+  // Posting lists of the query terms present in the segment
+  template<typename Scoring>
+  static void ResolveSegmentTerms(const Segment &segment,
+                                  const PreparedQuery &query,
+                                  const Scoring &scoring,
+                                  std::pmr::vector<ScoredTerm> &plus_terms,
+                                  std::pmr::vector<PostingList> &minus_terms) {
+    plus_terms.clear();
+    minus_terms.clear();
+    for (const auto &[term_id, term_weight] : query.plus_terms) {
+      const PostingList postings = segment.FindPostings(term_id);
+      if (!postings.empty()) {
+        plus_terms.push_back({postings, term_weight, scoring.GetUpperBound(postings.GetMaxTermFreq(), term_weight)});
       }
-      for (const auto[document_id, _] : word_to_document_freqs_.at(word)) {
-        document_to_relevance.erase(document_id);
+    }
+    for (const TermId term_id : query.minus_terms) {
+      const PostingList postings = segment.FindPostings(term_id);
+      if (!postings.empty()) {
+        minus_terms.push_back(postings);
       }
     }
+  }
+
+  // Documents of a range of one segment decided by the phrases of a query, ascending
+  struct PhraseDocuments {
+    // Containing every plus phrase, if the query has one
+    std::pmr::vector<uint32_t> required;
+    // Containing some minus phrase
+    std::pmr::vector<uint32_t> excluded;
+    bool has_plus_phrase = false;
+
+    bool Accepts(uint32_t document_index) const {
+      return (!has_plus_phrase || std::binary_search(required.begin(), required.end(), document_index))
+          && !std::binary_search(excluded.begin(), excluded.end(), document_index);
+    }
+  };
+
+  PhraseDocuments FindPhraseDocuments(const Segment &segment,
+                                      const PreparedQuery &query,
+                                      uint32_t first_index,
+                                      uint32_t last_index,
+                                      std::pmr::memory_resource *resource) const;
+  // Working state lives in the arena of the current thread until the call returns
+  bool ContainsPhrase(uint32_t document_index,
+                      const std::pmr::vector<PhraseTerm> &phrase_terms,
+                      const QueryPhrase &phrase) const;
+  // Whether the document has every plus phrase of the query and no minus one
+  bool MatchesPhrases(uint32_t document_index, const Query &query) const;
+
+  // Segment whose range contains the document index
+  std::vector<std::shared_ptr<Segment>>::const_iterator FindSegment(uint32_t document_index) const;
+  static bool ContainsWord(const Segment &segment, TermId term_id, uint32_t document_index);
+  IteratorRange<const TermCount *> GetDocumentTerms(uint32_t document_index) const;
+  void MapIndex(std::shared_ptr<const MappedIndexFile> index_file);
+  void SealActiveSegment();
+  void ScheduleMerge();
+  // Merges segment_count sealed segments from first in the background
+  void StartMerge(size_t first, size_t segment_count);
+  void InstallMerge(bool wait);
+  uint32_t GetParallelRangeCount() const;
 
-    std::vector<Document> matched_documents;
-    for (const auto[document_id, relevance] : document_to_relevance) {
-      matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+  // The matched documents are allocated from resource
+  template<typename Scoring, typename DocumentPredicate>
+  std::pmr::vector<Document> FindAllDocuments(const PreparedQuery &query, const Scoring &scoring,
+                                              DocumentPredicate document_predicate,
+                                              std::pmr::memory_resource *resource) const{
+    return FindAllDocuments(std::execution::seq, query, scoring, document_predicate, resource);
+  }
+
+  template<typename Scoring, typename DocumentPredicate>
+  std::pmr::vector<Document> FindAllDocuments(const std::execution::sequenced_policy seq, const PreparedQuery &query,
+                                              const Scoring &scoring,
+                                              DocumentPredicate document_predicate,
+                                              std::pmr::memory_resource *resource) const {
+    return FindDocumentsInRange(query, scoring, document_predicate, 0, document_attributes_.size(), resource);
+  }
+
+  template<typename Scoring, typename DocumentPredicate>
+  std::pmr::vector<Document> FindAllDocuments(const std::execution::parallel_policy par,
+                                              const PreparedQuery &query,
+                                              const Scoring &scoring,
+                                              DocumentPredicate document_predicate,
+                                              std::pmr::memory_resource *resource) const {
+    // Every range of document numbers is scored by its own task into its own
+    // accumulator, so threads share nothing and sums keep the sequential order
+    const uint32_t document_count = document_attributes_.size();
+    const uint32_t range_count = GetParallelRangeCount();
+    const uint32_t range_size = (document_count + range_count - 1) / range_count;
+    std::vector<uint32_t> ranges(range_count);
+    std::iota(ranges.begin(), ranges.end(), 0);
+    // Tasks run on other threads, so their results go to the shared heap
+    std::vector<std::pmr::vector<Document>> range_documents(range_count);
+    std::for_each(par, ranges.begin(), ranges.end(), [&](uint32_t range) {
+      const uint32_t first = std::min(range * range_size, document_count);
+      const uint32_t last = std::min(first + range_size, document_count);
+      range_documents[range] = FindDocumentsInRange(query, scoring, document_predicate, first, last,
+                                                    std::pmr::get_default_resource());
+    });
+
+    std::pmr::vector<Document> matched_documents(resource);
+    for (const auto &documents : range_documents) {
+      matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
     }
     return matched_documents;
   }
 
+  // Whether a document of the segment is live and passes the predicate. A
+  // DocumentFilter reads the live status bits, and the rating only when it
+  // has a range; other predicates see the attributes of every live document.
   template<typename DocumentPredicate>
-  std::vector<Document> FindAllDocuments(const std::execution::parallel_policy par,
-                                         const Query &query,
-                                         DocumentPredicate document_predicate) const {
-
-    ConcurrentMap<int, double> document_to_relevance(3);
-    std::for_each(par, query.plus_words.begin(), query.plus_words.end(), [&](const auto &word) {
-      if (word_to_document_freqs_.count(word) != 0) {
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto[document_id, term_freq] : word_to_document_freqs_.at(word)) {
-          const auto &document_data = documents_.at(document_id);
-          if (document_predicate(document_id, document_data.status, document_data.rating)) {
-            document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-          }
+  bool AcceptsDocument(const Segment &segment, uint32_t document_index,
+                       const DocumentPredicate &document_predicate) const {
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+      if ((GetLiveStatusBits(document_index) & document_predicate.status_mask) == 0) {
+        return false;
+      }
+      if (!document_predicate.HasRatingRange()) {
+        return true;
+      }
+      const int rating = document_attributes_[document_index].rating;
+      return rating >= document_predicate.min_rating && rating <= document_predicate.max_rating;
+    } else {
+      if (segment.IsRemoved(document_index)) {
+        return false;
+      }
+      const auto &attributes = document_attributes_[document_index];
+      return document_predicate(attributes.id, attributes.status, attributes.rating);
+    }
+  }
+
+  // Applies the phrases of the query to a range of the segment. With a plus
+  // phrase only the documents having it are scored, and true is returned.
+  // Kept out of line, so that the loop of queries without phrases stays tight.
+  template<typename Scoring, typename DocumentPredicate>
+  __attribute__((noinline)) bool ScorePhraseDocuments(const Segment &segment,
+                            const PreparedQuery &query,
+                            const Scoring &scoring,
+                            DocumentPredicate document_predicate,
+                            uint32_t first_index,
+                            uint32_t last_index,
+                            ScoreAccumulator &accumulator) const {
+    // Phrase state is dropped before the caller allocates its result from the same arena
+    QueryArena &arena = QueryArena::ForCurrentThread();
+    const QueryArena::Scope scope(arena);
+    const PhraseDocuments phrase_documents = FindPhraseDocuments(segment, query, first_index, last_index, &arena);
+    for (const uint32_t document_index : phrase_documents.excluded) {
+      accumulator.Exclude(document_index);
+    }
+    if (!phrase_documents.has_plus_phrase) {
+      return false;
+    }
+    // Posting lists are only probed for the documents with the plus phrases
+    for (const auto &[term_id, term_weight] : query.plus_terms) {
+      PostingCursor cursor(segment.FindPostings(term_id), first_index);
+      for (const uint32_t document_index : phrase_documents.required) {
+        cursor.AdvanceTo(document_index);
+        if (cursor.IsEnd()) {
+          break;
+        }
+        if (cursor->document_index != document_index || accumulator.IsExcluded(document_index)
+            || !AcceptsDocument(segment, document_index, document_predicate)) {
+          continue;
         }
+        accumulator.Add(document_index,
+                        scoring.Score(*cursor, document_attributes_[document_index].word_count, term_weight));
       }
-    });
+    }
+    return true;
+  }
 
-    std::for_each(par, query.minus_words.begin(), query.minus_words.end(), [&](const auto &word) {
-      if (word_to_document_freqs_.count(word) != 0) {
-        for (const auto[document_id, _] : word_to_document_freqs_.at(word)) {
-          document_to_relevance.Erase(document_id);
+  template<typename Scoring, typename DocumentPredicate>
+  std::pmr::vector<Document> FindDocumentsInRange(const PreparedQuery &query,
+                                                  const Scoring &scoring,
+                                                  DocumentPredicate document_predicate,
+                                                  uint32_t first_index,
+                                                  uint32_t last_index,
+                                                  std::pmr::memory_resource *resource) const {
+    ScoreAccumulator &accumulator = ScoreAccumulator::ForCurrentThread();
+    accumulator.Reset(first_index, last_index - first_index);
+
+    // A document lives in exactly one segment, so its relevance is still summed in plus_terms order
+    for (auto it_segment = FindSegment(first_index);
+         it_segment != segments_.end() && (*it_segment)->GetFirstIndex() < last_index; ++it_segment) {
+      const Segment &segment = **it_segment;
+      for (const TermId term_id : query.minus_terms) {
+        PostingCursor cursor(segment.FindPostings(term_id), first_index);
+        for (; !cursor.IsEnd() && cursor->document_index < last_index; cursor.Next()) {
+          accumulator.Exclude(cursor->document_index);
         }
       }
-    });
 
-    std::vector<Document> matched_documents;
-    for (const auto[document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-      matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+      if (!query.phrases.empty()
+          && ScorePhraseDocuments(segment, query, scoring, document_predicate, first_index, last_index, accumulator)) {
+        continue;
+      }
+
+      for (const auto &[term_id, term_weight] : query.plus_terms) {
+        PostingCursor cursor(segment.FindPostings(term_id), first_index);
+        for (; !cursor.IsEnd() && cursor->document_index < last_index; cursor.Next()) {
+          if (accumulator.IsExcluded(cursor->document_index)
+              || !AcceptsDocument(segment, cursor->document_index, document_predicate)) {
+            continue;
+          }
+          accumulator.Add(cursor->document_index,
+                          scoring.Score(*cursor, document_attributes_[cursor->document_index].word_count, term_weight));
+        }
+      }
     }
+
+    std::pmr::vector<Document> matched_documents(resource);
+    accumulator.ForEach([&](uint32_t document_index, double relevance) {
+      const auto &attributes = document_attributes_[document_index];
+      matched_documents.push_back({attributes.id, relevance, attributes.rating});
+    });
     return matched_documents;
   }
 };
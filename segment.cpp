@@ -0,0 +1,242 @@
+#include "segment.h"
+
+#include <algorithm>
+#include <numeric>
+
+Segment::Segment(uint32_t first_index)
+    : first_index_(first_index) {
+}
+
+Segment::Segment(uint32_t first_index,
+                 uint32_t document_count,
+                 const SealedLayout &layout,
+                 std::shared_ptr<const void> storage)
+    : first_index_(first_index)
+    , document_count_(document_count)
+    , is_sealed_(true)
+    , removed_bits_((document_count + 63) / 64, 0)
+    , layout_(layout)
+    , storage_(std::move(storage)) {
+}
+
+void Segment::AddDocument(uint32_t document_index, const std::vector<TermFrequency> &word_freqs) {
+  uint32_t word_count = 0;
+  for (const auto &[term_id, term_count, term_freq] : word_freqs) {
+    const auto [it, inserted] = term_slots_.emplace(term_id, active_postings_.size());
+    if (inserted) {
+      active_term_ids_.push_back(term_id);
+      active_postings_.emplace_back();
+      active_max_term_freqs_.push_back(0.0);
+    }
+    active_postings_[it->second].push_back({document_index, term_count, term_freq});
+    active_max_term_freqs_[it->second] = std::max(active_max_term_freqs_[it->second], term_freq);
+    word_count += term_count;
+  }
+  inv_word_counts_.push_back(1.0 / word_count);
+  ++document_count_;
+  if (removed_bits_.size() * 64 < document_count_) {
+    removed_bits_.push_back(0);
+  }
+}
+
+void Segment::Seal() {
+  std::vector<uint32_t> order(active_term_ids_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+    return active_term_ids_[lhs] < active_term_ids_[rhs];
+  });
+  term_ids_.reserve(order.size());
+  max_term_freqs_.reserve(order.size());
+  block_offsets_.reserve(order.size() + 1);
+  for (const uint32_t slot : order) {
+    AppendSealedTerm(active_term_ids_[slot], active_postings_[slot]);
+  }
+  active_term_ids_ = {};
+  active_postings_ = {};
+  active_max_term_freqs_ = {};
+  term_slots_ = {};
+  FinishSealedLayout();
+}
+
+bool Segment::IsSealed() const {
+  return is_sealed_;
+}
+
+uint32_t Segment::GetFirstIndex() const {
+  return first_index_;
+}
+
+uint32_t Segment::GetEndIndex() const {
+  return first_index_ + document_count_;
+}
+
+size_t Segment::GetDocumentCount() const {
+  return document_count_;
+}
+
+size_t Segment::GetRemovedCount() const {
+  return removed_count_;
+}
+
+size_t Segment::GetPendingRemovalCount() const {
+  return removed_count_ - dropped_count_;
+}
+
+PostingList Segment::FindPostings(TermId term_id) const {
+  if (!is_sealed_) {
+    const auto it = term_slots_.find(term_id);
+    if (it == term_slots_.end()) {
+      return {};
+    }
+    const auto &postings = active_postings_[it->second];
+    return {postings.data(), postings.data() + postings.size(), active_max_term_freqs_[it->second]};
+  }
+  const TermId *last = layout_.term_ids + layout_.term_count;
+  const TermId *it = std::lower_bound(layout_.term_ids, last, term_id);
+  if (it == last || *it != term_id) {
+    return {};
+  }
+  return GetSealedPostings(it - layout_.term_ids);
+}
+
+size_t Segment::GetPostingCount() const {
+  size_t posting_count = 0;
+  if (!is_sealed_) {
+    for (const auto &postings : active_postings_) {
+      posting_count += postings.size();
+    }
+    return posting_count;
+  }
+  for (size_t term = 0; term < layout_.term_count; ++term) {
+    posting_count += GetSealedPostings(term).size();
+  }
+  return posting_count;
+}
+
+size_t Segment::GetPostingByteCount() const {
+  size_t byte_count = 0;
+  if (!is_sealed_) {
+    for (const auto &postings : active_postings_) {
+      byte_count += postings.size() * sizeof(Posting);
+    }
+    return byte_count;
+  }
+  for (size_t term = 0; term < layout_.term_count; ++term) {
+    byte_count += GetSealedPostings(term).GetByteCount();
+  }
+  return byte_count + document_count_ * sizeof(double);
+}
+
+void Segment::MarkRemoved(uint32_t document_index) {
+  const uint32_t offset = document_index - first_index_;
+  uint64_t &word = removed_bits_[offset / 64];
+  const uint64_t bit = uint64_t{1} << (offset % 64);
+  if ((word & bit) == 0) {
+    word |= bit;
+    ++removed_count_;
+  }
+}
+
+void Segment::MarkRemovedFrom(const Segment &segment) {
+  for (uint32_t document_index = segment.GetFirstIndex(); document_index < segment.GetEndIndex(); ++document_index) {
+    if (segment.IsRemoved(document_index)) {
+      MarkRemoved(document_index);
+    }
+  }
+}
+
+const std::vector<uint64_t> &Segment::GetRemovedBits() const {
+  return removed_bits_;
+}
+
+std::shared_ptr<Segment> Segment::Merge(const std::vector<std::shared_ptr<const Segment>> &segments,
+                                        const std::vector<std::vector<uint64_t>> &removed_bits) {
+  auto merged = std::make_shared<Segment>(segments.front()->GetFirstIndex());
+  merged->document_count_ = segments.back()->GetEndIndex() - merged->first_index_;
+  merged->removed_bits_.assign((merged->document_count_ + 63) / 64, 0);
+  for (const auto &segment : segments) {
+    const double *inv_word_counts = segment->layout_.inv_word_counts;
+    merged->inv_word_counts_.insert(merged->inv_word_counts_.end(), inv_word_counts,
+                                    inv_word_counts + segment->GetDocumentCount());
+  }
+  const auto is_removed = [&](size_t segment, uint32_t document_index) {
+    const uint32_t offset = document_index - segments[segment]->GetFirstIndex();
+    return (removed_bits[segment][offset / 64] >> (offset % 64)) & 1;
+  };
+  for (size_t segment = 0; segment < segments.size(); ++segment) {
+    for (uint32_t index = segments[segment]->GetFirstIndex(); index < segments[segment]->GetEndIndex(); ++index) {
+      if (is_removed(segment, index)) {
+        merged->MarkRemoved(index);
+      }
+    }
+  }
+  merged->dropped_count_ = merged->removed_count_;
+
+  // Terms of every segment are sorted, so their union is a k-way merge; the
+  // ranges are adjacent, so postings concatenated in segment order stay sorted
+  std::vector<size_t> positions(segments.size(), 0);
+  std::vector<Posting> postings;
+  while (true) {
+    TermId term_id = TermDictionary::NO_TERM;
+    for (size_t segment = 0; segment < segments.size(); ++segment) {
+      const SealedLayout &layout = segments[segment]->layout_;
+      if (positions[segment] < layout.term_count) {
+        term_id = std::min(term_id, layout.term_ids[positions[segment]]);
+      }
+    }
+    if (term_id == TermDictionary::NO_TERM) {
+      break;
+    }
+    postings.clear();
+    for (size_t segment = 0; segment < segments.size(); ++segment) {
+      const SealedLayout &layout = segments[segment]->layout_;
+      size_t &position = positions[segment];
+      if (position == layout.term_count || layout.term_ids[position] != term_id) {
+        continue;
+      }
+      for (PostingCursor cursor(segments[segment]->GetSealedPostings(position)); !cursor.IsEnd(); cursor.Next()) {
+        if (!is_removed(segment, cursor->document_index)) {
+          postings.push_back(*cursor);
+        }
+      }
+      ++position;
+    }
+    if (!postings.empty()) {
+      merged->AppendSealedTerm(term_id, postings);
+    }
+  }
+  merged->FinishSealedLayout();
+  return merged;
+}
+
+PostingList Segment::GetSealedPostings(size_t term) const {
+  return {layout_.blocks + layout_.block_offsets[term],
+          layout_.blocks + layout_.block_offsets[term + 1],
+          layout_.words,
+          layout_.inv_word_counts,
+          first_index_,
+          layout_.max_term_freqs[term]};
+}
+
+void Segment::AppendSealedTerm(TermId term_id, const std::vector<Posting> &postings) {
+  if (block_offsets_.empty()) {
+    block_offsets_.push_back(0);
+  }
+  double max_term_freq = 0.0;
+  for (const Posting &posting : postings) {
+    max_term_freq = std::max(max_term_freq, posting.term_freq);
+  }
+  EncodePostings(postings.data(), postings.data() + postings.size(), blocks_, words_);
+  term_ids_.push_back(term_id);
+  max_term_freqs_.push_back(max_term_freq);
+  block_offsets_.push_back(blocks_.size());
+}
+
+void Segment::FinishSealedLayout() {
+  if (block_offsets_.empty()) {
+    block_offsets_.push_back(0);
+  }
+  layout_ = {term_ids_.data(), block_offsets_.data(), max_term_freqs_.data(), blocks_.data(), words_.data(),
+             inv_word_counts_.data(), term_ids_.size()};
+  is_sealed_ = true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct TermFrequency {
+  TermId term_id;
+  uint32_t term_count;
+  double term_freq;
+};
+
+// Entry of the forward index; the term freq follows from the document length
+struct TermCount {
+  TermId term_id;
+  uint32_t term_count;
+};
+
+// Postings of the documents numbered [first_index, end_index). The active
+// segment takes new documents; once sealed, its postings never change and only
+// its deletion bitmap does, so sealed segments are safe to merge in the
+// background while queries run on them.
+class Segment {
+ public:
+  // Postings of a sealed segment: those of term_ids[i] (ascending) are the
+  // blocks[block_offsets[i]] .. blocks[block_offsets[i + 1]] packed in words.
+  // inv_word_counts holds 1 / (word count) of every document of the segment.
+  struct SealedLayout {
+    const TermId *term_ids = nullptr;
+    const uint64_t *block_offsets = nullptr;
+    const double *max_term_freqs = nullptr;
+    const PostingBlock *blocks = nullptr;
+    const uint32_t *words = nullptr;
+    const double *inv_word_counts = nullptr;
+    size_t term_count = 0;
+  };
+
+  explicit Segment(uint32_t first_index);
+  // Sealed segment reading the layout in place; storage keeps it alive
+  Segment(uint32_t first_index,
+          uint32_t document_count,
+          const SealedLayout &layout,
+          std::shared_ptr<const void> storage);
+  Segment(const Segment &) = delete;
+  Segment &operator=(const Segment &) = delete;
+
+  // Documents come in index order without gaps
+  void AddDocument(uint32_t document_index, const std::vector<TermFrequency> &word_freqs);
+  // Compresses the postings into the sealed layout and drops the insertion hash table
+  void Seal();
+  bool IsSealed() const;
+
+  uint32_t GetFirstIndex() const;
+  uint32_t GetEndIndex() const;
+  // Size of the index range, removed documents included
+  size_t GetDocumentCount() const;
+  size_t GetRemovedCount() const;
+  // Removed documents whose postings are still in the segment
+  size_t GetPendingRemovalCount() const;
+
+  // Returns an empty list for terms without postings in the segment
+  PostingList FindPostings(TermId term_id) const;
+  size_t GetPostingCount() const;
+  // Bytes taken by the postings and the inv_word_counts needed to decode them
+  size_t GetPostingByteCount() const;
+
+  void MarkRemoved(uint32_t document_index);
+  // Copies the removals of a segment whose range lies inside this one
+  void MarkRemovedFrom(const Segment &segment);
+
+  bool IsRemoved(uint32_t document_index) const {
+    const uint32_t offset = document_index - first_index_;
+    return (removed_bits_[offset / 64] >> (offset % 64)) & 1;
+  }
+
+  const std::vector<uint64_t> &GetRemovedBits() const;
+
+  // Merges adjacent sealed segments into a sealed one covering their ranges.
+  // Postings of documents marked in removed_bits (a snapshot of the segments'
+  // bitmaps) are dropped; the snapshot becomes the bitmap of the result.
+  static std::shared_ptr<Segment> Merge(const std::vector<std::shared_ptr<const Segment>> &segments,
+                                        const std::vector<std::vector<uint64_t>> &removed_bits);
+
+ private:
+  uint32_t first_index_;
+  uint32_t document_count_ = 0;
+  size_t removed_count_ = 0;
+  // Removed before the merge that built the segment dropped their postings
+  size_t dropped_count_ = 0;
+  bool is_sealed_ = false;
+  std::vector<uint64_t> removed_bits_;
+  std::vector<double> inv_word_counts_;
+
+  // Active segment: the postings of every term in their own growing list
+  std::vector<TermId> active_term_ids_;
+  std::vector<std::vector<Posting>> active_postings_;
+  std::vector<double> active_max_term_freqs_;
+  std::unordered_map<TermId, uint32_t> term_slots_;
+
+  // Sealed segment: the layout points either into the vectors below or into storage_
+  SealedLayout layout_;
+  std::vector<TermId> term_ids_;
+  std::vector<uint64_t> block_offsets_;
+  std::vector<double> max_term_freqs_;
+  std::vector<PostingBlock> blocks_;
+  std::vector<uint32_t> words_;
+  std::shared_ptr<const void> storage_;
+
+  PostingList GetSealedPostings(size_t term) const;
+  void AppendSealedTerm(TermId term_id, const std::vector<Posting> &postings);
+  void FinishSealedLayout();
+};
@@ -0,0 +1,161 @@
+#include "sharded_search_server.h"
+
+#include <cmath>
+
+ShardedSearchServer::ShardedSearchServer(const std::string &stop_words_text,
+                                         size_t shard_count,
+                                         const IndexOptions &options) {
+  CheckShardCount(shard_count);
+  shards_.reserve(shard_count);
+  for (size_t shard = 0; shard < shard_count; ++shard) {
+    shards_.push_back(std::make_unique<SearchServer>(stop_words_text, options));
+  }
+}
+
+ShardedSearchServer::ShardedSearchServer(const std::string_view &stop_words_text,
+                                         size_t shard_count,
+                                         const IndexOptions &options) {
+  CheckShardCount(shard_count);
+  shards_.reserve(shard_count);
+  for (size_t shard = 0; shard < shard_count; ++shard) {
+    shards_.push_back(std::make_unique<SearchServer>(stop_words_text, options));
+  }
+}
+
+void ShardedSearchServer::AddDocument(int document_id,
+                                      const std::string_view &document,
+                                      DocumentStatus status,
+                                      const std::vector<int> &ratings) {
+  // An id belongs to one shard, which rejects it when it is taken
+  shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::AddDocuments(const std::vector<DocumentInput> &documents) {
+  std::vector<std::vector<DocumentInput>> shard_documents(shards_.size());
+  for (const DocumentInput &document : documents) {
+    shard_documents[GetShardIndex(document.id)].push_back(document);
+  }
+  ForEachShard([&shard_documents](SearchServer &server, size_t shard) {
+    server.AddDocuments(std::execution::par, shard_documents[shard]);
+  });
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view &raw_query,
+                                                            DocumentStatus status,
+                                                            size_t top_k) const {
+  return FindTopDocuments(std::execution::seq, raw_query, DocumentFilter::ForStatus(status), top_k);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::execution::sequenced_policy seq,
+                                                            const std::string_view &raw_query,
+                                                            DocumentStatus status,
+                                                            size_t top_k) const {
+  return FindTopDocuments(seq, raw_query, DocumentFilter::ForStatus(status), top_k);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::execution::parallel_policy par,
+                                                            const std::string_view &raw_query,
+                                                            DocumentStatus status,
+                                                            size_t top_k) const {
+  return FindTopDocuments(par, raw_query, DocumentFilter::ForStatus(status), top_k);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const std::string_view &raw_query,
+                                                                                             int document_id) const {
+  return shards_[GetShardIndex(document_id)]->MatchDocument(raw_query, document_id);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const std::execution::parallel_policy par,
+                                                                                             const std::string_view &raw_query,
+                                                                                             int document_id) const {
+  return shards_[GetShardIndex(document_id)]->MatchDocument(par, raw_query, document_id);
+}
+
+std::map<std::string_view, double, std::less<>> ShardedSearchServer::GetWordFrequencies(int document_id) const {
+  return shards_[GetShardIndex(document_id)]->GetWordFrequencies(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+  shards_[GetShardIndex(document_id)]->RemoveDocument(document_id);
+}
+
+void ShardedSearchServer::RemoveDocuments(const std::vector<int> &document_ids) {
+  std::vector<std::vector<int>> shard_document_ids(shards_.size());
+  for (const int document_id : document_ids) {
+    shard_document_ids[GetShardIndex(document_id)].push_back(document_id);
+  }
+  ForEachShard([&shard_document_ids](SearchServer &server, size_t shard) {
+    server.RemoveDocuments(shard_document_ids[shard]);
+  });
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+  int document_count = 0;
+  for (const auto &shard : shards_) {
+    document_count += shard->GetDocumentCount();
+  }
+  return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+  return shards_.size();
+}
+
+const SearchServer &ShardedSearchServer::GetShard(size_t shard) const {
+  return *shards_.at(shard);
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+  // Mixed, so ids in steps of the shard count still spread over all shards
+  return MixFingerprintBits(static_cast<uint32_t>(document_id)) % shards_.size();
+}
+
+void ShardedSearchServer::WaitForMerges() {
+  for (auto &shard : shards_) {
+    shard->WaitForMerges();
+  }
+}
+
+MemoryUsage ShardedSearchServer::GetMemoryUsage() const {
+  MemoryUsage usage;
+  for (const auto &shard : shards_) {
+    const MemoryUsage shard_usage = shard->GetMemoryUsage();
+    usage.dictionary += shard_usage.dictionary;
+    usage.postings += shard_usage.postings;
+    usage.positions += shard_usage.positions;
+    usage.forward_index += shard_usage.forward_index;
+    usage.texts += shard_usage.texts;
+    usage.documents += shard_usage.documents;
+    usage.statistics += shard_usage.statistics;
+    usage.duplicates += shard_usage.duplicates;
+    usage.removed_documents += shard_usage.removed_documents;
+  }
+  return usage;
+}
+
+void ShardedSearchServer::CheckShardCount(size_t shard_count) {
+  using namespace std::literals;
+  if (shard_count == 0) {
+    throw std::invalid_argument("Shard count must be positive"s);
+  }
+}
+
+std::unordered_map<std::string_view, double> ShardedSearchServer::ComputeInverseDocumentFreqs(
+    const std::vector<std::vector<std::pair<std::string_view, uint32_t>>> &shard_document_freqs) const {
+  // Views of the first shard having a term stay valid while the shards live
+  std::unordered_map<std::string_view, uint32_t> document_freqs;
+  uint32_t document_count = 0;
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    for (const auto &[term, document_freq] : shard_document_freqs[shard]) {
+      document_freqs[term] += document_freq;
+    }
+    document_count += shards_[shard]->GetCorpusStatistics().GetDocumentCount();
+  }
+  // The expression of CorpusStatistics, for the IDF of a single server
+  std::unordered_map<std::string_view, double> inverse_document_freqs;
+  inverse_document_freqs.reserve(document_freqs.size());
+  for (const auto &[term, document_freq] : document_freqs) {
+    inverse_document_freqs.emplace(term, log(document_count * 1.0 / document_freq));
+  }
+  return inverse_document_freqs;
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "search_server.h"
+
+#include <algorithm>
+#include <exception>
+#include <execution>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Documents hash-partitioned by id over several SearchServer shards, each a
+// smaller index that stays in the caches of the core searching it. A query
+// goes to every shard twice: the shards first report the document freqs of
+// its plus terms, whose sums give the IDF over all documents, then each one
+// finds its top_k with that IDF and the tops are merged. Results are those of
+// one SearchServer holding every document, but for words with '*' matching
+// more than MAX_WILDCARD_TERM_COUNT terms, which each shard expands into its
+// own. Duplicates are only detected among the documents of a shard.
+class ShardedSearchServer {
+ public:
+  // Throws std::invalid_argument without shards
+  template<typename StringContainer>
+  ShardedSearchServer(const StringContainer &stop_words, size_t shard_count, const IndexOptions &options = {}) {
+    CheckShardCount(shard_count);
+    shards_.reserve(shard_count);
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+      shards_.push_back(std::make_unique<SearchServer>(stop_words, options));
+    }
+  }
+
+  ShardedSearchServer(const std::string &stop_words_text, size_t shard_count, const IndexOptions &options = {});
+  ShardedSearchServer(const std::string_view &stop_words_text, size_t shard_count, const IndexOptions &options = {});
+
+  void AddDocument(int document_id,
+                   const std::string_view &document,
+                   DocumentStatus status,
+                   const std::vector<int> &ratings);
+  // Every shard adds its documents in their order, all shards in parallel.
+  // When a shard rejects a document, those before it in the shard stay added,
+  // the other shards add theirs and the invalid_argument of the first such
+  // shard is thrown.
+  void AddDocuments(const std::vector<DocumentInput> &documents);
+
+  template<typename DocumentPredicate>
+  std::vector<Document> FindTopDocuments(const std::string_view &raw_query,
+                                         DocumentPredicate document_predicate,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k);
+  }
+  // The parallel version searches the shards in parallel, each on one thread
+  template<typename DocumentPredicate, typename ExecutionPolicy>
+  std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view &raw_query,
+                                         DocumentPredicate document_predicate,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const {
+    if (top_k == 0) {
+      return {};
+    }
+    // Parses the query on every shard, so an invalid one throws before the search round
+    const auto inverse_document_freqs = ComputeInverseDocumentFreqs(policy, raw_query);
+    const auto inverse_document_freq = [&inverse_document_freqs](const std::string_view &term) {
+      return inverse_document_freqs.at(term);
+    };
+
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    ForEachShard(policy, [&](const SearchServer &server, size_t shard) {
+      shard_documents[shard] = server.FindTopDocumentsWithIdf(raw_query, inverse_document_freq,
+                                                              document_predicate, top_k);
+    });
+
+    TopDocuments top_documents(top_k);
+    for (const auto &documents : shard_documents) {
+      for (const Document &document : documents) {
+        top_documents.Add(document);
+      }
+    }
+    return std::move(top_documents).Extract();
+  }
+
+  std::vector<Document> FindTopDocuments(const std::string_view &raw_query,
+                                         DocumentStatus status = DocumentStatus::ACTUAL,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy seq,
+                                         const std::string_view &raw_query,
+                                         DocumentStatus status = DocumentStatus::ACTUAL,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(const std::execution::parallel_policy par,
+                                         const std::string_view &raw_query,
+                                         DocumentStatus status = DocumentStatus::ACTUAL,
+                                         size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+  // Matched words view the dictionary of the document's shard
+  std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view &raw_query,
+                                                                          int document_id) const;
+  std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy par,
+                                                                          const std::string_view &raw_query,
+                                                                          int document_id) const;
+  std::map<std::string_view, double, std::less<>> GetWordFrequencies(int document_id) const;
+  void RemoveDocument(int document_id);
+  // Skips unknown ids; the shards remove theirs in parallel
+  void RemoveDocuments(const std::vector<int> &document_ids);
+
+  int GetDocumentCount() const;
+  size_t GetShardCount() const;
+  const SearchServer &GetShard(size_t shard) const;
+  // Shard a document with the id belongs to
+  size_t GetShardIndex(int document_id) const;
+  // Blocks until background merges of every shard are done
+  void WaitForMerges();
+  MemoryUsage GetMemoryUsage() const;
+
+ private:
+  std::vector<std::unique_ptr<SearchServer>> shards_;
+
+  static void CheckShardCount(size_t shard_count);
+  // IDF over all shards of the plus terms of the query with live documents, by
+  // text; the shards report their document freqs under the policy
+  template<typename ExecutionPolicy>
+  std::unordered_map<std::string_view, double> ComputeInverseDocumentFreqs(const ExecutionPolicy &policy,
+                                                                           const std::string_view &raw_query) const {
+    std::vector<std::vector<std::pair<std::string_view, uint32_t>>> shard_document_freqs(shards_.size());
+    ForEachShard(policy, [&](const SearchServer &server, size_t shard) {
+      shard_document_freqs[shard] = server.GetQueryDocumentFreqs(raw_query);
+    });
+    return ComputeInverseDocumentFreqs(shard_document_freqs);
+  }
+  std::unordered_map<std::string_view, double> ComputeInverseDocumentFreqs(
+      const std::vector<std::vector<std::pair<std::string_view, uint32_t>>> &shard_document_freqs) const;
+  // Runs task(shard_server, shard) on every shard under the policy, then
+  // rethrows the exception of the first failed one; an exception must not
+  // leave a parallel algorithm, which would call std::terminate
+  template<typename ExecutionPolicy, typename Task>
+  void ForEachShard(const ExecutionPolicy &policy, Task task) const {
+    std::vector<size_t> shards(shards_.size());
+    std::iota(shards.begin(), shards.end(), 0);
+    std::vector<std::exception_ptr> errors(shards_.size());
+    std::for_each(policy, shards.begin(), shards.end(), [&](size_t shard) {
+      try {
+        task(*shards_[shard], shard);
+      } catch (...) {
+        errors[shard] = std::current_exception();
+      }
+    });
+    for (const auto &error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+  // The same in parallel, for tasks modifying the shards
+  template<typename Task>
+  void ForEachShard(Task task) {
+    std::as_const(*this).ForEachShard(std::execution::par, [this, &task](const SearchServer &, size_t shard) {
+      task(*shards_[shard], shard);
+    });
+  }
+};
@@ -1,45 +1,164 @@
 #include "string_processing.h"
 
-std::vector<std::string> SplitIntoWords(const std::string &text) {
-  std::vector<std::string> words;
-  std::string word;
-  for (const char c : text) {
-    if (c == ' ') {
-      if (!word.empty()) {
-        words.push_back(word);
-        word.clear();
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRING_PROCESSING_X86
+#endif
+
+namespace {
+
+bool IsControlCharacter(char c) {
+  return static_cast<unsigned char>(c) < ' ';
+}
+
+// Appends the words ended by the spaces marked in space_mask, bit i standing for data[offset + i]
+void AppendWords(const char *data, size_t offset, uint32_t space_mask, size_t &word_begin,
+                 std::vector<std::string_view> &words) {
+  while (space_mask != 0) {
+    const size_t space = offset + __builtin_ctz(space_mask);
+    if (space > word_begin) {
+      words.emplace_back(data + word_begin, space - word_begin);
+    }
+    word_begin = space + 1;
+    space_mask &= space_mask - 1;
+  }
+}
+
+// Byte by byte from offset on; returns whether a control character was met
+bool SplitTail(const char *data, size_t size, size_t offset, size_t word_begin, std::vector<std::string_view> &words) {
+  bool has_control_character = false;
+  for (; offset < size; ++offset) {
+    if (data[offset] == ' ') {
+      if (offset > word_begin) {
+        words.emplace_back(data + word_begin, offset - word_begin);
       }
-    } else {
-      word += c;
+      word_begin = offset + 1;
+    } else if (IsControlCharacter(data[offset])) {
+      has_control_character = true;
     }
   }
-  if (!word.empty()) {
-    words.push_back(word);
+  if (size > word_begin) {
+    words.emplace_back(data + word_begin, size - word_begin);
   }
+  return has_control_character;
+}
 
-  return words;
+bool SplitScalar(const char *data, size_t size, std::vector<std::string_view> &words) {
+  return SplitTail(data, size, 0, 0, words);
+}
+
+#ifdef STRING_PROCESSING_X86
+
+__attribute__((target("sse2")))
+bool SplitSse2(const char *data, size_t size, std::vector<std::string_view> &words) {
+  const __m128i spaces = _mm_set1_epi8(' ');
+  const __m128i last_control_character = _mm_set1_epi8(' ' - 1);
+  __m128i control_characters = _mm_setzero_si128();
+  size_t word_begin = 0;
+  size_t offset = 0;
+  for (; offset + 16 <= size; offset += 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + offset));
+    // Unsigned chunk <= 31
+    control_characters = _mm_or_si128(control_characters,
+                                      _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control_character), chunk));
+    AppendWords(data, offset, _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, spaces)), word_begin, words);
+  }
+  const bool has_control_character = _mm_movemask_epi8(control_characters) != 0;
+  return SplitTail(data, size, offset, word_begin, words) || has_control_character;
+}
+
+__attribute__((target("avx2")))
+bool SplitAvx2(const char *data, size_t size, std::vector<std::string_view> &words) {
+  const __m256i spaces = _mm256_set1_epi8(' ');
+  const __m256i last_control_character = _mm256_set1_epi8(' ' - 1);
+  __m256i control_characters = _mm256_setzero_si256();
+  size_t word_begin = 0;
+  size_t offset = 0;
+  for (; offset + 32 <= size; offset += 32) {
+    const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + offset));
+    control_characters = _mm256_or_si256(control_characters,
+                                         _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, last_control_character), chunk));
+    AppendWords(data, offset, static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, spaces))),
+                word_begin, words);
+  }
+  const bool has_control_character = _mm256_movemask_epi8(control_characters) != 0;
+  return SplitTail(data, size, offset, word_begin, words) || has_control_character;
+}
+
+#endif
+
+using SplitKernel = bool (*)(const char *data, size_t size, std::vector<std::string_view> &words);
+
+SplitKernel SelectSplitKernel() {
+#ifdef STRING_PROCESSING_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return SplitAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SplitSse2;
+  }
+#endif
+  return SplitScalar;
+}
+
+bool SplitWords(const std::string_view &text, std::vector<std::string_view> &words) {
+  static const SplitKernel split = SelectSplitKernel();
+  return split(text.data(), text.size(), words);
+}
+
+}
+
+std::vector<std::string> SplitIntoWords(const std::string &text) {
+  std::vector<std::string_view> word_views;
+  SplitWords(text, word_views);
+  return {word_views.begin(), word_views.end()};
 }
 
 std::vector<std::string_view> SplitIntoWords(const std::string_view &text) {
   std::vector<std::string_view> words;
-  auto word_begin = text.begin();
-  size_t word_end = 0;
-  for (size_t i =0; i < text.size(); ++i) {
-    if (text[i] == ' ') {
-      if (word_end != 0) {
-        std::string_view word(word_begin, word_end);
-        words.push_back(word);
-        word_begin = word_begin+word_end+1;
-        word_end = 0;
-      }
+  SplitWords(text, words);
+  return words;
+}
+
+// Greedy with backtracking to the last star, which is enough for stars alone
+bool MatchesWildcard(const std::string_view &pattern, const std::string_view &text) {
+  size_t pattern_pos = 0;
+  size_t text_pos = 0;
+  size_t star_pos = std::string_view::npos;
+  size_t star_text_pos = 0;
+  while (text_pos < text.size()) {
+    if (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+      star_pos = pattern_pos++;
+      star_text_pos = text_pos;
+    } else if (pattern_pos < pattern.size() && pattern[pattern_pos] == text[text_pos]) {
+      ++pattern_pos;
+      ++text_pos;
+    } else if (star_pos != std::string_view::npos) {
+      pattern_pos = star_pos + 1;
+      text_pos = ++star_text_pos;
     } else {
-      ++word_end;
+      return false;
     }
   }
-  if (word_end != 0) {
-    std::string_view word(word_begin, word_end);
-    words.push_back(word);
+  while (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+    ++pattern_pos;
   }
+  return pattern_pos == pattern.size();
+}
 
-  return words;
+WordSplitter &WordSplitter::ForCurrentThread() {
+  static thread_local WordSplitter splitter;
+  return splitter;
+}
+
+std::vector<std::string_view> &WordSplitter::Split(const std::string_view &text) {
+  words_.clear();
+  has_control_character_ = SplitWords(text, words_);
+  return words_;
+}
+
+bool WordSplitter::HasControlCharacter() const {
+  return has_control_character_;
 }
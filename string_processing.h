@@ -6,6 +6,26 @@
 
 std::vector<std::string> SplitIntoWords(const std::string &text);
 std::vector<std::string_view> SplitIntoWords(const std::string_view &text);
+// Whether text matches pattern, where every '*' stands for any run of characters
+bool MatchesWildcard(const std::string_view &pattern, const std::string_view &text);
+
+// Splits text at spaces and looks for control characters (bytes 0 to 31) in
+// the same pass, 32 or 16 bytes at a time when the CPU has AVX2 or SSE2. The
+// words point into the text and live in the splitter until the next Split, so
+// a reused splitter stops allocating once its buffer has grown.
+class WordSplitter {
+ public:
+  // Every thread owns one splitter, reused from text to text
+  static WordSplitter &ForCurrentThread();
+
+  std::vector<std::string_view> &Split(const std::string_view &text);
+  // Whether the text of the last Split holds a control character
+  bool HasControlCharacter() const;
+
+ private:
+  std::vector<std::string_view> words_;
+  bool has_control_character_ = false;
+};
 
 
 template<typename StringContainer>
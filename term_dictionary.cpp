@@ -0,0 +1,246 @@
+#include "term_dictionary.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+uint64_t MixBits(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+}
+
+uint64_t HashTerm(const std::string_view &term, uint64_t seed) {
+  uint64_t hash = seed ^ (term.size() * 0x9e3779b97f4a7c15ULL);
+  size_t pos = 0;
+  for (; pos + sizeof(uint64_t) <= term.size(); pos += sizeof(uint64_t)) {
+    uint64_t chunk;
+    std::memcpy(&chunk, term.data() + pos, sizeof(chunk));
+    hash = MixBits(hash ^ chunk);
+  }
+  uint64_t tail = 0;
+  if (pos < term.size()) {  // An empty term may have no data
+    std::memcpy(&tail, term.data() + pos, term.size() - pos);
+  }
+  return MixBits(hash ^ tail);
+}
+
+TermDictionary::TermDictionary(const FrozenLayout &layout, std::shared_ptr<const void> storage)
+    : mapped_(layout)
+    , storage_(std::move(storage))
+    , sorted_terms_(layout.sorted_terms)
+    , is_frozen_(true)
+    , displacements_(layout.displacements)
+    , displacement_count_(layout.displacement_count)
+    , perfect_slots_(layout.perfect_slots)
+    , perfect_slot_count_(layout.perfect_slot_count) {
+  perfect_hash_.seed = layout.perfect_hash_seed;
+}
+
+TermId TermDictionary::Add(const std::string_view &term) {
+  const TermId existing = Find(term);
+  if (existing != NO_TERM) {
+    return existing;
+  }
+  if (is_frozen_) {
+    Thaw();
+  }
+  const TermId term_id = size();
+  terms_.push_back(StoreTerm(term));
+  term_to_id_.emplace(terms_.back(), term_id);
+  recent_terms_.emplace(terms_.back(), term_id);
+  if (recent_terms_.size() > std::max(MIN_RECENT_TERM_COUNT, size() / 8)) {
+    SortTerms();
+  }
+  return term_id;
+}
+
+TermId TermDictionary::Find(const std::string_view &term) const {
+  if (is_frozen_) {
+    return FindFrozen(term);
+  }
+  const auto it = term_to_id_.find(term);
+  return it == term_to_id_.end() ? NO_TERM : it->second;
+}
+
+std::string_view TermDictionary::GetTerm(TermId term_id) const {
+  if (term_id < mapped_.term_count) {
+    const uint64_t offset = mapped_.term_offsets[term_id];
+    return {mapped_.term_bytes + offset, mapped_.term_offsets[term_id + 1] - offset};
+  }
+  return terms_[term_id - mapped_.term_count];
+}
+
+size_t TermDictionary::size() const {
+  return mapped_.term_count + terms_.size();
+}
+
+void TermDictionary::Freeze() {
+  if (is_frozen_) {
+    return;
+  }
+  if (!recent_terms_.empty()) {
+    SortTerms();
+  }
+  perfect_hash_ = BuildPerfectHash();
+  displacements_ = perfect_hash_.displacements.data();
+  displacement_count_ = perfect_hash_.displacements.size();
+  perfect_slots_ = perfect_hash_.slots.data();
+  perfect_slot_count_ = perfect_hash_.slots.size();
+  is_frozen_ = true;
+  term_to_id_ = {};
+}
+
+bool TermDictionary::IsFrozen() const {
+  return is_frozen_;
+}
+
+TermDictionary::PerfectHash TermDictionary::BuildPerfectHash() const {
+  PerfectHash perfect_hash;
+  for (uint64_t seed = 0; !TryBuildPerfectHash(seed, perfect_hash); ++seed) {
+  }
+  return perfect_hash;
+}
+
+FrontCodedTerms TermDictionary::BuildSortedTerms() const {
+  std::vector<std::pair<std::string_view, uint32_t>> terms(size());
+  for (TermId term_id = 0; term_id < size(); ++term_id) {
+    terms[term_id] = {GetTerm(term_id), term_id};
+  }
+  std::sort(terms.begin(), terms.end());
+  return FrontCodedTerms(terms);
+}
+
+size_t TermDictionary::GetSortedTermByteCount() const {
+  return sorted_terms_.GetByteCount();
+}
+
+size_t TermDictionary::GetByteCount() const {
+  size_t byte_count = arena_byte_count_ + terms_.capacity() * sizeof(std::string_view)
+      + EstimateHashTableByteCount(term_to_id_) + EstimateTreeByteCount(recent_terms_)
+      + perfect_hash_.displacements.capacity() * sizeof(uint32_t) + perfect_hash_.slots.capacity() * sizeof(TermId)
+      + sorted_terms_.GetByteCount();
+  if (mapped_.term_count > 0) {
+    byte_count += mapped_.term_offsets[mapped_.term_count] + (mapped_.term_count + 1) * sizeof(uint64_t)
+        + mapped_.displacement_count * sizeof(uint32_t) + mapped_.perfect_slot_count * sizeof(TermId);
+  }
+  return byte_count;
+}
+
+std::string_view TermDictionary::StoreTerm(const std::string_view &term) {
+  if (term.size() > ARENA_BLOCK_SIZE) {
+    // Oversized terms get a block of their own in front of the one being filled
+    auto oversized_block = std::make_unique<char[]>(term.size());
+    arena_byte_count_ += term.size();
+    std::memcpy(oversized_block.get(), term.data(), term.size());
+    const char *data = oversized_block.get();
+    arena_blocks_.insert(arena_blocks_.end() - (arena_blocks_.empty() ? 0 : 1), std::move(oversized_block));
+    return {data, term.size()};
+  }
+  if (arena_block_used_ + term.size() > ARENA_BLOCK_SIZE) {
+    arena_blocks_.push_back(std::make_unique<char[]>(ARENA_BLOCK_SIZE));
+    arena_byte_count_ += ARENA_BLOCK_SIZE;
+    arena_block_used_ = 0;
+  }
+  char *data = arena_blocks_.back().get() + arena_block_used_;
+  std::memcpy(data, term.data(), term.size());
+  arena_block_used_ += term.size();
+  return {data, term.size()};
+}
+
+// Hash-and-displace: every bucket of about four terms gets the displacement
+// that sends all of its terms to free slots of a table with 80% load
+TermId TermDictionary::FindFrozen(const std::string_view &term) const {
+  if (perfect_slot_count_ == 0) {
+    return NO_TERM;
+  }
+  const uint64_t hash = HashTerm(term, perfect_hash_.seed);
+  const uint64_t step = MixBits(hash) | 1;
+  const uint32_t displacement = displacements_[(hash >> 32) % displacement_count_];
+  const TermId term_id = perfect_slots_[(hash + displacement * step) % perfect_slot_count_];
+  if (term_id != NO_TERM && GetTerm(term_id) == term) {
+    return term_id;
+  }
+  return NO_TERM;
+}
+
+bool TermDictionary::TryBuildPerfectHash(uint64_t seed, PerfectHash &perfect_hash) const {
+  const size_t term_count = size();
+  const size_t bucket_count = term_count / 4 + 1;
+  const size_t slot_count = term_count + term_count / 4 + 1;
+
+  std::vector<uint64_t> hashes(term_count);
+  std::vector<std::vector<TermId>> buckets(bucket_count);
+  for (TermId term_id = 0; term_id < term_count; ++term_id) {
+    hashes[term_id] = HashTerm(GetTerm(term_id), seed);
+    buckets[(hashes[term_id] >> 32) % bucket_count].push_back(term_id);
+  }
+  std::vector<uint32_t> bucket_order(bucket_count);
+  std::iota(bucket_order.begin(), bucket_order.end(), 0);
+  std::stable_sort(bucket_order.begin(), bucket_order.end(), [&buckets](uint32_t lhs, uint32_t rhs) {
+    return buckets[lhs].size() > buckets[rhs].size();
+  });
+
+  std::vector<uint32_t> displacements(bucket_count, 0);
+  std::vector<TermId> slots(slot_count, NO_TERM);
+  std::vector<size_t> bucket_slots;
+  for (const uint32_t bucket : bucket_order) {
+    if (buckets[bucket].empty()) {
+      break;
+    }
+    bool placed = false;
+    for (uint32_t displacement = 0; displacement < 4 * slot_count && !placed; ++displacement) {
+      bucket_slots.clear();
+      placed = true;
+      for (const TermId term_id : buckets[bucket]) {
+        const uint64_t step = MixBits(hashes[term_id]) | 1;
+        const size_t slot = (hashes[term_id] + displacement * step) % slot_count;
+        if (slots[slot] != NO_TERM
+            || std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+          placed = false;
+          break;
+        }
+        bucket_slots.push_back(slot);
+      }
+      if (placed) {
+        displacements[bucket] = displacement;
+        for (size_t i = 0; i < bucket_slots.size(); ++i) {
+          slots[bucket_slots[i]] = buckets[bucket][i];
+        }
+      }
+    }
+    if (!placed) {
+      return false;
+    }
+  }
+  perfect_hash.seed = seed;
+  perfect_hash.displacements = std::move(displacements);
+  perfect_hash.slots = std::move(slots);
+  return true;
+}
+
+void TermDictionary::SortTerms() {
+  sorted_terms_ = BuildSortedTerms();
+  recent_terms_.clear();
+}
+
+void TermDictionary::Thaw() {
+  term_to_id_.reserve(size());
+  for (TermId term_id = 0; term_id < size(); ++term_id) {
+    term_to_id_.emplace(GetTerm(term_id), term_id);
+  }
+  perfect_hash_ = {};
+  displacements_ = nullptr;
+  displacement_count_ = 0;
+  perfect_slots_ = nullptr;
+  perfect_slot_count_ = 0;
+  is_frozen_ = false;
+}
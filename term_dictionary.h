@@ -0,0 +1,121 @@
+#pragma once
+#include "front_coded_terms.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = uint32_t;
+
+uint64_t HashTerm(const std::string_view &term, uint64_t seed = 0);
+
+struct TermHash {
+  size_t operator()(const std::string_view &term) const {
+    return HashTerm(term);
+  }
+};
+
+// Owns the bytes of every distinct term once and numbers terms densely.
+// Views returned by GetTerm stay valid for the lifetime of the dictionary.
+// A front-coded sorted copy of the terms serves prefix searches; terms added
+// since it was built wait in a small ordered map until there are enough of
+// them to rebuild it.
+class TermDictionary {
+ public:
+  static constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+  // Hash-and-displace table sending every term to its own slot
+  struct PerfectHash {
+    uint64_t seed = 0;
+    std::vector<uint32_t> displacements;
+    std::vector<TermId> slots;
+  };
+
+  // Frozen dictionary stored outside of it: term i is
+  // term_bytes[term_offsets[i]] .. term_bytes[term_offsets[i + 1]]
+  struct FrozenLayout {
+    const uint64_t *term_offsets = nullptr;
+    const char *term_bytes = nullptr;
+    size_t term_count = 0;
+    uint64_t perfect_hash_seed = 0;
+    const uint32_t *displacements = nullptr;
+    size_t displacement_count = 0;
+    const TermId *perfect_slots = nullptr;
+    size_t perfect_slot_count = 0;
+    // Every term, front coded in byte order
+    FrontCodedTerms::Layout sorted_terms;
+  };
+
+  TermDictionary() = default;
+  // Frozen dictionary reading the layout in place; storage keeps it alive.
+  // Terms added later are stored in the dictionary itself.
+  TermDictionary(const FrozenLayout &layout, std::shared_ptr<const void> storage);
+  TermDictionary(const TermDictionary &) = delete;
+  TermDictionary &operator=(const TermDictionary &) = delete;
+  TermDictionary(TermDictionary &&) = default;
+  TermDictionary &operator=(TermDictionary &&) = default;
+
+  TermId Add(const std::string_view &term);
+  // Returns NO_TERM for unknown terms
+  TermId Find(const std::string_view &term) const;
+  std::string_view GetTerm(TermId term_id) const;
+  size_t size() const;
+
+  // Replaces the hash table by a perfect hash; the next Add of a new term thaws it back
+  void Freeze();
+  bool IsFrozen() const;
+  PerfectHash BuildPerfectHash() const;
+
+  // Calls visitor(term, term_id) for every term starting with prefix, in no
+  // particular order; the term view is valid during the call only
+  template<typename Visitor>
+  void ForEachTermWithPrefix(const std::string_view &prefix, Visitor visitor) const {
+    sorted_terms_.ForEachWithPrefix(prefix, visitor);
+    for (auto it = recent_terms_.lower_bound(prefix);
+         it != recent_terms_.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+      visitor(it->first, it->second);
+    }
+  }
+  // Every term front coded in byte order, as FrozenLayout::sorted_terms expects
+  FrontCodedTerms BuildSortedTerms() const;
+  // Bytes of the sorted copy used for prefix search
+  size_t GetSortedTermByteCount() const;
+  // Bytes of the terms, their lookups and the sorted copy
+  size_t GetByteCount() const;
+
+ private:
+  static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+  // The sorted terms are rebuilt once the recent ones outnumber this and an eighth of all terms
+  static constexpr size_t MIN_RECENT_TERM_COUNT = 1024;
+
+  std::vector<std::unique_ptr<char[]>> arena_blocks_;
+  size_t arena_block_used_ = ARENA_BLOCK_SIZE;
+  size_t arena_byte_count_ = 0;
+  // Terms below mapped_.term_count are read from the frozen layout, the rest from terms_
+  FrozenLayout mapped_;
+  std::shared_ptr<const void> storage_;
+  std::vector<std::string_view> terms_;
+  std::unordered_map<std::string_view, TermId, TermHash> term_to_id_;
+  FrontCodedTerms sorted_terms_;
+  // Terms added after sorted_terms_ was built
+  std::map<std::string_view, TermId, std::less<>> recent_terms_;
+
+  bool is_frozen_ = false;
+  // Either built in memory or the one of the frozen layout
+  PerfectHash perfect_hash_;
+  const uint32_t *displacements_ = nullptr;
+  size_t displacement_count_ = 0;
+  const TermId *perfect_slots_ = nullptr;
+  size_t perfect_slot_count_ = 0;
+
+  std::string_view StoreTerm(const std::string_view &term);
+  TermId FindFrozen(const std::string_view &term) const;
+  bool TryBuildPerfectHash(uint64_t seed, PerfectHash &perfect_hash) const;
+  void Thaw();
+  void SortTerms();
+};
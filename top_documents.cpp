@@ -0,0 +1,89 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+bool IsMoreRelevant(const Document &lhs, const Document &rhs) {
+  if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_EPSILON) {
+    if (lhs.rating == rhs.rating) {
+      return lhs.id < rhs.id;
+    }
+    return lhs.rating > rhs.rating;
+  } else {
+    return lhs.relevance > rhs.relevance;
+  }
+}
+
+TopDocuments::TopDocuments(size_t top_k, std::pmr::memory_resource *resource)
+    : top_k_(top_k)
+    , heap_(resource) {
+  // top_k may be far beyond the candidates, the heap grows as it fills
+  heap_.reserve(std::min(top_k, INITIAL_CAPACITY));
+}
+
+void TopDocuments::Add(const Document &document) {
+  if (heap_.size() < top_k_) {
+    heap_.push_back(document);
+    std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+  } else if (top_k_ > 0 && IsMoreRelevant(document, heap_.front())) {
+    std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    heap_.back() = document;
+    std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+  }
+}
+
+bool TopDocuments::IsFull() const {
+  return heap_.size() >= top_k_;
+}
+
+const Document &TopDocuments::GetLeastRelevant() const {
+  return heap_.front();
+}
+
+void TopDocuments::Merge(const TopDocuments &other) {
+  for (const Document &document : other.heap_) {
+    Add(document);
+  }
+}
+
+std::vector<Document> TopDocuments::Extract() &&{
+  std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+  return {heap_.begin(), heap_.end()};
+}
+
+std::vector<Document> SelectTopDocuments(const std::execution::sequenced_policy seq,
+                                         const std::pmr::vector<Document> &documents,
+                                         size_t top_k,
+                                         std::pmr::memory_resource *resource) {
+  TopDocuments top_documents(top_k, resource);
+  for (const Document &document : documents) {
+    top_documents.Add(document);
+  }
+  return std::move(top_documents).Extract();
+}
+
+std::vector<Document> SelectTopDocuments(const std::execution::parallel_policy par,
+                                         const std::pmr::vector<Document> &documents,
+                                         size_t top_k,
+                                         std::pmr::memory_resource *resource) {
+  const size_t thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  const size_t chunk_count = std::clamp<size_t>(documents.size() / 4096, 1, thread_count);
+  const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+  std::vector<TopDocuments> chunk_tops(chunk_count, TopDocuments(top_k));
+  std::vector<size_t> chunks(chunk_count);
+  std::iota(chunks.begin(), chunks.end(), 0);
+  std::for_each(par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+    const size_t first = std::min(chunk * chunk_size, documents.size());
+    const size_t last = std::min(first + chunk_size, documents.size());
+    for (size_t i = first; i < last; ++i) {
+      chunk_tops[chunk].Add(documents[i]);
+    }
+  });
+  TopDocuments top_documents(top_k, resource);
+  for (const TopDocuments &chunk_top : chunk_tops) {
+    top_documents.Merge(chunk_top);
+  }
+  return std::move(top_documents).Extract();
+}
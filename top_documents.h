@@ -0,0 +1,45 @@
+#pragma once
+#include "document.h"
+
+#include <cstddef>
+#include <execution>
+#include <memory_resource>
+#include <vector>
+
+const double RELEVANCE_EPSILON = 1e-6;
+
+// Relevances closer than RELEVANCE_EPSILON are ordered by rating, full ties by id
+bool IsMoreRelevant(const Document &lhs, const Document &rhs);
+
+// Keeps the top_k most relevant documents seen so far in a bounded heap
+// whose front is the least relevant of them
+class TopDocuments {
+ public:
+  explicit TopDocuments(size_t top_k, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  void Add(const Document &document);
+  bool IsFull() const;
+  // Requires at least one kept document
+  const Document &GetLeastRelevant() const;
+  void Merge(const TopDocuments &other);
+  // The kept documents, most relevant first, in memory of the default allocator
+  std::vector<Document> Extract() &&;
+
+ private:
+  static constexpr size_t INITIAL_CAPACITY = 64;
+
+  size_t top_k_;
+  std::pmr::vector<Document> heap_;
+};
+
+// The heap lives in resource, only the result is allocated on the heap
+std::vector<Document> SelectTopDocuments(const std::execution::sequenced_policy seq,
+                                         const std::pmr::vector<Document> &documents,
+                                         size_t top_k,
+                                         std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+// Every chunk of documents is reduced to its own heap, heaps are merged at the
+// end into one that lives in resource
+std::vector<Document> SelectTopDocuments(const std::execution::parallel_policy par,
+                                         const std::pmr::vector<Document> &documents,
+                                         size_t top_k,
+                                         std::pmr::memory_resource *resource = std::pmr::get_default_resource());
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// LEB128: seven bits per byte, low bits first, the high bit set on all bytes but the last
+inline void AppendVarint(uint32_t value, std::vector<uint8_t> &bytes) {
+  while (value >= 0x80) {
+    bytes.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  bytes.push_back(static_cast<uint8_t>(value));
+}
+
+inline uint32_t ReadVarint(const uint8_t *&data) {
+  uint32_t value = 0;
+  int shift = 0;
+  while (*data & 0x80) {
+    value |= static_cast<uint32_t>(*data++ & 0x7f) << shift;
+    shift += 7;
+  }
+  return value | static_cast<uint32_t>(*data++) << shift;
+}
+
+// ReadVarint of untrusted bytes: false when the varint runs up to last or
+// beyond five bytes
+inline bool ReadVarintChecked(const uint8_t *&data, const uint8_t *last, uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 35 && data != last; shift += 7) {
+    const uint8_t byte = *data++;
+    value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void SkipVarints(const uint8_t *&data, uint32_t count) {
+  for (; count > 0; --count) {
+    while (*data++ & 0x80) {
+    }
+  }
+}
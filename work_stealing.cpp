@@ -0,0 +1,32 @@
+#include "work_stealing.h"
+
+void StealableRange::Assign(size_t first, size_t last) {
+  std::lock_guard lock(mx_);
+  first_ = first;
+  last_ = last;
+}
+
+bool StealableRange::PopFront(size_t &task) {
+  std::lock_guard lock(mx_);
+  if (first_ == last_) {
+    return false;
+  }
+  task = first_++;
+  return true;
+}
+
+bool StealableRange::StealFrom(StealableRange &victim) {
+  size_t first;
+  size_t last;
+  {
+    std::lock_guard lock(victim.mx_);
+    if (victim.first_ == victim.last_) {
+      return false;
+    }
+    last = victim.last_;
+    first = victim.last_ - (victim.last_ - victim.first_ + 1) / 2;
+    victim.last_ = first;
+  }
+  Assign(first, last);
+  return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <execution>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+// Task indices not yet taken by one worker. The owner takes them from the
+// front, idle workers steal the back half.
+class StealableRange {
+ public:
+  void Assign(size_t first, size_t last);
+  bool PopFront(size_t &task);
+  // Moves the back half of the victim's tasks into this range
+  bool StealFrom(StealableRange &victim);
+
+ private:
+  std::mutex mx_;
+  size_t first_ = 0;
+  size_t last_ = 0;
+};
+
+// Runs task(i) for every i in [0, task_count) on all cores. Every worker starts
+// with a contiguous chunk of indices and steals from the others once it is done;
+// a worker the pool starts late finds its chunk stolen and returns.
+// The first exception of a task stops the workers taking new tasks and is
+// rethrown on the calling thread.
+template<typename Task>
+void ParallelForWorkStealing(size_t task_count, Task task) {
+  const size_t worker_count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(task_count, 1));
+  std::vector<StealableRange> ranges(worker_count);
+  for (size_t worker = 0; worker < worker_count; ++worker) {
+    ranges[worker].Assign(task_count * worker / worker_count, task_count * (worker + 1) / worker_count);
+  }
+
+  std::atomic<bool> has_failed{false};
+  std::exception_ptr error;
+  std::mutex error_mx;
+  const auto run_worker = [&](size_t worker) {
+    size_t current_task;
+    while (true) {
+      while (!has_failed.load(std::memory_order_relaxed) && ranges[worker].PopFront(current_task)) {
+        try {
+          task(current_task);
+        } catch (...) {
+          std::lock_guard lock(error_mx);
+          if (!error) {
+            error = std::current_exception();
+          }
+          has_failed.store(true, std::memory_order_relaxed);
+        }
+      }
+      if (has_failed.load(std::memory_order_relaxed)) {
+        return;
+      }
+      bool has_stolen = false;
+      for (size_t shift = 1; shift < worker_count && !has_stolen; ++shift) {
+        has_stolen = ranges[worker].StealFrom(ranges[(worker + shift) % worker_count]);
+      }
+      if (!has_stolen) {
+        return;
+      }
+    }
+  };
+
+  // The workers run on the long-lived threads of the parallel algorithms, so
+  // thread_local arenas and accumulators are reused from batch to batch
+  std::vector<size_t> workers(worker_count);
+  std::iota(workers.begin(), workers.end(), 0);
+  std::for_each(std::execution::par, workers.begin(), workers.end(), run_worker);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}